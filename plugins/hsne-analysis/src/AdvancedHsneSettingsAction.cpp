@@ -1,6 +1,10 @@
 #include "AdvancedHsneSettingsAction.h"
 #include "HsneSettingsAction.h"
 #include "InteractiveHsnePlugin.h"
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <thread>
 
 using namespace mv::gui;
 
@@ -19,7 +23,8 @@ AdvancedHsneSettingsAction::AdvancedHsneSettingsAction(HsneSettingsAction& hsneS
     _initWithPCAAction(this, "Init with PCA (of landmark data)"),
     _pcaAlgorithmAction(this, "PCA alg"),
     _hardCutOffAction(this, "Hard cut off"),
-    _hardCutOffPercentageAction(this, "% hard cut off")
+    _hardCutOffPercentageAction(this, "% hard cut off"),
+    _numThreadsAction(this, "Threads")
 {
     setText("Advanced HSNE");
     setObjectName("Advanced HSNE");
@@ -28,7 +33,7 @@ AdvancedHsneSettingsAction::AdvancedHsneSettingsAction(HsneSettingsAction& hsneS
     for (auto& action : WidgetActions{ &_numWalksForLandmarkSelectionAction, &_numWalksForLandmarkSelectionThresholdAction,
         &_randomWalkLengthAction, &_numWalksForAreaOfInfluenceAction, &_minWalksRequiredAction,
         &_minWalksRequiredAction, &_numTreesAknnAction, &_HNSW_M_Action, &_HNSW_eff_Action, &_useOutOfCoreComputationAction,
-        &_initWithPCAAction, &_hardCutOffAction, &_hardCutOffPercentageAction })
+        &_initWithPCAAction, &_hardCutOffAction, &_hardCutOffPercentageAction, &_numThreadsAction })
         addAction(action);
 
     _numWalksForLandmarkSelectionAction.setDefaultWidgetFlags(IntegralAction::SpinBox);
@@ -43,6 +48,7 @@ AdvancedHsneSettingsAction::AdvancedHsneSettingsAction(HsneSettingsAction& hsneS
     _initWithPCAAction.setDefaultWidgetFlags(ToggleAction::CheckBox);
     _hardCutOffAction.setDefaultWidgetFlags(ToggleAction::CheckBox);
     _hardCutOffPercentageAction.setDefaultWidgetFlags(IntegralAction::SpinBox | IntegralAction::Slider);
+    _numThreadsAction.setDefaultWidgetFlags(IntegralAction::SpinBox | IntegralAction::Slider);
 
     _numWalksForLandmarkSelectionAction.setToolTip("Number of walks for landmark selection");
     _numWalksForLandmarkSelectionThresholdAction.setToolTip("Threshold for landmark selection");
@@ -57,6 +63,7 @@ AdvancedHsneSettingsAction::AdvancedHsneSettingsAction(HsneSettingsAction& hsneS
     _pcaAlgorithmAction.setToolTip("Type of PCA algorithm");
     _hardCutOffAction.setToolTip("Select landmarks based on a user provided hard percentage cut off, instead of data-driven");
     _hardCutOffPercentageAction.setToolTip("Percentage of previous level landmarks to use in next level when using the hard cut off");
+    _numThreadsAction.setToolTip("Maximum number of threads shared by all parallel computations (hierarchy, scale updates and t-SNE)");
 
     const auto& hsneParameters = hsneSettingsAction.getHsneParameters();
 
@@ -74,6 +81,7 @@ AdvancedHsneSettingsAction::AdvancedHsneSettingsAction(HsneSettingsAction& hsneS
     _hardCutOffAction.setChecked(true);
     _hardCutOffPercentageAction.initialize(0, 1, 0.25f,3);
     _hardCutOffPercentageAction.setSingleStep(0.01f);
+    _numThreadsAction.initialize(1, std::max(1u, std::thread::hardware_concurrency()), static_cast<int>(utils::Scheduler::instance().getNumThreads()));
 
 
     const auto updateNumWalksForLandmarkSelectionAction = [this]() -> void {
@@ -142,6 +150,11 @@ AdvancedHsneSettingsAction::AdvancedHsneSettingsAction(HsneSettingsAction& hsneS
         _hsneSettingsAction.getHsneParameters().initWithPCA(_initWithPCAAction.isChecked());
     };
 
+    // not a parameter of the hierarchy, can be changed at any time
+    const auto updateNumThreads = [this]() -> void {
+        utils::Scheduler::instance().setNumThreads(_numThreadsAction.getValue());
+    };
+
     const auto updateReadOnly = [this]() -> void {
         const auto enabled = !isReadOnly();
 
@@ -208,6 +221,10 @@ AdvancedHsneSettingsAction::AdvancedHsneSettingsAction(HsneSettingsAction& hsneS
         updateHardCutOffPercetage();
     });
 
+    connect(&_numThreadsAction, &IntegralAction::valueChanged, this, [this, updateNumThreads]() {
+        updateNumThreads();
+    });
+
     connect(this, &GroupAction::readOnlyChanged, this, [this, updateReadOnly](const bool& readOnly) {
         updateReadOnly();
     });
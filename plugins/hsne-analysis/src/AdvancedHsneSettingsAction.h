@@ -43,6 +43,7 @@ public: // Action getters
     DecimalAction& getHardCutOffPercentageAction() { return _hardCutOffPercentageAction; }
     ToggleAction& getUseOutOfCoreComputationAction() { return _useOutOfCoreComputationAction; }
     ToggleAction& getInitWithPCA() { return _initWithPCAAction; }
+    IntegralAction& getNumThreadsAction() { return _numThreadsAction; }
 
     /* "SVD" = 0, "COV" = 1 (default) */
     OptionAction& getPcaAlgorithmAction() { return _pcaAlgorithmAction; }
@@ -62,4 +63,5 @@ protected:
     ToggleAction            _hardCutOffAction;                                  /** Select landmarks based on a user provided hard percentage cut off, instead of data-driven */
     DecimalAction           _hardCutOffPercentageAction;                        /** percentage of previous level landmarks to use in next level when using the hard cut off */
     OptionAction            _pcaAlgorithmAction;                                /** PCA algorithm action */
+    IntegralAction          _numThreadsAction;                                  /** Maximum number of threads used for parallel computations */
 };
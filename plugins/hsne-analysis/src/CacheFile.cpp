@@ -0,0 +1,217 @@
+#include "CacheFile.h"
+
+#include "Logger.h"
+
+namespace cache {
+
+    /// ////// ///
+    /// WRITER ///
+    /// ////// ///
+
+    CacheWriter::CacheWriter(const std::filesystem::path& path, const uint32_t formatVersion) :
+        _file(QString::fromStdString(path.string())),
+        _formatVersion(formatVersion),
+        _pos(0),
+        _failed(false),
+        _inSection(false),
+        _sections(),
+        _streamBuffer(*this)
+    {
+        if (!_file.open(QIODevice::WriteOnly))
+        {
+            Log::error("CacheWriter: could not open " + path.string());
+            _failed = true;
+            return;
+        }
+
+        // header: magic and version
+        write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        write(&_formatVersion, sizeof(_formatVersion));
+        pad(SECTION_ALIGNMENT);
+    }
+
+    void CacheWriter::beginSection(const uint32_t id)
+    {
+        if (_inSection)
+            endSection();
+
+        pad(SECTION_ALIGNMENT);
+        _sections.push_back({ id, 0, _pos, 0 });
+        _inSection = true;
+    }
+
+    void CacheWriter::endSection()
+    {
+        if (!_inSection)
+            return;
+
+        _sections.back().size = _pos - _sections.back().offset;
+        _inSection = false;
+    }
+
+    void CacheWriter::write(const void* data, const uint64_t size)
+    {
+        if (_failed || size == 0)
+            return;
+
+        if (_file.write(static_cast<const char*>(data), static_cast<qint64>(size)) != static_cast<qint64>(size))
+        {
+            Log::error("CacheWriter: writing failed: " + _file.errorString().toStdString());
+            _failed = true;
+            return;
+        }
+
+        _pos += size;
+    }
+
+    void CacheWriter::pad(const uint64_t alignment)
+    {
+        static const char zeros[SECTION_ALIGNMENT] = {};
+
+        const uint64_t remainder = _pos % alignment;
+        if (remainder != 0)
+            write(zeros, alignment - remainder);
+    }
+
+    bool CacheWriter::commit()
+    {
+        endSection();
+
+        // section table and footer
+        pad(VALUE_ALIGNMENT);
+        const uint64_t tableOffset = _pos;
+        write(_sections.data(), _sections.size() * sizeof(CacheSectionEntry));
+
+        CacheFileFooter footer{ tableOffset, static_cast<uint32_t>(_sections.size()), _formatVersion, {} };
+        std::memcpy(footer.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        write(&footer, sizeof(footer));
+
+        if (_failed)
+        {
+            _file.cancelWriting();
+            return false;
+        }
+
+        // atomically replace the target file
+        if (!_file.commit())
+        {
+            Log::error("CacheWriter: commit failed: " + _file.errorString().toStdString());
+            return false;
+        }
+
+        return true;
+    }
+
+    CacheWriter::WriterStreamBuffer::int_type CacheWriter::WriterStreamBuffer::overflow(int_type c)
+    {
+        if (c == traits_type::eof())
+            return traits_type::not_eof(c);
+
+        const char ch = traits_type::to_char_type(c);
+        _writer.write(&ch, 1);
+        return _writer._failed ? traits_type::eof() : c;
+    }
+
+    std::streamsize CacheWriter::WriterStreamBuffer::xsputn(const char* s, std::streamsize n)
+    {
+        _writer.write(s, static_cast<uint64_t>(n));
+        return _writer._failed ? 0 : n;
+    }
+
+    /// ////// ///
+    /// READER ///
+    /// ////// ///
+
+    CacheReader::CacheReader(const std::filesystem::path& path, const uint32_t formatVersion) :
+        _file(QString::fromStdString(path.string())),
+        _data(nullptr),
+        _size(0),
+        _sections()
+    {
+        if (!_file.open(QIODevice::ReadOnly))
+            return;
+
+        const uint64_t fileSize = static_cast<uint64_t>(_file.size());
+        if (fileSize < sizeof(CACHE_MAGIC) + sizeof(CacheFileFooter))
+            return;
+
+        const uchar* mapped = _file.map(0, static_cast<qint64>(fileSize));
+        if (mapped == nullptr)
+        {
+            Log::warn("CacheReader: could not map " + path.string());
+            return;
+        }
+
+        const char* data = reinterpret_cast<const char*>(mapped);
+
+        CacheFileFooter footer;
+        std::memcpy(&footer, data + fileSize - sizeof(CacheFileFooter), sizeof(CacheFileFooter));
+
+        if (std::memcmp(data, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || std::memcmp(footer.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+        {
+            Log::warn("CacheReader: not a cache file: " + path.string());
+            return;
+        }
+
+        if (footer.formatVersion != formatVersion)
+        {
+            Log::info("CacheReader: cache format version " + std::to_string(footer.formatVersion) + " differs from " + std::to_string(formatVersion) + ": " + path.string());
+            return;
+        }
+
+        // compare against the file size instead of adding up the corrupt values, which might overflow
+        const uint64_t maxTableSize = fileSize - sizeof(CACHE_MAGIC) - sizeof(CacheFileFooter);
+        if (footer.numSections > maxTableSize / sizeof(CacheSectionEntry))
+        {
+            Log::warn("CacheReader: corrupt section table: " + path.string());
+            return;
+        }
+
+        const uint64_t tableSize = static_cast<uint64_t>(footer.numSections) * sizeof(CacheSectionEntry);
+        if (footer.tableOffset != fileSize - sizeof(CacheFileFooter) - tableSize)
+        {
+            Log::warn("CacheReader: corrupt section table: " + path.string());
+            return;
+        }
+
+        _sections.resize(footer.numSections);
+        std::memcpy(_sections.data(), data + footer.tableOffset, tableSize);
+
+        for (const auto& section : _sections)
+        {
+            if (section.offset > footer.tableOffset || section.size > footer.tableOffset - section.offset || section.offset % SECTION_ALIGNMENT != 0)
+            {
+                Log::warn("CacheReader: corrupt section: " + path.string());
+                _sections.clear();
+                return;
+            }
+        }
+
+        _data = data;
+        _size = fileSize;
+    }
+
+    CacheReader::~CacheReader()
+    {
+        if (_data != nullptr)
+            _file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(_data)));
+    }
+
+    bool CacheReader::hasSection(const uint32_t id) const
+    {
+        return section(id).isValid();
+    }
+
+    SectionReader CacheReader::section(const uint32_t id) const
+    {
+        if (_data == nullptr)
+            return SectionReader();
+
+        for (const auto& section : _sections)
+            if (section.id == id)
+                return SectionReader(_data + section.offset, section.size);
+
+        return SectionReader();
+    }
+
+}
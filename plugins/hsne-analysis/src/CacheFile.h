@@ -0,0 +1,255 @@
+#pragma once
+
+#include <QFile>
+#include <QSaveFile>
+
+#include <algorithm>    // min
+#include <cstdint>
+#include <cstring>      // memcpy
+#include <filesystem>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Single-file binary cache container
+ *
+ * Layout:
+ *      header          magic and format version, padded to SECTION_ALIGNMENT
+ *      sections        each section starts at a multiple of SECTION_ALIGNMENT
+ *      section table   one CacheSectionEntry per section
+ *      footer          offset of the section table, number of sections, format version and magic
+ *
+ * Values and arrays within a section are padded to 8 bytes, arrays are stored as their
+ * element count (uint64_t) followed by the elements. Since the file is memory-mapped
+ * for reading, arrays can be viewed in place or copied with a single memcpy.
+ *
+ * Files are written to a temporary file which atomically replaces the target file
+ * on commit, a failed or interrupted save never leaves a partial cache behind.
+ */
+namespace cache {
+
+    constexpr char CACHE_MAGIC[8] = { 'I', 'H', 'P', 'C', 'A', 'C', 'H', 'E' };
+    constexpr uint64_t SECTION_ALIGNMENT = 64;
+    constexpr uint64_t VALUE_ALIGNMENT = 8;
+
+    struct CacheSectionEntry
+    {
+        uint32_t id;
+        uint32_t reserved;
+        uint64_t offset;    /** in bytes from the start of the file */
+        uint64_t size;      /** in bytes */
+    };
+
+    struct CacheFileFooter
+    {
+        uint64_t tableOffset;
+        uint32_t numSections;
+        uint32_t formatVersion;
+        char magic[8];
+    };
+
+    /**
+     * CacheWriter
+     *
+     * Writes sections to a temporary file, commit() atomically replaces the target file
+     */
+    class CacheWriter
+    {
+    public:
+        CacheWriter(const std::filesystem::path& path, const uint32_t formatVersion);
+
+        bool isOpen() const { return _file.isOpen() && !_failed; }
+
+        void beginSection(const uint32_t id);
+        void endSection();
+
+        /** Raw bytes without padding, e.g. streamed data */
+        void write(const void* data, const uint64_t size);
+
+        template<typename T>
+        void writeValue(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            write(&value, sizeof(T));
+            pad(VALUE_ALIGNMENT);
+        }
+
+        template<typename T>
+        void writeArray(const T* data, const uint64_t count)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            writeValue(count);
+            write(data, count * sizeof(T));
+            pad(VALUE_ALIGNMENT);
+        }
+
+        template<typename T>
+        void writeArray(const std::vector<T>& values) { writeArray(values.data(), values.size()); }
+
+        void writeString(const std::string& string) { writeArray(string.data(), string.size()); }
+
+        /** Stream buffer that writes into the current section, for use with std::ostream */
+        std::streambuf* streamBuffer() { return &_streamBuffer; }
+
+        /** Writes section table and footer, then replaces the target file. Returns false if any write failed */
+        bool commit();
+
+    private:
+        void pad(const uint64_t alignment);
+
+        class WriterStreamBuffer : public std::streambuf
+        {
+        public:
+            WriterStreamBuffer(CacheWriter& writer) : _writer(writer) {}
+
+        protected:
+            int_type overflow(int_type c) override;
+            std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+        private:
+            CacheWriter& _writer;
+        };
+
+    private:
+        QSaveFile                       _file;              /** Temporary file, renamed to target on commit */
+        uint32_t                        _formatVersion;     /** Version of the file content */
+        uint64_t                        _pos;               /** Current write position in bytes */
+        bool                            _failed;            /** Whether any write failed */
+        bool                            _inSection;         /** Whether a section is currently written */
+        std::vector<CacheSectionEntry>  _sections;          /** Section table */
+        WriterStreamBuffer              _streamBuffer;      /** Adapter for std::ostream */
+    };
+
+    /**
+     * SectionReader
+     *
+     * Reads values and arrays from a memory-mapped section
+     */
+    class SectionReader
+    {
+    public:
+        SectionReader() : _begin(nullptr), _end(nullptr), _cur(nullptr) {}
+        SectionReader(const char* begin, const uint64_t size) : _begin(begin), _end(begin + size), _cur(begin) {}
+
+        bool isValid() const { return _begin != nullptr; }
+
+        template<typename T>
+        bool readValue(T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (!canRead(sizeof(T))) return false;
+            std::memcpy(&value, _cur, sizeof(T));
+            advance(sizeof(T));
+            return true;
+        }
+
+        /** View an array in place, the view is valid as long as the CacheReader exists */
+        template<typename T>
+        bool viewArray(std::span<const T>& view)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            uint64_t count = 0;
+            if (!readValue(count) || count > available() / sizeof(T)) return false;   // count * sizeof(T) might overflow
+            if (reinterpret_cast<std::uintptr_t>(_cur) % alignof(T) != 0) return false;
+            view = std::span<const T>(reinterpret_cast<const T*>(_cur), count);
+            advance(count * sizeof(T));
+            return true;
+        }
+
+        /** Copy an array with a single memcpy */
+        template<typename T>
+        bool readArray(std::vector<T>& values)
+        {
+            std::span<const T> view;
+            if (!viewArray(view)) return false;
+            values.resize(view.size());
+            if (!view.empty())
+                std::memcpy(values.data(), view.data(), view.size_bytes());
+            return true;
+        }
+
+        bool readString(std::string& string)
+        {
+            std::span<const char> view;
+            if (!viewArray(view)) return false;
+            string.assign(view.begin(), view.end());
+            return true;
+        }
+
+        /** Remaining bytes of the section, e.g. for streamed data */
+        std::span<const char> remaining() const { return { _cur, static_cast<size_t>(_end - _cur) }; }
+
+    private:
+        uint64_t available() const { return _cur != nullptr ? static_cast<uint64_t>(_end - _cur) : 0; }
+        bool canRead(const uint64_t size) const { return _cur != nullptr && available() >= size; }
+
+        void advance(const uint64_t size)
+        {
+            // skip padding
+            const uint64_t padded = (size + VALUE_ALIGNMENT - 1) / VALUE_ALIGNMENT * VALUE_ALIGNMENT;
+            _cur += std::min<uint64_t>(padded, static_cast<uint64_t>(_end - _cur));
+        }
+
+    private:
+        const char* _begin;
+        const char* _end;
+        const char* _cur;
+    };
+
+    /**
+     * CacheReader
+     *
+     * Memory-maps a cache file and gives access to its sections
+     */
+    class CacheReader
+    {
+    public:
+        CacheReader(const std::filesystem::path& path, const uint32_t formatVersion);
+        ~CacheReader();
+
+        /** Whether the file exists, could be mapped and has a valid footer and section table */
+        bool isValid() const { return _data != nullptr; }
+
+        bool hasSection(const uint32_t id) const;
+
+        /** Returns an invalid SectionReader if the section does not exist */
+        SectionReader section(const uint32_t id) const;
+
+    private:
+        QFile                           _file;      /** Mapped file */
+        const char*                     _data;      /** Start of mapped file */
+        uint64_t                        _size;      /** Size of mapped file in bytes */
+        std::vector<CacheSectionEntry>  _sections;  /** Section table */
+    };
+
+    /** Read-only stream buffer over memory, for use with std::istream */
+    class MemoryStreamBuffer : public std::streambuf
+    {
+    public:
+        MemoryStreamBuffer(std::span<const char> data)
+        {
+            char* begin = const_cast<char*>(data.data());
+            setg(begin, begin, begin + data.size());
+        }
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in) override
+        {
+            char* base = (dir == std::ios_base::beg) ? eback() : (dir == std::ios_base::cur) ? gptr() : egptr();
+            char* target = base + off;
+            if (target < eback() || target > egptr())
+                return pos_type(off_type(-1));
+            setg(eback(), target, egptr());
+            return pos_type(target - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+}
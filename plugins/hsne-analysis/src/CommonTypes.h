@@ -4,6 +4,11 @@
 #include <unordered_map>
 #include <map>
 #include <vector>
+#include <span>
+#include <numeric>
+#include <limits>
+#include <cstdint>
+#include <cassert>
 #include <Eigen/Dense>
 
 #pragma warning( push ) 
@@ -27,17 +32,104 @@ using HsneMatrix = std::vector<hdi::data::SparseVec<uint32_t, float>>;
 
 using Hsne = hdi::dr::HierarchicalSNE<float, HsneMatrix>;
 
-// A LandmarkMap is nothing but std::vector<std::vector<uint32_t>>
+// A LandmarkMap maps each row to a list of IDs, stored in compressed sparse row (CSR) format:
+//      the IDs of row i are _ids[_offsets[i]], ..., _ids[_offsets[i + 1] - 1]
 // Example use:
-//      The LandmarkMap vector is of the size of numLandmarks on a given scale
-//      landmarkMap[i] is a vector of data points (global IDs) on which the landmark i on a given scale (here topScaleIndex) has the highest influence
-using LandmarkMap = std::vector<std::vector<uint32_t>>;
+//      The LandmarkMap is of the size of numLandmarks on a given scale
+//      landmarkMap[i] is a span of data points (global IDs) on which the landmark i on a given scale (here topScaleIndex) has the highest influence
+class LandmarkMap
+{
+public:
+    using Row = std::span<const uint32_t>;
+    using MutableRow = std::span<uint32_t>;
+
+    LandmarkMap() : _offsets(1, 0), _ids() {}
+
+    /** offsets must be of size numRows + 1, start with 0 and end with ids.size() */
+    LandmarkMap(std::vector<size_t> offsets, std::vector<uint32_t> ids) : _offsets(std::move(offsets)), _ids(std::move(ids))
+    {
+        assert(!_offsets.empty() && _offsets.front() == 0 && _offsets.back() == _ids.size());
+    }
+
+    /** Create a map in which each row holds exactly one ID */
+    static LandmarkMap fromSingleIDs(std::vector<uint32_t> ids)
+    {
+        std::vector<size_t> offsets(ids.size() + 1);
+        std::iota(offsets.begin(), offsets.end(), size_t{ 0 });
+        return LandmarkMap(std::move(offsets), std::move(ids));
+    }
+
+    Row operator[](const size_t row) const { return { _ids.data() + _offsets[row], _offsets[row + 1] - _offsets[row] }; }
+    MutableRow operator[](const size_t row) { return { _ids.data() + _offsets[row], _offsets[row + 1] - _offsets[row] }; }
+
+    /** Number of rows */
+    size_t size() const { return _offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+    size_t rowSize(const size_t row) const { return _offsets[row + 1] - _offsets[row]; }
 
+    /** Total number of IDs in all rows */
+    size_t numIDs() const { return _ids.size(); }
+
+    void clear() { _offsets.assign(1, 0); _ids.clear(); }
+
+    const std::vector<size_t>& getOffsets() const { return _offsets; }
+    const std::vector<uint32_t>& getIDs() const { return _ids; }
+
+private:
+    std::vector<size_t>     _offsets;   /** Size: number of rows + 1. Row i spans [_offsets[i], _offsets[i + 1]) in _ids */
+    std::vector<uint32_t>   _ids;       /** IDs of all rows */
+};
+
+// A LandmarkMapSingle maps each entry to at most one ID, NO_LANDMARK indicates that there is no mapped value
+// Example use:
+//      The LandmarkMapSingle vector is of the size of data points
+//      landmarkMapSingle[i] is the landmark (on a given scale) that has the highest influence on data point i
 using LandmarkMapSingle = std::vector<uint32_t>;
 
+constexpr uint32_t NO_LANDMARK = std::numeric_limits<uint32_t>::max();
+
 // ID and transision value
 using transitionVec = std::vector<std::pair<uint32_t, float>>;
 
+// A NeighborMatrix stores up to k neighbor IDs per row in a flat numRows x k array
+// with the number of valid neighbors per row, rows with fewer than k neighbors are padded with NO_LANDMARK
+// Example use:
+//      The NeighborMatrix is of the size of numLandmarks on a given scale
+//      neighborMatrix[i] is a span of the (up to k) landmarks with the highest transition values from landmark i, sorted descending
+class NeighborMatrix
+{
+public:
+    using Row = std::span<const uint32_t>;
+
+    NeighborMatrix() : _k(0), _ids(), _counts() {}
+    NeighborMatrix(const size_t numRows, const size_t k) : _k(k), _ids(numRows * k, NO_LANDMARK), _counts(numRows, 0) {}
+
+    /** ids must be of size counts.size() * k */
+    NeighborMatrix(const size_t k, std::vector<uint32_t> ids, std::vector<uint32_t> counts) : _k(k), _ids(std::move(ids)), _counts(std::move(counts))
+    {
+        assert(_ids.size() == _counts.size() * _k);
+    }
+
+    Row operator[](const size_t row) const { return { _ids.data() + row * _k, _counts[row] }; }
+
+    /** Writable storage of a row with space for k IDs, set the number of valid IDs with setRowSize */
+    uint32_t* rowData(const size_t row) { return _ids.data() + row * _k; }
+    void setRowSize(const size_t row, const uint32_t count) { assert(count <= _k); _counts[row] = count; }
+
+    /** Number of rows */
+    size_t size() const { return _counts.size(); }
+    bool empty() const { return size() == 0; }
+    size_t k() const { return _k; }
+
+    const std::vector<uint32_t>& getIDs() const { return _ids; }
+    const std::vector<uint32_t>& getCounts() const { return _counts; }
+
+private:
+    size_t                  _k;         /** Maximum number of neighbors per row */
+    std::vector<uint32_t>   _ids;       /** Size: number of rows * k. Row i spans [i * k, i * k + _counts[i]) */
+    std::vector<uint32_t>   _counts;    /** Number of valid neighbors per row */
+};
+
 namespace Eigen {
     // Matrix version for uint32_t, works just as MatrixXi
     typedef Matrix<uint32_t, -1, -1> MatrixXui;
@@ -0,0 +1,78 @@
+#include "ConvergenceMonitor.h"
+
+#include <algorithm>    // max
+#include <cmath>
+#include <utility>      // swap
+
+ConvergenceMonitor::ConvergenceMonitor() :
+    _tolerance(0),
+    _lastChange(-1),
+    _numChecksBelowTolerance(0),
+    _previous(),
+    _current()
+{
+}
+
+void ConvergenceMonitor::reset()
+{
+    _lastChange = -1;
+    _numChecksBelowTolerance = 0;
+    _previous.clear();
+}
+
+bool ConvergenceMonitor::check(const std::vector<float>& embedding, const uint32_t numDimensions)
+{
+    if (_tolerance <= 0 || numDimensions == 0)
+        return false;
+
+    const size_t numPoints = embedding.size() / numDimensions;
+    if (numPoints == 0)
+        return false;
+
+    // same samples in every check, as long as the number of points does not change
+    const size_t stride = (numPoints + MAX_SAMPLES - 1) / MAX_SAMPLES;
+    const size_t numSamples = (numPoints + stride - 1) / stride;
+
+    std::vector<double> center(numDimensions, 0.0);
+    for (size_t s = 0; s < numSamples; s++)
+        for (uint32_t d = 0; d < numDimensions; d++)
+            center[d] += embedding[s * stride * numDimensions + d];
+    for (uint32_t d = 0; d < numDimensions; d++)
+        center[d] /= numSamples;
+
+    double squaredRadius = 0;
+    for (size_t s = 0; s < numSamples; s++)
+        for (uint32_t d = 0; d < numDimensions; d++)
+        {
+            const double offset = embedding[s * stride * numDimensions + d] - center[d];
+            squaredRadius += offset * offset;
+        }
+    const double radius = std::max(std::sqrt(squaredRadius / numSamples), 1e-12);
+
+    _current.resize(numSamples * numDimensions);
+    for (size_t s = 0; s < numSamples; s++)
+        for (uint32_t d = 0; d < numDimensions; d++)
+            _current[s * numDimensions + d] = static_cast<float>((embedding[s * stride * numDimensions + d] - center[d]) / radius);
+
+    const bool comparable = _previous.size() == _current.size();
+    if (comparable)
+    {
+        double squaredChange = 0;
+        for (size_t e = 0; e < _current.size(); e++)
+        {
+            const double diff = _current[e] - _previous[e];
+            squaredChange += diff * diff;
+        }
+        _lastChange = static_cast<float>(std::sqrt(squaredChange / numSamples));
+        _numChecksBelowTolerance = (_lastChange < _tolerance) ? _numChecksBelowTolerance + 1 : 0;
+    }
+    else
+    {
+        _lastChange = -1;
+        _numChecksBelowTolerance = 0;
+    }
+
+    std::swap(_previous, _current);
+
+    return _numChecksBelowTolerance >= CHECKS_BELOW_TOLERANCE;
+}
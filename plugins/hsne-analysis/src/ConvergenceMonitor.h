@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * ConvergenceMonitor
+ *
+ * Detects when a t-SNE layout stops changing. Each check compares the embedding with the one of the previous check,
+ * after normalizing both for translation and scale, since t-SNE embeddings keep expanding slowly long after
+ * their shape is stable. The change is the RMS displacement of the normalized points, i.e. relative to the RMS radius.
+ * Large embeddings are sampled with a fixed stride, so a check costs at most MAX_SAMPLES points.
+ */
+class ConvergenceMonitor
+{
+public:
+    ConvergenceMonitor();
+
+    /** Relative change per check below which the layout counts as stable, 0 disables the monitor */
+    void setTolerance(const float tolerance) { _tolerance = tolerance; }
+    float getTolerance() const { return _tolerance; }
+
+    /** Forget previous checks, e.g. when the gradient descent continues after a pause */
+    void reset();
+
+    /**
+     * Compare the embedding with the previous check
+     * \param embedding positions [x0, y0, x1, y1, ...] for two dimensions
+     * \param numDimensions dimensionality of the embedding
+     * \return true once the change stayed below the tolerance for CHECKS_BELOW_TOLERANCE consecutive checks
+     */
+    bool check(const std::vector<float>& embedding, const uint32_t numDimensions);
+
+    /** Change of the last check, negative before the second check */
+    float getLastChange() const { return _lastChange; }
+
+public:
+    static constexpr uint32_t   MAX_SAMPLES = 10000;
+    static constexpr uint32_t   CHECKS_BELOW_TOLERANCE = 2;     /** Guards against a single small step, e.g. when momentum reverses */
+
+private:
+    float                       _tolerance;
+    float                       _lastChange;
+    uint32_t                    _numChecksBelowTolerance;
+    std::vector<float>          _previous;                      /** Normalized samples of the previous check */
+    std::vector<float>          _current;
+};
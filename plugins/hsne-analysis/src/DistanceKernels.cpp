@@ -0,0 +1,455 @@
+#include "DistanceKernels.h"
+
+#include "Logger.h"
+
+#include <algorithm>    // min
+#include <cmath>        // sqrt
+
+// SIMD kernels are only available on x86-64, other platforms use the scalar kernels
+#if defined(__x86_64__) || defined(_M_X64)
+#define IHP_DISTANCE_X86
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>     // __cpuidex, _xgetbv
+// MSVC allows using intrinsics of any instruction set without setting /arch
+#define IHP_TARGET_AVX2
+#define IHP_TARGET_AVX512
+#else
+// Compile kernels for an instruction set without setting it for the entire target
+#define IHP_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define IHP_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+#endif // x86-64
+
+namespace {
+
+    // Fixed dimensionalities are compile time constants, allowing the compiler to fully unroll the loops.
+    // Dim == 0 denotes the generic kernel that uses the runtime dimensionality
+    template<size_t Dim>
+    inline size_t numDimensions(const size_t numDims) { return Dim != 0 ? Dim : numDims; }
+
+    inline float cosineFromDotAndNorms(const float dot, const float normA, const float normB)
+    {
+        const float denom = std::sqrt(normA * normB);
+        return denom > 0.0f ? 1.0f - dot / denom : 1.0f;
+    }
+
+    /// ////// ///
+    /// SCALAR ///
+    /// ////// ///
+    namespace scalar {
+
+        template<size_t Dim>
+        float l2Sqr(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            float res = 0;
+            for (size_t i = 0; i < n; i++) {
+                const float t = a[i] - b[i];
+                res += t * t;
+            }
+            return res;
+        }
+
+        template<size_t Dim>
+        float innerProduct(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            float dot = 0;
+            for (size_t i = 0; i < n; i++)
+                dot += a[i] * b[i];
+            return 1.0f - dot;
+        }
+
+        template<size_t Dim>
+        float cosine(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            float dot = 0, normA = 0, normB = 0;
+            for (size_t i = 0; i < n; i++) {
+                dot += a[i] * b[i];
+                normA += a[i] * a[i];
+                normB += b[i] * b[i];
+            }
+            return cosineFromDotAndNorms(dot, normA, normB);
+        }
+
+    }
+
+#ifdef IHP_DISTANCE_X86
+
+    inline float horizontalSum(const __m128 v)
+    {
+        __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 sums = _mm_add_ps(v, shuf);
+        shuf = _mm_movehl_ps(shuf, sums);
+        sums = _mm_add_ss(sums, shuf);
+        return _mm_cvtss_f32(sums);
+    }
+
+    /// ///////////// ///
+    /// SSE (128 bit) ///
+    /// ///////////// ///
+    namespace sse {
+
+        template<size_t Dim>
+        float l2Sqr(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            const size_t nSimd = n - n % 4;
+
+            __m128 sum = _mm_setzero_ps();
+            for (size_t i = 0; i < nSimd; i += 4) {
+                const __m128 diff = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+                sum = _mm_add_ps(sum, _mm_mul_ps(diff, diff));
+            }
+
+            float res = horizontalSum(sum);
+            for (size_t i = nSimd; i < n; i++) {
+                const float t = a[i] - b[i];
+                res += t * t;
+            }
+            return res;
+        }
+
+        template<size_t Dim>
+        float innerProduct(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            const size_t nSimd = n - n % 4;
+
+            __m128 sum = _mm_setzero_ps();
+            for (size_t i = 0; i < nSimd; i += 4)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+            float dot = horizontalSum(sum);
+            for (size_t i = nSimd; i < n; i++)
+                dot += a[i] * b[i];
+            return 1.0f - dot;
+        }
+
+        template<size_t Dim>
+        float cosine(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            const size_t nSimd = n - n % 4;
+
+            __m128 dotSum = _mm_setzero_ps(), normASum = _mm_setzero_ps(), normBSum = _mm_setzero_ps();
+            for (size_t i = 0; i < nSimd; i += 4) {
+                const __m128 va = _mm_loadu_ps(a + i);
+                const __m128 vb = _mm_loadu_ps(b + i);
+                dotSum = _mm_add_ps(dotSum, _mm_mul_ps(va, vb));
+                normASum = _mm_add_ps(normASum, _mm_mul_ps(va, va));
+                normBSum = _mm_add_ps(normBSum, _mm_mul_ps(vb, vb));
+            }
+
+            float dot = horizontalSum(dotSum), normA = horizontalSum(normASum), normB = horizontalSum(normBSum);
+            for (size_t i = nSimd; i < n; i++) {
+                dot += a[i] * b[i];
+                normA += a[i] * a[i];
+                normB += b[i] * b[i];
+            }
+            return cosineFromDotAndNorms(dot, normA, normB);
+        }
+
+    }
+
+    /// ////////////// ///
+    /// AVX2 (256 bit) ///
+    /// ////////////// ///
+    namespace avx2 {
+
+        IHP_TARGET_AVX2 inline float horizontalSum256(const __m256 v)
+        {
+            return horizontalSum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+        }
+
+        template<size_t Dim>
+        IHP_TARGET_AVX2 float l2Sqr(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            const size_t nSimd = n - n % 8;
+
+            __m256 sum = _mm256_setzero_ps();
+            for (size_t i = 0; i < nSimd; i += 8) {
+                const __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+                sum = _mm256_fmadd_ps(diff, diff, sum);
+            }
+
+            float res = horizontalSum256(sum);
+            for (size_t i = nSimd; i < n; i++) {
+                const float t = a[i] - b[i];
+                res += t * t;
+            }
+            return res;
+        }
+
+        template<size_t Dim>
+        IHP_TARGET_AVX2 float innerProduct(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            const size_t nSimd = n - n % 8;
+
+            __m256 sum = _mm256_setzero_ps();
+            for (size_t i = 0; i < nSimd; i += 8)
+                sum = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum);
+
+            float dot = horizontalSum256(sum);
+            for (size_t i = nSimd; i < n; i++)
+                dot += a[i] * b[i];
+            return 1.0f - dot;
+        }
+
+        template<size_t Dim>
+        IHP_TARGET_AVX2 float cosine(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            const size_t nSimd = n - n % 8;
+
+            __m256 dotSum = _mm256_setzero_ps(), normASum = _mm256_setzero_ps(), normBSum = _mm256_setzero_ps();
+            for (size_t i = 0; i < nSimd; i += 8) {
+                const __m256 va = _mm256_loadu_ps(a + i);
+                const __m256 vb = _mm256_loadu_ps(b + i);
+                dotSum = _mm256_fmadd_ps(va, vb, dotSum);
+                normASum = _mm256_fmadd_ps(va, va, normASum);
+                normBSum = _mm256_fmadd_ps(vb, vb, normBSum);
+            }
+
+            float dot = horizontalSum256(dotSum), normA = horizontalSum256(normASum), normB = horizontalSum256(normBSum);
+            for (size_t i = nSimd; i < n; i++) {
+                dot += a[i] * b[i];
+                normA += a[i] * a[i];
+                normB += b[i] * b[i];
+            }
+            return cosineFromDotAndNorms(dot, normA, normB);
+        }
+
+    }
+
+    /// ///////////////// ///
+    /// AVX-512 (512 bit) ///
+    /// ///////////////// ///
+    namespace avx512 {
+
+        // Remaining dimensions are handled with a masked load instead of a scalar loop
+        IHP_TARGET_AVX512 inline __mmask16 tailMask(const size_t remaining)
+        {
+            return static_cast<__mmask16>((1u << remaining) - 1u);
+        }
+
+        template<size_t Dim>
+        IHP_TARGET_AVX512 float l2Sqr(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            const size_t nSimd = n - n % 16;
+
+            __m512 sum = _mm512_setzero_ps();
+            for (size_t i = 0; i < nSimd; i += 16) {
+                const __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+                sum = _mm512_fmadd_ps(diff, diff, sum);
+            }
+
+            if (nSimd < n) {
+                const __mmask16 mask = tailMask(n - nSimd);
+                const __m512 diff = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + nSimd), _mm512_maskz_loadu_ps(mask, b + nSimd));
+                sum = _mm512_fmadd_ps(diff, diff, sum);
+            }
+
+            return _mm512_reduce_add_ps(sum);
+        }
+
+        template<size_t Dim>
+        IHP_TARGET_AVX512 float innerProduct(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            const size_t nSimd = n - n % 16;
+
+            __m512 sum = _mm512_setzero_ps();
+            for (size_t i = 0; i < nSimd; i += 16)
+                sum = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum);
+
+            if (nSimd < n) {
+                const __mmask16 mask = tailMask(n - nSimd);
+                sum = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + nSimd), _mm512_maskz_loadu_ps(mask, b + nSimd), sum);
+            }
+
+            return 1.0f - _mm512_reduce_add_ps(sum);
+        }
+
+        template<size_t Dim>
+        IHP_TARGET_AVX512 float cosine(const float* a, const float* b, const size_t numDims)
+        {
+            const size_t n = numDimensions<Dim>(numDims);
+            const size_t nSimd = n - n % 16;
+
+            __m512 dotSum = _mm512_setzero_ps(), normASum = _mm512_setzero_ps(), normBSum = _mm512_setzero_ps();
+            for (size_t i = 0; i < nSimd; i += 16) {
+                const __m512 va = _mm512_loadu_ps(a + i);
+                const __m512 vb = _mm512_loadu_ps(b + i);
+                dotSum = _mm512_fmadd_ps(va, vb, dotSum);
+                normASum = _mm512_fmadd_ps(va, va, normASum);
+                normBSum = _mm512_fmadd_ps(vb, vb, normBSum);
+            }
+
+            if (nSimd < n) {
+                const __mmask16 mask = tailMask(n - nSimd);
+                const __m512 va = _mm512_maskz_loadu_ps(mask, a + nSimd);
+                const __m512 vb = _mm512_maskz_loadu_ps(mask, b + nSimd);
+                dotSum = _mm512_fmadd_ps(va, vb, dotSum);
+                normASum = _mm512_fmadd_ps(va, va, normASum);
+                normBSum = _mm512_fmadd_ps(vb, vb, normBSum);
+            }
+
+            return cosineFromDotAndNorms(_mm512_reduce_add_ps(dotSum), _mm512_reduce_add_ps(normASum), _mm512_reduce_add_ps(normBSum));
+        }
+
+    }
+
+    /// ///////////// ///
+    /// CPU DETECTION ///
+    /// ///////////// ///
+
+    utils::SimdLevel detectSimdLevel()
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuidex(info, 0, 0);
+        const int maxLeaf = info[0];
+
+        __cpuidex(info, 1, 0);
+        const bool hasSSE = (info[3] & (1 << 25)) != 0;
+        const bool hasFMA = (info[2] & (1 << 12)) != 0;
+        const bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+
+        // OS must save the AVX (and AVX-512) registers on context switches
+        const unsigned long long xcr0 = hasOSXSAVE ? _xgetbv(0) : 0;
+        const bool osAVX = (xcr0 & 0x6) == 0x6;
+        const bool osAVX512 = (xcr0 & 0xE6) == 0xE6;
+
+        bool hasAVX2 = false, hasAVX512 = false;
+        if (maxLeaf >= 7) {
+            __cpuidex(info, 7, 0);
+            hasAVX2 = (info[1] & (1 << 5)) != 0;
+            hasAVX512 = (info[1] & (1 << 16)) != 0;
+        }
+
+        if (hasAVX512 && hasAVX2 && hasFMA && osAVX512)
+            return utils::SimdLevel::AVX512;
+        if (hasAVX2 && hasFMA && osAVX)
+            return utils::SimdLevel::AVX2;
+        if (hasSSE)
+            return utils::SimdLevel::SSE;
+#else
+        // also checks whether the OS supports the extended registers
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return utils::SimdLevel::AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return utils::SimdLevel::AVX2;
+        if (__builtin_cpu_supports("sse"))
+            return utils::SimdLevel::SSE;
+#endif
+        return utils::SimdLevel::SCALAR;
+    }
+
+#else
+
+    utils::SimdLevel detectSimdLevel()
+    {
+        return utils::SimdLevel::SCALAR;
+    }
+
+#endif // IHP_DISTANCE_X86
+
+    /// //////// ///
+    /// DISPATCH ///
+    /// //////// ///
+
+    utils::DistanceFunction selectMetric(const utils::DistanceMetric metric, utils::DistanceFunction l2Sqr, utils::DistanceFunction innerProduct, utils::DistanceFunction cosine)
+    {
+        switch (metric)
+        {
+        case utils::DistanceMetric::InnerProduct:   return innerProduct;
+        case utils::DistanceMetric::Cosine:         return cosine;
+        default:                                    return l2Sqr;
+        }
+    }
+
+    template<size_t Dim>
+    utils::DistanceFunction selectKernel(const utils::DistanceMetric metric, const utils::SimdLevel level)
+    {
+        switch (level)
+        {
+#ifdef IHP_DISTANCE_X86
+        case utils::SimdLevel::AVX512:  return selectMetric(metric, &avx512::l2Sqr<Dim>, &avx512::innerProduct<Dim>, &avx512::cosine<Dim>);
+        case utils::SimdLevel::AVX2:    return selectMetric(metric, &avx2::l2Sqr<Dim>, &avx2::innerProduct<Dim>, &avx2::cosine<Dim>);
+        case utils::SimdLevel::SSE:     return selectMetric(metric, &sse::l2Sqr<Dim>, &sse::innerProduct<Dim>, &sse::cosine<Dim>);
+#endif
+        default:                        return selectMetric(metric, &scalar::l2Sqr<Dim>, &scalar::innerProduct<Dim>, &scalar::cosine<Dim>);
+        }
+    }
+
+}
+
+namespace utils {
+
+    SimdLevel getSimdLevel()
+    {
+        static const SimdLevel level = []() {
+            const SimdLevel detected = detectSimdLevel();
+            Log::info("Distance kernels use " + simdLevelName(detected));
+            return detected;
+        }();
+
+        return level;
+    }
+
+    std::string simdLevelName(const SimdLevel level)
+    {
+        switch (level)
+        {
+        case SimdLevel::SSE:        return "SSE";
+        case SimdLevel::AVX2:       return "AVX2";
+        case SimdLevel::AVX512:     return "AVX-512";
+        default:                    return "scalar";
+        }
+    }
+
+    DistanceFunction getDistanceFunction(const DistanceMetric metric, const size_t numDims)
+    {
+        return getDistanceFunction(metric, numDims, getSimdLevel());
+    }
+
+    DistanceFunction getDistanceFunction(const DistanceMetric metric, const size_t numDims, const SimdLevel level)
+    {
+        // Never use an instruction set that is not supported by the CPU
+        const SimdLevel usedLevel = static_cast<SimdLevel>(std::min(static_cast<int>(level), static_cast<int>(getSimdLevel())));
+
+        // Specializations for common numbers of image channels
+        switch (numDims)
+        {
+        case 8:     return selectKernel<8>(metric, usedLevel);
+        case 16:    return selectKernel<16>(metric, usedLevel);
+        case 32:    return selectKernel<32>(metric, usedLevel);
+        case 64:    return selectKernel<64>(metric, usedLevel);
+        case 128:   return selectKernel<128>(metric, usedLevel);
+        case 224:   return selectKernel<224>(metric, usedLevel);
+        default:    return selectKernel<0>(metric, usedLevel);
+        }
+    }
+
+    bool convertFromHDILibMetric(const hdi::dr::knn_distance_metric& in, DistanceMetric& out)
+    {
+        switch (in)
+        {
+        case hdi::dr::knn_distance_metric::KNN_METRIC_EUCLIDEAN:        out = DistanceMetric::L2Sqr; return true;
+        case hdi::dr::knn_distance_metric::KNN_METRIC_INNER_PRODUCT:    out = DistanceMetric::InnerProduct; return true;
+        case hdi::dr::knn_distance_metric::KNN_METRIC_COSINE:           out = DistanceMetric::Cosine; return true;
+        default:                                                        return false;
+        }
+    }
+
+}
@@ -0,0 +1,62 @@
+#ifndef DISTANCEKERNELS_H
+#define DISTANCEKERNELS_H
+
+#include <cstddef>      // size_t
+#include <string>
+
+#include "hdi/dimensionality_reduction/knn_utils.h"
+
+namespace utils {
+
+    /// //////////////// ///
+    /// DISTANCE KERNELS ///
+    /// //////////////// ///
+
+    /*! Distance metrics with SIMD kernels
+     * L2Sqr:        squared euclidean distance
+     * InnerProduct: 1 - <a, b>                      (same as hnswlib)
+     * Cosine:       1 - <a, b> / (|a| * |b|)
+    */
+    enum class DistanceMetric
+    {
+        L2Sqr = 0,
+        InnerProduct = 1,
+        Cosine = 2
+    };
+
+    /*! Instruction set used by a distance kernel
+     * The available level is detected at runtime, such that the same binary
+     * runs on machines without AVX2 and makes use of AVX-512 where present
+    */
+    enum class SimdLevel
+    {
+        SCALAR = 0,
+        SSE = 1,
+        AVX2 = 2,
+        AVX512 = 3
+    };
+
+    using DistanceFunction = float(*)(const float* a, const float* b, const size_t numDims);
+
+    /*! Highest instruction set supported by CPU and OS, detected once */
+    SimdLevel getSimdLevel();
+
+    std::string simdLevelName(const SimdLevel level);
+
+    /*! Get the distance kernel for a metric and dimensionality
+     * Dedicated kernels exist for common band counts (8, 16, 32, 64, 128, 224),
+     * all other dimensionalities use a generic kernel.
+     * The returned function must only be called with the numDims it was requested for.
+     * \param metric distance metric
+     * \param numDims number of dimensions
+     * \param level instruction set, clamped to getSimdLevel()
+    */
+    DistanceFunction getDistanceFunction(const DistanceMetric metric, const size_t numDims);
+    DistanceFunction getDistanceFunction(const DistanceMetric metric, const size_t numDims, const SimdLevel level);
+
+    /*! Convert HDILib metric to kernel metric, returns false if there is no corresponding kernel */
+    bool convertFromHDILibMetric(const hdi::dr::knn_distance_metric& in, DistanceMetric& out);
+
+}
+
+#endif DISTANCEKERNELS_H
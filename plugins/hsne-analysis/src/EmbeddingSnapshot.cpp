@@ -0,0 +1,54 @@
+#include "EmbeddingSnapshot.h"
+
+#include <utility>      // swap
+
+EmbeddingSnapshot::EmbeddingSnapshot() :
+    _buffers(),
+    _front(0),
+    _middle(1),
+    _back(2),
+    _newEmbedding(false),
+    _notificationPending(false)
+{
+}
+
+bool EmbeddingSnapshot::publish(const std::vector<float>& data, const uint32_t numPoints, const uint32_t numDimensions, const uint32_t iteration)
+{
+    std::lock_guard<std::mutex> writerLock(_writerMutex);
+
+    // assign reuses the capacity of the buffer
+    Embedding& back = _buffers[_back];
+    back.data.assign(data.begin(), data.end());
+    back.numPoints = numPoints;
+    back.numDimensions = numDimensions;
+    back.iteration = iteration;
+
+    {
+        std::lock_guard<std::mutex> swapLock(_swapMutex);
+        std::swap(_back, _middle);
+        _newEmbedding = true;
+    }
+
+    return !_notificationPending.exchange(true);
+}
+
+const EmbeddingSnapshot::Embedding& EmbeddingSnapshot::acquire()
+{
+    // cleared first: a publication during the swap notifies again
+    _notificationPending.store(false);
+
+    std::lock_guard<std::mutex> swapLock(_swapMutex);
+    if (_newEmbedding)
+    {
+        std::swap(_front, _middle);
+        _newEmbedding = false;
+    }
+
+    return _buffers[_front];
+}
+
+bool EmbeddingSnapshot::hasNewEmbedding() const
+{
+    std::lock_guard<std::mutex> swapLock(_swapMutex);
+    return _newEmbedding;
+}
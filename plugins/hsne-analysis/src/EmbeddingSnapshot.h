@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * EmbeddingSnapshot
+ *
+ * Triple buffer for handing embeddings from a computation thread to the UI thread without blocking either.
+ * The writer copies into its back buffer and swaps it with the middle buffer, the reader swaps the middle
+ * buffer with its front buffer if a newer embedding was published. Buffers are reused, so after the first
+ * three publications of the same size no memory is allocated.
+ *
+ * publish() returns true only for the first publication after the reader acquired the last one,
+ * such that the writer can notify the reader once instead of queuing a notification per publication.
+ */
+class EmbeddingSnapshot
+{
+public:
+    struct Embedding
+    {
+        std::vector<float>  data;
+        uint32_t            numPoints = 0;
+        uint32_t            numDimensions = 0;
+        uint32_t            iteration = 0;
+    };
+
+public:
+    EmbeddingSnapshot();
+
+    /** Writer: copy an embedding into the snapshot. Returns true if the reader should be notified */
+    bool publish(const std::vector<float>& data, const uint32_t numPoints, const uint32_t numDimensions, const uint32_t iteration);
+
+    /** Reader: latest published embedding, stays valid and unchanged until the next call of acquire() */
+    const Embedding& acquire();
+
+    /** Reader: whether an embedding was published since the last acquire() */
+    bool hasNewEmbedding() const;
+
+private:
+    std::array<Embedding, 3>    _buffers;
+    uint32_t                    _front;                 /** Owned by the reader */
+    uint32_t                    _middle;                /** Exchanged under _swapMutex */
+    uint32_t                    _back;                  /** Owned by the writer */
+    bool                        _newEmbedding;          /** Middle buffer is newer than the front buffer */
+    mutable std::mutex          _swapMutex;
+    std::mutex                  _writerMutex;           /** Serializes writers, e.g. of a stopped and a new computation */
+    std::atomic<bool>           _notificationPending;
+};
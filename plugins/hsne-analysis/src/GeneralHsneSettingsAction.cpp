@@ -39,7 +39,7 @@ GeneralHsneSettingsAction::GeneralHsneSettingsAction(HsneSettingsAction& hsneSet
     
     _knnMetrics["HNSW"] = { "Euclidean", "Inner Product (Dot)" };
     _knnMetrics["ANNOY"] = { "Euclidean", "Cosine", "Inner Product (Dot)", "Manhattan" };
-    _knnMetrics["Exact"] = { "Euclidean" };
+    _knnMetrics["Exact"] = { "Euclidean", "Cosine", "Inner Product (Dot)" };
 
     _knnTypeAction.setDefaultWidgetFlags(OptionAction::ComboBox);
     _distanceMetricAction.setDefaultWidgetFlags(OptionAction::ComboBox);
@@ -20,6 +20,8 @@ GeneralTsneSettingsAction::GeneralTsneSettingsAction(TsneSettingsAction& tsneSet
     _iterationsPushlishExtendAction(this, "Set Ref. extends at"),
     _publishExtendsOnceAction(this, "Set Ref. extends once", true),
     _numComputatedIterationsAction(this, "Computed iterations"),
+    _gradientDescentTypeAction(this, "Gradient descent"),
+    _convergenceToleranceAction(this, "Convergence tolerance"),
     _computationAction(this),
     _embDatasets()
 {
@@ -27,12 +29,13 @@ GeneralTsneSettingsAction::GeneralTsneSettingsAction(TsneSettingsAction& tsneSet
     setObjectName("General TSNE");
 
     /// UI set up: add actions
-    for (auto& action : WidgetActions{ &_datasetSelectionAction, &_exaggerationIterAction, &_exponentialDecayAction,
+    for (auto& action : WidgetActions{ &_datasetSelectionAction, &_gradientDescentTypeAction, &_exaggerationIterAction, &_exponentialDecayAction,
         & _exaggerationFactorAction, & _exaggerationToggleAction, & _iterationsPushlishExtendAction, & _publishExtendsOnceAction,
-        & _numNewIterationsAction, & _numDefaultUpdateIterationsAction, & _numComputatedIterationsAction, & _computationAction })
+        & _numNewIterationsAction, & _numDefaultUpdateIterationsAction, & _convergenceToleranceAction, & _numComputatedIterationsAction, & _computationAction })
         addAction(action);
 
     _datasetSelectionAction.setDefaultWidgetFlags(OptionAction::ComboBox);
+    _gradientDescentTypeAction.setDefaultWidgetFlags(OptionAction::ComboBox);
     _numNewIterationsAction.setDefaultWidgetFlags(IntegralAction::SpinBox);
     _exaggerationIterAction.setDefaultWidgetFlags(IntegralAction::SpinBox);
     _exponentialDecayAction.setDefaultWidgetFlags(IntegralAction::SpinBox);
@@ -42,12 +45,14 @@ GeneralTsneSettingsAction::GeneralTsneSettingsAction(TsneSettingsAction& tsneSet
     _iterationsPushlishExtendAction.setDefaultWidgetFlags(IntegralAction::SpinBox);
 
     _datasetSelectionAction.initialize();
+    _gradientDescentTypeAction.initialize(QStringList({ "GPU", "CPU (Barnes-Hut)", "CPU (FFT)", "CPU (exact)", "Automatic" }), "Automatic");
     _numDefaultUpdateIterationsAction.initialize(0, 10000, 2000u);
     _numNewIterationsAction.initialize(0, 10000, 0);
     _iterationsPushlishExtendAction.initialize(1, 10000, 250);
     _exaggerationIterAction.initialize(1, 10000, 250);
     _exponentialDecayAction.initialize(1, 10000, 70);
     _exaggerationFactorAction.initialize(0, 100, 4, 2);
+    _convergenceToleranceAction.initialize(0, 0.1f, 0.0005f, 4);
 
     _numComputatedIterationsAction.initialize(0, 100000, 0);
     _numComputatedIterationsAction.setEnabled(false);
@@ -58,6 +63,8 @@ GeneralTsneSettingsAction::GeneralTsneSettingsAction(TsneSettingsAction& tsneSet
 
     _iterationsPushlishExtendAction.setToolTip("Should be larger or equal to number of exaggeration iterations");
     _publishExtendsOnceAction.setToolTip("Only set the reference extends once, when computing the top level embedding first");
+    _gradientDescentTypeAction.setToolTip("GPU requires OpenGL, the CPU gradient descent also runs on headless machines. CPU (exact) is fastest for small and CPU (FFT) for large embeddings. Automatic selects by number of points. Falls back to CPU if no OpenGL context is available");
+    _convergenceToleranceAction.setToolTip("Stop before the set number of iterations once the embedding changes its shape by less than this fraction of its radius per 10 iterations. Only checked after exaggeration. 0 always runs all iterations");
 
     const auto updateNumIterations = [this]() -> void {
         _tsneSettingsAction.getTsneParameters().setNumIterations(_numDefaultUpdateIterationsAction.getValue());
@@ -89,9 +96,20 @@ GeneralTsneSettingsAction::GeneralTsneSettingsAction(TsneSettingsAction& tsneSet
         _tsneSettingsAction.getTsneParameters().setExaggerationFactor(exaggeration);
     };
 
+    const auto updateGradientDescentType = [this]() -> void {
+        // order as in GradientDescentType
+        _tsneSettingsAction.getTsneParameters().setGradientDescentType(static_cast<GradientDescentType>(_gradientDescentTypeAction.getCurrentIndex()));
+    };
+
+    const auto updateConvergenceTolerance = [this]() -> void {
+        _tsneSettingsAction.getTsneParameters().setConvergenceTolerance(_convergenceToleranceAction.getValue());
+    };
+
     const auto updateReadOnly = [this]() -> void {
         auto enable = !isReadOnly();
 
+        _gradientDescentTypeAction.setEnabled(enable);
+        _convergenceToleranceAction.setEnabled(enable);
         _numNewIterationsAction.setEnabled(enable);
         _numDefaultUpdateIterationsAction.setEnabled(enable);
         _iterationsPushlishExtendAction.setEnabled(enable);
@@ -165,6 +183,14 @@ GeneralTsneSettingsAction::GeneralTsneSettingsAction(TsneSettingsAction& tsneSet
         updateExaggerationFactor();
         });
 
+    connect(&_gradientDescentTypeAction, &OptionAction::currentIndexChanged, this, [this, updateGradientDescentType](const std::int32_t& currentIndex) {
+        updateGradientDescentType();
+        });
+
+    connect(&_convergenceToleranceAction, &DecimalAction::valueChanged, this, [this, updateConvergenceTolerance](const float& value) {
+        updateConvergenceTolerance();
+        });
+
     connect(this, &GroupAction::readOnlyChanged, this, [this, updateReadOnly](const bool& readOnly) {
         updateReadOnly();
     });
@@ -174,6 +200,8 @@ GeneralTsneSettingsAction::GeneralTsneSettingsAction(TsneSettingsAction& tsneSet
     updateExaggerationIter();
     updateExponentialDecay();
     updateExaggerationFactor();
+    updateGradientDescentType();
+    updateConvergenceTolerance();
     updateReadOnly();
     _numComputatedIterationsAction.setEnabled(false);
 
@@ -43,6 +43,8 @@ public: // Action getters
     IntegralAction& getNumNewIterationsAction() { return _numNewIterationsAction; };
     IntegralAction& getNumDefaultUpdateIterationsAction() { return _numDefaultUpdateIterationsAction; };
     IntegralAction& getNumComputatedIterationsAction() { return _numComputatedIterationsAction; };
+    OptionAction& getGradientDescentTypeAction() { return _gradientDescentTypeAction; };
+    DecimalAction& getConvergenceToleranceAction() { return _convergenceToleranceAction; };
     TsneComputationAction& getComputationAction() { return _computationAction; }
 
 public: // EmbDatasets
@@ -61,6 +63,8 @@ protected:
     IntegralAction          _numNewIterationsAction;                /** Number of new iterations action */
     IntegralAction          _numDefaultUpdateIterationsAction;      /** Number of default update iterations action */
     IntegralAction          _numComputatedIterationsAction;         /** Number of computed iterations action */
+    OptionAction            _gradientDescentTypeAction;             /** GPU or CPU gradient descent action */
+    DecimalAction           _convergenceToleranceAction;            /** Stop the gradient descent early once the layout is stable action */
     TsneComputationAction   _computationAction;                     /** Computation action */
 
 private:
@@ -0,0 +1,142 @@
+#include "Hashing.h"
+
+#include "Utils.h"
+
+#include <algorithm>    // min, for_each
+#include <cstring>      // memcpy
+#include <execution>
+
+namespace utils {
+
+    /// ///// ///
+    /// XXH64 ///
+    /// ///// ///
+
+    // Reference: https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+
+    static constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    static constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+    static constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+    // size of the independently hashed blocks in contentHash
+    static constexpr size_t HASH_BLOCK_SIZE = size_t(1) << 20;
+
+    static inline uint64_t rotl64(const uint64_t x, const int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static inline uint64_t read64(const unsigned char* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static inline uint32_t read32(const unsigned char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static inline uint64_t round64(uint64_t acc, const uint64_t input) {
+        acc += input * PRIME64_2;
+        acc = rotl64(acc, 31);
+        return acc * PRIME64_1;
+    }
+
+    static inline uint64_t mergeRound64(uint64_t acc, const uint64_t val) {
+        acc ^= round64(0, val);
+        return acc * PRIME64_1 + PRIME64_4;
+    }
+
+    uint64_t xxhash64(const void* data, const size_t size, const uint64_t seed)
+    {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        const unsigned char* const end = p + size;
+        uint64_t h64;
+
+        if (size >= 32)
+        {
+            const unsigned char* const limit = end - 32;
+            uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+            uint64_t v2 = seed + PRIME64_2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME64_1;
+
+            do {
+                v1 = round64(v1, read64(p)); p += 8;
+                v2 = round64(v2, read64(p)); p += 8;
+                v3 = round64(v3, read64(p)); p += 8;
+                v4 = round64(v4, read64(p)); p += 8;
+            } while (p <= limit);
+
+            h64 = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+            h64 = mergeRound64(h64, v1);
+            h64 = mergeRound64(h64, v2);
+            h64 = mergeRound64(h64, v3);
+            h64 = mergeRound64(h64, v4);
+        }
+        else
+            h64 = seed + PRIME64_5;
+
+        h64 += static_cast<uint64_t>(size);
+
+        while (p + 8 <= end) {
+            h64 ^= round64(0, read64(p));
+            h64 = rotl64(h64, 27) * PRIME64_1 + PRIME64_4;
+            p += 8;
+        }
+
+        if (p + 4 <= end) {
+            h64 ^= static_cast<uint64_t>(read32(p)) * PRIME64_1;
+            h64 = rotl64(h64, 23) * PRIME64_2 + PRIME64_3;
+            p += 4;
+        }
+
+        while (p < end) {
+            h64 ^= static_cast<uint64_t>(*p) * PRIME64_5;
+            h64 = rotl64(h64, 11) * PRIME64_1;
+            p++;
+        }
+
+        // avalanche
+        h64 ^= h64 >> 33;
+        h64 *= PRIME64_2;
+        h64 ^= h64 >> 29;
+        h64 *= PRIME64_3;
+        h64 ^= h64 >> 32;
+
+        return h64;
+    }
+
+    uint64_t contentHash(const void* data, const size_t size, const uint64_t seed)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        const size_t numBlocks = (size + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE;
+
+        // blocks are hashed independently, the last entry holds the total size
+        std::vector<uint64_t> blockHashes(numBlocks + 1);
+        blockHashes[numBlocks] = static_cast<uint64_t>(size);
+
+        utils::parallel_for(numBlocks, [&](const auto block) {
+            const size_t begin = block * HASH_BLOCK_SIZE;
+            const size_t blockSize = std::min(HASH_BLOCK_SIZE, size - begin);
+            blockHashes[block] = xxhash64(bytes + begin, blockSize, seed);
+            }, 1);
+
+        return xxhash64(blockHashes.data(), blockHashes.size() * sizeof(uint64_t), seed);
+    }
+
+    std::string hashToString(const uint64_t hash)
+    {
+        static constexpr char hexDigits[] = "0123456789abcdef";
+
+        std::string hex(16, '0');
+        for (size_t i = 0; i < 16; i++)
+            hex[15 - i] = hexDigits[(hash >> (4 * i)) & 0xF];
+
+        return hex;
+    }
+
+}
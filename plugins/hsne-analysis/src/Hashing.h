@@ -0,0 +1,43 @@
+#ifndef HASHING_H
+#define HASHING_H
+
+#include <cstddef>      // size_t
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace utils {
+
+    /// /////// ///
+    /// HASHING ///
+    /// /////// ///
+
+    /*! 64 bit xxHash (XXH64) of a byte sequence
+     * \param data pointer to the first byte
+     * \param size number of bytes
+     * \param seed hash seed
+    */
+    uint64_t xxhash64(const void* data, const size_t size, const uint64_t seed = 0);
+
+    /*! Content hash of a large buffer, computed in parallel
+     * The buffer is split into fixed-size blocks which are hashed independently,
+     * the block hashes are then hashed together with the total size.
+     * The result thus only depends on the content, not on the number of threads.
+    */
+    uint64_t contentHash(const void* data, const size_t size, const uint64_t seed = 0);
+
+    inline uint64_t contentHash(const std::vector<float>& data, const uint64_t seed = 0) {
+        return contentHash(data.data(), data.size() * sizeof(float), seed);
+    }
+
+    /*! Combine two hashes, order dependent */
+    inline uint64_t hashCombine(const uint64_t a, const uint64_t b) {
+        return xxhash64(&b, sizeof(b), a);
+    }
+
+    /*! Fixed-width hexadecimal representation, e.g. for file names */
+    std::string hashToString(const uint64_t hash);
+
+}
+
+#endif HASHING_H
@@ -5,40 +5,38 @@
 #include "Utils.h"
 #include "UtilsScale.h"
 #include "Logger.h"
+#include "CacheFile.h"
+#include "Hashing.h"
 
 #include <nlohmann/json.hpp>
 
 #include <iostream>
-#include <fstream>
-#include <algorithm>    // std::partial_sort_copy, max_element
+#include <sstream>
+#include <span>
+#include <algorithm>    // std::partial_sort_copy, max_element, any_of
 #include <utility>      // pair
 #include <numeric>
+#include <atomic>
+#include <future>
 #include <mutex>
 #include <execution>
 #include <limits>
 
 // set suffix strings for cache
 constexpr auto _CACHE_SUBFOLDER_ = "roi-hsne-cache";
-constexpr auto _HIERARCHY_CACHE_EXTENSION_ = "_hierarchy.hsne";
-constexpr auto _INFLUENCE_TOPDOWN_CACHE_EXTENSION_ = "_influence-tp-hierarchy.hsne";
-constexpr auto _INFLUENCE_BUTTUP_CACHE_EXTENSION_ = "_influence-bu-hierarchy.hsne";
-constexpr auto _PARAMETERS_CACHE_EXTENSION_ = "_parameters.hsne";
-constexpr auto _TRANSITIONNN_CACHE_EXTENSION_ = "_transitionNN.hsne";
-constexpr auto _PARAMETERS_CACHE_VERSION_ = "1.0";
-
-////////////////////
-// Utility functions
-////////////////////
-
-//* Utility function to check whether a file opens correctly */
-const bool fileOpens(const std::ofstream& file) {
-    if (!file.is_open())
-    {
-        Log::error("Caching failed. File could not be opened. ");
-        return false;
-    }
-
-    return true;
+constexpr auto _CACHE_EXTENSION_ = ".hsnecache";
+constexpr auto _KNN_CACHE_EXTENSION_ = ".knncache";
+constexpr auto _PARAMETERS_CACHE_VERSION_ = "1.3";
+constexpr uint32_t _CACHE_FORMAT_VERSION_ = 2;
+
+// sections of the cache file
+namespace CacheSection {
+    constexpr uint32_t PARAMETERS = 0;
+    constexpr uint32_t HIERARCHY = 1;
+    constexpr uint32_t INFLUENCE_TOPDOWN = 2;
+    constexpr uint32_t INFLUENCE_BOTTOMUP = 3;
+    constexpr uint32_t TRANSITION_NN = 4;
+    constexpr uint32_t SIMILARITIES = 5;
 }
 
 ////////////////////
@@ -49,119 +47,148 @@ void InfluenceHierarchy::initialize(const HsneHierarchy& hierarchy)
 {
     Log::info("InfluenceHierarchy::initialize: for each data point for each scale, comp the influence the respc landmarks have on it");
 
-    // Resize the influence maps and their LandmarkMaps on each scale
     const uint32_t numDataPoints = hierarchy.getScale(0).size();
     const uint32_t numScales = hierarchy.getNumScales();
-
-    _influenceMapTopDown.resize(numScales);
-    _influenceMapBottomUp.resize(numScales);
-
-    // scale 0, the data level: numLandmarksData == numDataPoints
-    _influenceMapTopDown[0].resize(numDataPoints);
-    _influenceMapBottomUp[0].resize(numDataPoints);
     const Hsne::scale_type& bottomScale = hierarchy.getScale(0);
 
-    // for scales 1 to n
-    for (uint32_t scale = 1; scale < numScales; scale++)
-    {
-        uint32_t numLandmarks = hierarchy.getScale(scale).size();
+    // The maps are built in two passes, without any locks:
+    // 1. For each data point and scale, find the landmark with the largest influence (here)
+    // 2. For each scale, count the data points per landmark, prefix-sum the counts and scatter the data point IDs (initializeScale)
+    //
+    // The influence of the landmarks on scale s on the data points is the chained sparse product
+    //      I_1 = A_1,  I_s = I_{s-1} x A_s
+    // of the area of influence matrices A_s (rows: landmarks on scale s-1, columns: landmarks on scale s).
+    // Each row of I_s only depends on the same row of I_{s-1}, so the product is computed row by row
+    // (Gustavson's algorithm with a dense accumulator) and only the top-1 column per row is kept.
+    // As in HDILib's getInfluenceOnDataPoint, only entries above a threshold are propagated to the next scale.
+
+    // topLandmark[scale][i]: landmark (on scale) that influences data point i the most, or NO_LANDMARK
+    // this is the bottom-up map
+    std::vector<LandmarkMapSingle> topLandmark(numScales, LandmarkMapSingle(numDataPoints, NO_LANDMARK));
+
+    // for scale 0 points only influence themselve
+    utils::parallel_for(numDataPoints, [&](const auto i) {
+        topLandmark[0][i] = bottomScale._landmark_to_original_data_idx[i];
+        });
 
-        _influenceMapTopDown[scale].resize(numLandmarks);
-        _influenceMapBottomUp[scale].resize(numDataPoints);
-    }
+    // accumulator size: largest number of landmarks on any scale above the data scale
+    uint32_t maxNumLandmarks = 0;
+    for (uint32_t scale = 1; scale < numScales; scale++)
+        maxNumLandmarks = std::max(maxNumLandmarks, static_cast<uint32_t>(hierarchy.getScale(scale).size()));
 
-    // guards _influenceMapTopDown and progressCounter
-    std::mutex m_influenceMapTopDown;
-    std::mutex m_progressCounter;
+    constexpr float threshPropagation = 0.01f;     // entries below are not propagated, unless they are the largest in their row
+    constexpr uint32_t blockSize = 1024;           // data points per task, amortizes the accumulator allocation
 
-    uint32_t progressCounter = 0;
-    float progress = 0.0;
+    const uint32_t numBlocks = (numDataPoints + blockSize - 1) / blockSize;
 
-    // for each data point, get the influence of landmarks
-    auto range = utils::pyrange(numDataPoints);
-    std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const auto i) {
-        // influence[scale]: influence exercised on the data points i by landmarks in a scale 
-        std::vector<std::unordered_map<uint32_t, float>> influence;
+    std::atomic<uint32_t> progressCounter = 0;
+    const uint32_t progressStep = std::max(numBlocks / 1000u, 1u);   // update every 0.1 percent
 
-        float threshTopDown = 0.01f;
-        hierarchy.getInfluenceOnDataPoint(i, influence, threshTopDown, false);
+    utils::parallel_for(numBlocks, [&](const auto block) {
+        std::vector<float> accumulator(maxNumLandmarks, 0.0f);
+        std::vector<uint32_t> touched;                          // non-zero columns of the accumulator
+        std::vector<std::pair<uint32_t, float>> currentRow;     // sparse row of I_{s-1}
 
-        // make sure that each data point i is influenced by at least 1 landmark in each scale
-        // if not, lower the influence treshold by the factor 0.1. Tries this maximally 3 times
+        const uint32_t blockEnd = std::min(numDataPoints, (block + 1) * blockSize);
+        for (uint32_t i = block * blockSize; i < blockEnd; i++)
         {
-            bool redo = false;
-            const int tries_max = 3;
+            // I_0 is the identity: the data point influences only itself
+            currentRow.assign(1, { i, 1.0f });
 
-            for (int tries = 0; tries < tries_max; tries++)
+            for (uint32_t scale = 1; scale < numScales; scale++)
             {
-                for (uint32_t scale = 1; scale < numScales; scale++)
-                {
-                    if (influence[scale].size() < 1)
-                    {
-                        redo = true;
-                        break;  // immedeatly break out the inner for loop once we know that there is a redo
-                    }
-                }
+                const HsneMatrix& areaOfInfluence = hierarchy.getScale(scale)._area_of_influence;
 
-                // get influence for lower treshold if necessary, else break out of the loop
-                if (redo)
+                // propagate entries above the threshold, but always at least the largest one
+                float thresh = 0.0f;
+                if (scale > 1)
                 {
-                    //if(threshTopDown < 0.0005) 
-                        // Log::info("Couldn't find landmark for point " + std::to_string(i) + " at scale " + std::to_string(redo) + " num possible landmarks " + std::to_string(influence[redo].size()) + "\nSetting new threshold to " + std::to_string(threshTopDown * 0.1));
-                    threshTopDown *= 0.1f;
-                    hierarchy.getInfluenceOnDataPoint(i, influence, threshTopDown, false);
+                    float maxValue = 0.0f;
+                    for (const auto& [landmark, value] : currentRow)
+                        maxValue = std::max(maxValue, value);
+                    thresh = std::min(threshPropagation, maxValue);
                 }
-                else
+
+                // row of I_{s-1} x A_s
+                for (const auto& [landmark, value] : currentRow)
                 {
-                    break; // if we don't need to redo, we can break out of the trying-loop
+                    if (value < thresh)
+                        continue;
+
+                    for (Eigen::SparseVector<float>::InnerIterator it(areaOfInfluence[landmark].memory()); it; ++it) {
+                        const uint32_t col = static_cast<uint32_t>(it.index());
+                        if (accumulator[col] == 0.0f)
+                            touched.push_back(col);
+                        accumulator[col] += value * it.value();
+                    }
                 }
-            }
-        }
-
-        // for scale 0 points only influence themselve
-        _influenceMapTopDown[0][i].push_back(bottomScale._landmark_to_original_data_idx[i]);
-        _influenceMapBottomUp[0][i].push_back(bottomScale._landmark_to_original_data_idx[i]);
-
-        // for each scale above 0 
-        // take the landmark that influences data point i the most and save it as
-        //      _influenceMapTopDown[scale][topInfluencingLandmark].push_back(i)
-        // and save the reverse mapping as
-        //      _influenceMapBottomUp[scale][i].push_back(topInfluencingLandmark)
-        for (uint32_t scale = 1; scale < numScales; scale++)
-        {
-            // order influences
-            const std::unordered_map<uint32_t, float>& scaleMap = influence[scale];
 
-            // check if there are any influcing landmarks
-            if (scaleMap.size() == 0)
-            {
-                Log::error("Failed to find landmark for point " + std::to_string(i) + " at scale " + std::to_string(scale) + ". Num possible landmarks: " + std::to_string(scaleMap.size()));
-                continue;
-            }
+                // gather the row, reset the accumulator and keep the top-1 landmark
+                currentRow.clear();
+                uint32_t topLandmarkOnScale = NO_LANDMARK;
+                float topValue = 0.0f;
+                for (const uint32_t col : touched)
+                {
+                    const float value = accumulator[col];
+                    accumulator[col] = 0.0f;
+                    currentRow.emplace_back(col, value);
 
-            // find landmarks with largest influence
-            auto cmpLambda = [](const std::pair<uint32_t, float>& lhs, const std::pair<uint32_t, float>& rhs) { return lhs.second < rhs.second; };
-            auto largestInfluencingLandmark = std::max_element(scaleMap.begin(), scaleMap.end(), cmpLambda);
+                    if (value > topValue || (value == topValue && col < topLandmarkOnScale))
+                    {
+                        topValue = value;
+                        topLandmarkOnScale = col;
+                    }
+                }
+                touched.clear();
 
-            _influenceMapBottomUp[scale][i].push_back(largestInfluencingLandmark->first);   // _influenceMapBottomUp[scale][i].size() will be at most 1
+                if (topLandmarkOnScale == NO_LANDMARK)
+                {
+                    Log::error("Failed to find landmark for point " + std::to_string(i) + " at scale " + std::to_string(scale));
+                    break;
+                }
 
-            {   // guard in case largestInfluencingLandmark->first is the same for another i on this scale
-                std::scoped_lock<std::mutex> lk(m_influenceMapTopDown);
-                _influenceMapTopDown[scale][largestInfluencingLandmark->first].push_back(i);
+                // each data point is only written by one thread, no guard necessary
+                topLandmark[scale][i] = topLandmarkOnScale;
             }
-
         }
 
         // print progress
-        {
-            std::scoped_lock<std::mutex> lk(m_progressCounter);
-            progressCounter++;
-            progress = static_cast<float>(progressCounter) / numDataPoints;
-            if (static_cast<uint32_t>(progress * 10000) % 10 == 0) // update every 10th percent
-                std::cout << '\r' << fmt::format("Progress: {:.1f}% ({}/{})", progress*100, progressCounter, numDataPoints);   // rewrite progress line 
-        }
-    });
+        const uint32_t progress = ++progressCounter;
+        if (progress % progressStep == 0 || progress == numBlocks)
+            std::cout << '\r' + fmt::format("Progress: {:.1f}% ({}/{})", 100.f * progress / numBlocks, std::min(progress * blockSize, numDataPoints), numDataPoints);   // rewrite progress line 
+    }, 1);
     std::cout << std::endl; // next line after progress
+
+    _influenceMapBottomUp = std::move(topLandmark);
+
+    // The top-down maps are built per scale with initializeScale()
+    _influenceMapTopDown.clear();
+    _influenceMapTopDown.resize(numScales);
+}
+
+void InfluenceHierarchy::initializeScale(const HsneHierarchy& hierarchy, const uint32_t scale)
+{
+    const LandmarkMapSingle& labels = _influenceMapBottomUp[scale];
+    const uint32_t numDataPoints = static_cast<uint32_t>(labels.size());
+    const uint32_t numLandmarks = (scale == 0) ? numDataPoints : hierarchy.getScale(scale).size();
+
+    // count data points per landmark and compute row offsets with an exclusive prefix sum
+    std::vector<size_t> offsets(static_cast<size_t>(numLandmarks) + 1, 0);
+    for (const uint32_t landmark : labels)
+        if (landmark != NO_LANDMARK)
+            offsets[landmark + 1]++;
+
+    std::inclusive_scan(offsets.begin(), offsets.end(), offsets.begin());
+
+    // scatter data point IDs, iterating in order keeps the IDs of each landmark sorted
+    std::vector<uint32_t> dataPointIDs(offsets.back());
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < numDataPoints; i++)
+        if (labels[i] != NO_LANDMARK)
+            dataPointIDs[cursor[labels[i]]++] = i;
+
+    // offsets and IDs are the CSR layout of the LandmarkMap
+    _influenceMapTopDown[scale] = LandmarkMap(std::move(offsets), std::move(dataPointIDs));
 }
 
 
@@ -177,6 +204,10 @@ void HsneHierarchy::setParameters(const HsneParameters& parameters)
 
 void HsneHierarchy::initialize(mv::CoreInterface* core, const Points& inputData, const std::vector<bool>& enabledDimensions, const HsneParameters& parameters, const std::string& cachePath)
 {
+    // finish preparing the scales of a previous hierarchy before replacing it
+    if (_scalePreparation.valid())
+        _scalePreparation.wait();
+
     _core = core;
 
     // Convert our own HSNE parameters to the HDI parameters
@@ -200,7 +231,34 @@ void HsneHierarchy::initialize(mv::CoreInterface* core, const Points& inputData,
     else
         _cachePath = std::filesystem::path(cachePath) / _CACHE_SUBFOLDER_;
 
-    _cachePathFileName = _cachePath / _inputDataName.toStdString();
+    // Get data from core, discard local data copy after initialization
+    std::vector<float> data;
+    {
+        std::vector<uint32_t> dimensionIndices;
+
+        data.resize((inputData.isFull() ? inputData.getNumPoints() : inputData.indices.size()) * _numDimensions);
+        for (uint32_t i = 0; i < inputData.getNumDimensions(); i++)
+            if (enabledDimensions[i]) dimensionIndices.push_back(i);
+
+        inputData.populateDataForDimensions<std::vector<float>, std::vector<uint32_t>>(data, dimensionIndices);
+    }
+
+    // The cache is keyed by the content of the data and the parameters, not the data name
+    utils::timer([&]() {
+        _dataHash = utils::contentHash(data);
+        },
+        "Hashing data for cache");
+
+    const std::string cacheParameters = getCacheParameters();
+    const uint64_t cacheKey = utils::hashCombine(_dataHash, utils::xxhash64(cacheParameters.data(), cacheParameters.size()));
+
+    _cachePathFileName = _cachePath / utils::hashToString(cacheKey);
+
+    // The kNN graph does not depend on the hierarchy settings and is cached separately
+    const std::string cacheKnnParameters = getCacheKnnParameters();
+    const uint64_t cacheKnnKey = utils::hashCombine(_dataHash, utils::xxhash64(cacheKnnParameters.data(), cacheKnnParameters.size()));
+
+    _cacheKnnPathFileName = _cachePath / utils::hashToString(cacheKnnKey);
 
     // Initialize hierarchy
     _hsne = std::make_unique<Hsne>();
@@ -208,7 +266,10 @@ void HsneHierarchy::initialize(mv::CoreInterface* core, const Points& inputData,
 
     // Check of hsne data can be loaded from cache on disk, otherwise compute hsne hierarchy
     bool hsneLoadedFromCache = loadCache();
-    if (hsneLoadedFromCache == false) {
+    if (hsneLoadedFromCache == true) {
+        setScalesReady(true);
+    }
+    else {
         Log::info("HsneHierarchy::initialize() compute HSNE hierarchy.");
 
         // Set up a logger
@@ -219,26 +280,31 @@ void HsneHierarchy::initialize(mv::CoreInterface* core, const Points& inputData,
 
         Log::redirect_std_io_to_logger();
 
-        // Init hierarchy, discard local data copy afterwards
+        // Init hierarchy
         {
-            // Get data from core
-            std::vector<float> data;
-            std::vector<uint32_t> dimensionIndices;
-
-            data.resize((inputData.isFull() ? inputData.getNumPoints() : inputData.indices.size()) * _numDimensions);
-            for (uint32_t i = 0; i < inputData.getNumDimensions(); i++)
-                if (enabledDimensions[i]) dimensionIndices.push_back(i);
-
-            inputData.populateDataForDimensions<std::vector<float>, std::vector<uint32_t>>(data, dimensionIndices);
-
             // Initialize HSNE with the input data and the given parameters
-            if (_exactKnn)
+            // Start from cached similarities if only the hierarchy settings changed
+            if (loadCacheSimilarities())
+            {
+                _hsne->initialize(_similarities, _params);
+            }
+            else if (_exactKnn)
             {
                 computeSimilarities(data);
                 _hsne->initialize(_similarities, _params);
+                saveCacheSimilarities(_similarities);
             }
             else
+            {
                 _hsne->initialize((Hsne::scalar_type*)data.data(), _numPoints, _params);
+                saveCacheSimilarities(_hsne->scale(0)._transition_matrix);   // the data scale transition matrix are the similarities
+            }
+
+            // the hierarchy keeps its own copy of the similarities
+            HsneMatrix().swap(_similarities);
+
+            data.clear();
+            data.shrink_to_fit();
         }
 
         // Add a number of scales as indicated by the user
@@ -248,16 +314,73 @@ void HsneHierarchy::initialize(mv::CoreInterface* core, const Points& inputData,
 
         Log::reset_std_io();
 
+        // bottom-up maps for all scales
         _influenceHierarchy.initialize(*this);
 
-        computeTransitionNN();
+        // Top-down maps and transition NN are prepared per scale:
+        // the top scale right away such that the top level embedding can be computed,
+        // all other scales in the background
+        _transitionNNOnScale.clear();
+        _transitionNNOnScale.resize(_numScales);
+        setScalesReady(false);
+
+        prepareScale(getTopScale());
+
+        _scalePreparation = std::async(std::launch::async, [this]() {
+            utils::ScopedTimer prepareScalesTimer("Preparing lower scales in the background");
+            utils::ScopedTaskPriority taskPriority(utils::TaskPriority::Background);
+
+            utils::parallel_for(getTopScale(), [this](const auto scale) {
+                prepareScale(scale);
+                }, 1);
 
-        // Write HSNE hierarchy to disk
-        saveCacheHsne();
+            // Write HSNE hierarchy to disk
+            saveCacheHsne();
+            });
     }
 
 }
 
+void HsneHierarchy::prepareScale(const uint32_t scale)
+{
+    _influenceHierarchy.initializeScale(*this, scale);
+    computeTransitionNN(scale);
+
+    {
+        std::lock_guard<std::mutex> lock(_scaleReadyMutex);
+        _scaleReady[scale] = true;
+    }
+    _scaleReadyCondition.notify_all();
+
+    Log::info("HsneHierarchy::prepareScale: scale " + std::to_string(scale) + " is ready");
+}
+
+void HsneHierarchy::setScalesReady(const bool ready)
+{
+    {
+        std::lock_guard<std::mutex> lock(_scaleReadyMutex);
+        _scaleReady.assign(_numScales, ready);
+    }
+    _scaleReadyCondition.notify_all();
+}
+
+void HsneHierarchy::waitForScale(const uint32_t scale) const
+{
+    std::unique_lock<std::mutex> lock(_scaleReadyMutex);
+
+    if (scale >= _scaleReady.size() || _scaleReady[scale])
+        return;
+
+    Log::info("HsneHierarchy::waitForScale: waiting for scale " + std::to_string(scale));
+    _scaleReadyCondition.wait(lock, [this, scale]() { return _scaleReady[scale]; });
+}
+
+bool HsneHierarchy::isScaleReady(const uint32_t scale) const
+{
+    std::lock_guard<std::mutex> lock(_scaleReadyMutex);
+    return scale < _scaleReady.size() && _scaleReady[scale];
+}
+
 void HsneHierarchy::getTransitionMatrixForSelectionAtScale(const uint32_t scale, const uint32_t threshConnections, std::vector<uint32_t>& landmarkIdxs, HsneMatrix& transitionMatrix, float thresh) const
 {
     // Get full transition matrix of the previous scale
@@ -316,134 +439,132 @@ void HsneHierarchy::computeSelectionMapsAtScale(const uint32_t scale, const std:
     // INFO: No need to ensure uniqueness in mappingLocalToBottom since InteractiveHsnePlugin::selectionMapping will take care of that
 
     // clear old mappings
-    mappingLocalToBottom.clear();
     mappingBottomToLocal.clear();
+    mappingBottomToLocal.resize(_numPoints, NO_LANDMARK);  // indicator for no mapped value
+
+    // landmarkMap[i] is a span of data points (global IDs) on which the landmark i on a given scale has the highest influence
+    const LandmarkMap& landmarkMapTopDown = getInfluenceMapTopDown(scale);
+    const LandmarkMapSingle& landmarkMapBottomUp = getInfluenceMapBottomUp(scale);
 
-    // Prevent rehashing when inserting values
-    mappingLocalToBottom.resize(localIDsOnNewScale.size());
-    mappingBottomToLocal.resize(_numPoints, std::numeric_limits<uint32_t>::max());  // use max as an indicator for no mapped value
+    const uint32_t numEmbeddedLandmarks = static_cast<uint32_t>(localIDsOnNewScale.size());
 
-    // A LandmarkMap is nothing but std::vector<std::vector<uint32_t>>
-    // The LandmarkMap vector is of the size of numLandmarks on a given scale
-    // landmarkMap[i] is a vector of data points (global IDs) on which the landmark i on a given scale (here topScaleIndex) has the highest influence
-    const LandmarkMap& landmarkMapTopDown = getInfluenceHierarchy().getMapTopDown()[scale];
+    // row offsets of mappingLocalToBottom from the number of influenced data points per landmark
+    std::vector<size_t> offsets(static_cast<size_t>(numEmbeddedLandmarks) + 1, 0);
+    for (uint32_t posInEmbedding = 0; posInEmbedding < numEmbeddedLandmarks; posInEmbedding++)
+        offsets[posInEmbedding + 1] = landmarkMapTopDown.rowSize(localIDsOnNewScale[posInEmbedding]);
 
-    auto range = utils::pyrange(static_cast<uint32_t>(localIDsOnNewScale.size()));
-    std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const auto posInEmbedding) {
-        //const uint32_t localIdOnScale = localIDsOnNewScale[posInEmbedding];
-        //const std::vector<uint32_t>& newBottomIDs = landmarkMapTopDown[localIdOnScale];
+    std::inclusive_scan(offsets.begin(), offsets.end(), offsets.begin());
 
+    std::vector<uint32_t> bottomIDs(offsets.back());
+
+    // position in embedding for each landmark on the scale, NO_LANDMARK if the landmark is not embedded
+    LandmarkMapSingle landmarkToPosInEmbedding(landmarkMapTopDown.size(), NO_LANDMARK);
+
+    utils::parallel_for(numEmbeddedLandmarks, [&](const auto posInEmbedding) {
         // when selecting in the embedding, select all data level IDs that are influenced by the landmark selection
-        mappingLocalToBottom[posInEmbedding] = landmarkMapTopDown[localIDsOnNewScale[posInEmbedding]];
+        const LandmarkMap::Row influencedBottomIDs = landmarkMapTopDown[localIDsOnNewScale[posInEmbedding]];
+        std::copy(influencedBottomIDs.begin(), influencedBottomIDs.end(), bottomIDs.begin() + offsets[posInEmbedding]);
+
+        landmarkToPosInEmbedding[localIDsOnNewScale[posInEmbedding]] = posInEmbedding;
+        });
 
-        // for heuristic, each image point maps to one landmark
-        for (auto const& bottomID : mappingLocalToBottom[posInEmbedding])
-            mappingBottomToLocal[bottomID] = posInEmbedding;
+    mappingLocalToBottom = LandmarkMap(std::move(offsets), std::move(bottomIDs));
 
+    // for heuristic, each image point maps to one landmark
+    utils::parallel_for(_numPoints, [&](const auto bottomID) {
+        const uint32_t landmark = landmarkMapBottomUp[bottomID];
+        if (landmark != NO_LANDMARK)
+            mappingBottomToLocal[bottomID] = landmarkToPosInEmbedding[landmark];
         });
 }
 
 void HsneHierarchy::saveCacheHsne() const {
     if (!_hsne) return; // only save if initialize() has been called
 
+    // all scales must be prepared
+    for (uint32_t scale = 0; scale < _numScales; scale++)
+        waitForScale(scale);
+
     if (!std::filesystem::exists(_cachePath))
         std::filesystem::create_directory(_cachePath);
 
-    Log::info("HsneHierarchy::saveCacheHsne(): save cache to " + _cachePathFileName.string());
-
-    saveCacheHsneHierarchy(_cachePathFileName.string() + _HIERARCHY_CACHE_EXTENSION_);
-    saveCacheHsneInfluenceHierarchy(_cachePathFileName.string() + _INFLUENCE_TOPDOWN_CACHE_EXTENSION_, _influenceHierarchy.getMapTopDown());
-    saveCacheHsneInfluenceHierarchy(_cachePathFileName.string() + _INFLUENCE_BUTTUP_CACHE_EXTENSION_, _influenceHierarchy.getMapBottomUp());
-    saveCacheParameters(_cachePathFileName.string() + _PARAMETERS_CACHE_EXTENSION_);
-    saveCacheHsneTransitionNNOnScale(_cachePathFileName.string() + _TRANSITIONNN_CACHE_EXTENSION_);
-}
-
-void HsneHierarchy::saveCacheHsneHierarchy(std::string fileName) const {
-    Log::info("Writing " + fileName);
+    const Path cacheFile = _cachePathFileName.string() + _CACHE_EXTENSION_;
 
-    std::ofstream saveFile(fileName, std::ios::out | std::ios::binary);
+    Log::info("HsneHierarchy::saveCacheHsne(): save cache to " + cacheFile.string());
 
-    if (!fileOpens(saveFile)) return;
+    cache::CacheWriter writer(cacheFile, _CACHE_FORMAT_VERSION_);
 
-    hdi::dr::IO::saveHSNE(*_hsne, saveFile, _hsne->logger());
+    if (!writer.isOpen())
+    {
+        Log::error("Caching failed. File could not be opened. ");
+        return;
+    }
 
-    saveFile.close();
+    saveCacheParameters(writer);
+    saveCacheHsneHierarchy(writer);
+    saveCacheHsneInfluenceHierarchy(writer, _influenceHierarchy.getMapTopDown());
+    saveCacheHsneInfluenceHierarchy(writer, _influenceHierarchy.getMapBottomUp());
+    saveCacheHsneTransitionNNOnScale(writer);
 
+    if (!writer.commit())
+        Log::error("Caching failed. Could not write " + cacheFile.string());
 }
 
-void HsneHierarchy::saveCacheHsneInfluenceHierarchy(std::string fileName, const std::vector<LandmarkMap>& influenceHierarchy) const {
-    Log::info("Writing " + fileName);
+void HsneHierarchy::saveCacheHsneHierarchy(cache::CacheWriter& writer) const {
+    writer.beginSection(CacheSection::HIERARCHY);
 
-    std::ofstream saveFile(fileName, std::ios::out | std::ios::binary);
+    std::ostream saveStream(writer.streamBuffer());
+    hdi::dr::IO::saveHSNE(*_hsne, saveStream, _hsne->logger());
+    saveStream.flush();
 
-    if (!fileOpens(saveFile)) return;
+    writer.endSection();
+}
 
-    size_t iSize = influenceHierarchy.size();
+void HsneHierarchy::saveCacheHsneInfluenceHierarchy(cache::CacheWriter& writer, const std::vector<LandmarkMap>& influenceHierarchy) const {
+    writer.beginSection(CacheSection::INFLUENCE_TOPDOWN);
 
-    saveFile.write((const char*)&iSize, sizeof(decltype(iSize)));
-    for (size_t i = 0; i < iSize; i++)
+    // each LandmarkMap is written as its CSR offsets and IDs arrays
+    writer.writeValue(static_cast<uint64_t>(influenceHierarchy.size()));
+    for (const LandmarkMap& landmarkMap : influenceHierarchy)
     {
-        size_t jSize = influenceHierarchy[i].size();
-        saveFile.write((const char*)&jSize, sizeof(decltype(jSize)));
-        for (size_t j = 0; j < jSize; j++)
-        {
-            size_t kSize = influenceHierarchy[i][j].size();
-            saveFile.write((const char*)&kSize, sizeof(decltype(kSize)));
-            if (kSize > 0)
-            {
-                saveFile.write((const char*)&influenceHierarchy[i][j].front(), kSize * sizeof(uint32_t));
-            }
-        }
+        writer.writeArray(landmarkMap.getOffsets());
+        writer.writeArray(landmarkMap.getIDs());
     }
 
-    saveFile.close();
+    writer.endSection();
 }
 
-void HsneHierarchy::saveCacheHsneTransitionNNOnScale(std::string fileName) const {
-    Log::info("Writing " + fileName);
+void HsneHierarchy::saveCacheHsneInfluenceHierarchy(cache::CacheWriter& writer, const std::vector<LandmarkMapSingle>& influenceHierarchy) const {
+    writer.beginSection(CacheSection::INFLUENCE_BOTTOMUP);
 
-    std::ofstream saveFile(fileName, std::ios::out | std::ios::binary);
+    writer.writeValue(static_cast<uint64_t>(influenceHierarchy.size()));
+    for (const LandmarkMapSingle& landmarkMap : influenceHierarchy)
+        writer.writeArray(landmarkMap);
 
-    if (!fileOpens(saveFile)) return;
+    writer.endSection();
+}
 
-    // type of _transitionNNOnScale is 
-    // std::vector<std::vector<std::vector<uint32_t>>>
-    //     scales     landmarks      kNN      ID (local on scale)
+void HsneHierarchy::saveCacheHsneTransitionNNOnScale(cache::CacheWriter& writer) const {
+    writer.beginSection(CacheSection::TRANSITION_NN);
 
-    size_t iSize = _transitionNNOnScale.size();
-    saveFile.write((const char*)&iSize, sizeof(decltype(iSize)));  // write number of scales
-    for (size_t i = 0; i < iSize; i++) // scales
+    // each scale is written as k and its flat ID and count arrays
+    writer.writeValue(static_cast<uint64_t>(_transitionNNOnScale.size()));  // write number of scales
+    for (const NeighborMatrix& nnOnScale : _transitionNNOnScale)
     {
-        size_t jSize = _transitionNNOnScale[i].size();
-        saveFile.write((const char*)&jSize, sizeof(decltype(jSize)));  // write number of landmarks on scale
-
-        for (size_t j = 0; j < jSize; j++) // landmarks on scale
-        {
-            size_t kSize = _transitionNNOnScale[i][j].size();
-            saveFile.write((const char*)&kSize, sizeof(decltype(kSize)));    // write number of kNN of landmarks on scale
-
-            if (kSize > 0)
-            {
-                saveFile.write((const char*)&_transitionNNOnScale[i][j].front(), kSize * sizeof(uint32_t));
-            }// kNN of landmarks on scale
-        } // landmarks on scale
-    } // scales
+        writer.writeValue(static_cast<uint64_t>(nnOnScale.k()));
+        writer.writeArray(nnOnScale.getIDs());
+        writer.writeArray(nnOnScale.getCounts());
+    }
 
-    saveFile.close();
+    writer.endSection();
 }
 
-void HsneHierarchy::saveCacheParameters(std::string fileName) const {
-    Log::info("Writing " + fileName);
-
-    std::ofstream saveFile(fileName, std::ios::out | std::ios::trunc);
-    
-    if (!fileOpens(saveFile)) return;
-
-    // store parameters in json file
+std::string HsneHierarchy::getCacheParameters() const {
+    // store parameters as json
     nlohmann::json parameters;
     parameters["## VERSION ##"] = _PARAMETERS_CACHE_VERSION_;
 
-    parameters["Input data name"] = _inputDataName.toStdString();
+    parameters["Data hash"] = utils::hashToString(_dataHash);
     parameters["Number of points"] = _numPoints;
     parameters["Number of dimensions"] = _numDimensions;
 
@@ -470,56 +591,72 @@ void HsneHierarchy::saveCacheParameters(std::string fileName) const {
     parameters["Seed for random algorithms"] = _params._seed;
     parameters["Select landmarks with a MCMCS"] = _params._monte_carlo_sampling;
 
-    // Write to file
-    saveFile << std::setw(4) << parameters << std::endl;
-    saveFile.close();
+    return parameters.dump(4);
+}
+
+void HsneHierarchy::saveCacheParameters(cache::CacheWriter& writer) const {
+    writer.beginSection(CacheSection::PARAMETERS);
+    writer.writeString(getCacheParameters());
+    writer.endSection();
 }
 
 bool HsneHierarchy::loadCache() {
-    Log::info("HsneHierarchy::loadCache(): attempt to load cache from " + _cachePathFileName.string());
-
-    auto pathParameter = _cachePathFileName.string() + _PARAMETERS_CACHE_EXTENSION_;
-    auto pathHierarchy = _cachePathFileName.string() + _HIERARCHY_CACHE_EXTENSION_;
-    auto pathInfluenceTD = _cachePathFileName.string() + _INFLUENCE_TOPDOWN_CACHE_EXTENSION_;
-    auto pathInfluenceBU = _cachePathFileName.string() + _INFLUENCE_BUTTUP_CACHE_EXTENSION_;
-    auto pathTransition = _cachePathFileName.string() + _TRANSITIONNN_CACHE_EXTENSION_;
-   
-    for (const Path& path : { pathHierarchy, pathInfluenceTD, pathInfluenceBU, pathParameter, pathTransition })
+    const Path cacheFile = _cachePathFileName.string() + _CACHE_EXTENSION_;
+
+    Log::info("HsneHierarchy::loadCache(): attempt to load cache from " + cacheFile.string());
+
+    if (!(std::filesystem::exists(cacheFile)))
     {
-        if (!(std::filesystem::exists(path)))
+        Log::info("Loading cache failed: No file exists at: " + cacheFile.string());
+        return false;
+    }
+
+    // maps the file, sections are read directly from the mapped memory
+    cache::CacheReader reader(cacheFile, _CACHE_FORMAT_VERSION_);
+
+    if (!reader.isValid())
+    {
+        Log::info("Loading cache failed: Not a valid cache file: " + cacheFile.string());
+        return false;
+    }
+
+    for (const uint32_t section : { CacheSection::PARAMETERS, CacheSection::HIERARCHY, CacheSection::INFLUENCE_TOPDOWN, CacheSection::INFLUENCE_BOTTOMUP, CacheSection::TRANSITION_NN })
+    {
+        if (!reader.hasSection(section))
         {
-            Log::info("Loading cache failed: No file exists at: " + path.string());
+            Log::info("Loading cache failed: Missing section in " + cacheFile.string());
             return false;
         }
     }
-    
-    if (!checkCacheParameters(pathParameter))
+
+    std::string parameters;
+    if (!reader.section(CacheSection::PARAMETERS).readString(parameters) || !checkCacheParameters(parameters))
     {
         Log::warn("Loading cache failed: Current settings are different from cached parameters.");
         return false;
     }
 
-    auto checkCache = [](bool success, std::string path) -> bool
+    auto checkCache = [&cacheFile](bool success, std::string sectionName) -> bool
     {
         if (success)
             return true;
         else
         {
-            Log::error("Loading cache failed: " + path);
+            Log::error("Loading cache failed: " + sectionName + " in " + cacheFile.string());
             return false;
         }
     };
 
-    if (!checkCache(loadCacheHsneHierarchy(pathHierarchy), pathHierarchy))
+    if (!checkCache(loadCacheHsneHierarchy(reader.section(CacheSection::HIERARCHY)), "hierarchy"))
         return false;
 
-    if (!checkCache(loadCacheHsneInfluenceHierarchy(pathInfluenceTD, _influenceHierarchy.getMapTopDown()), pathInfluenceTD))
+    if (!checkCache(loadCacheHsneInfluenceHierarchy(reader.section(CacheSection::INFLUENCE_TOPDOWN), _influenceHierarchy.getMapTopDown()), "top-down influence hierarchy"))
         return false;
 
-    if (!checkCache(loadCacheHsneInfluenceHierarchy(pathInfluenceBU, _influenceHierarchy.getMapBottomUp()), pathInfluenceBU))
+    if (!checkCache(loadCacheHsneInfluenceHierarchy(reader.section(CacheSection::INFLUENCE_BOTTOMUP), _influenceHierarchy.getMapBottomUp()), "bottom-up influence hierarchy"))
         return false;
 
-    if (!checkCache(loadCacheHsneTransitionNNOnScale(pathTransition), pathTransition))
+    if (!checkCache(loadCacheHsneTransitionNNOnScale(reader.section(CacheSection::TRANSITION_NN)), "transition NN"))
         return false;
 
     Log::info("HsneHierarchy::loadCache: loading hierarchy from cache was successfull");
@@ -527,12 +664,8 @@ bool HsneHierarchy::loadCache() {
     return true;
 }
 
-bool HsneHierarchy::loadCacheHsneHierarchy(std::string fileName) {
-    std::ifstream loadFile(fileName.c_str(), std::ios::in | std::ios::binary);
-
-    if (!loadFile.is_open()) return false;
-
-    Log::info("Loading " + fileName);
+bool HsneHierarchy::loadCacheHsneHierarchy(cache::SectionReader section) {
+    if (!section.isValid()) return false;
 
     if (_hsne) { 
         _hsne.reset();
@@ -543,116 +676,227 @@ bool HsneHierarchy::loadCacheHsneHierarchy(std::string fileName) {
 
     _hsne->setLogger(_log.get());
 
+    // HDILib parses the hierarchy from a stream, read it from the mapped section
+    cache::MemoryStreamBuffer sectionBuffer(section.remaining());
+    std::istream loadStream(&sectionBuffer);
+
     // TODO: check if hsne matches data
-    hdi::dr::IO::loadHSNE(*_hsne, loadFile, _log.get());
+    hdi::dr::IO::loadHSNE(*_hsne, loadStream, _log.get());
 
     _numScales = static_cast<uint32_t>(_hsne->hierarchy().size());
 
     Log::reset_std_io();
 
+    return !loadStream.bad();
+
+}
+
+bool HsneHierarchy::loadCacheHsneInfluenceHierarchy(cache::SectionReader section, std::vector<LandmarkMap>& influenceHierarchy) {
+    if (!_hsne) return false;
+
+    uint64_t numScales = 0;
+    if (!section.readValue(numScales) || numScales != _numScales)
+        return false;
+
+    influenceHierarchy.resize(numScales);
+
+    for (auto& landmarkMap : influenceHierarchy)
+    {
+        std::vector<size_t> offsets;
+        std::vector<uint32_t> ids;
+
+        if (!section.readArray(offsets) || !section.readArray(ids))
+            return false;
+
+        if (offsets.empty() || offsets.front() != 0 || offsets.back() != ids.size() || !std::is_sorted(offsets.begin(), offsets.end()))
+            return false;
+
+        landmarkMap = LandmarkMap(std::move(offsets), std::move(ids));
+    }
+
     return true;
 
 }
 
-bool HsneHierarchy::loadCacheHsneInfluenceHierarchy(std::string fileName, std::vector<LandmarkMap>& influenceHierarchy) {
+bool HsneHierarchy::loadCacheHsneInfluenceHierarchy(cache::SectionReader section, std::vector<LandmarkMapSingle>& influenceHierarchy) {
     if (!_hsne) return false;
 
-    std::ifstream loadFile(fileName.c_str(), std::ios::in | std::ios::binary);
+    uint64_t numScales = 0;
+    if (!section.readValue(numScales) || numScales != _numScales)
+        return false;
 
-    if (!loadFile.is_open()) return false;
+    influenceHierarchy.resize(numScales);
 
-    Log::info("Loading " + fileName);
+    for (auto& landmarkMap : influenceHierarchy)
+    {
+        if (!section.readArray(landmarkMap))
+            return false;
+    }
 
-    // TODO: check if hsne matches data
-    size_t iSize = 0;
-    loadFile.read((char*)&iSize, sizeof(decltype(iSize)));
+    return true;
+
+}
+
+bool HsneHierarchy::loadCacheHsneTransitionNNOnScale(cache::SectionReader section) {
+    if (!_hsne) return false;
 
-    influenceHierarchy.resize(iSize);
+    uint64_t numScales = 0;
+    if (!section.readValue(numScales) || numScales != _numScales)
+        return false;
 
-    for (size_t i = 0; i < influenceHierarchy.size(); i++)
+    _transitionNNOnScale.resize(numScales);
+
+    for (auto& nnOnScale : _transitionNNOnScale)
     {
-        size_t jSize = 0;
-        loadFile.read((char*)&jSize, sizeof(decltype(jSize)));
-        influenceHierarchy[i].resize(jSize);
+        uint64_t k = 0;
+        std::vector<uint32_t> ids;
+        std::vector<uint32_t> counts;
 
-        for (size_t j = 0; j < influenceHierarchy[i].size(); j++)
-        {
-            size_t kSize = 0;
-            loadFile.read((char*)&kSize, sizeof(decltype(kSize)));
+        if (!section.readValue(k) || !section.readArray(ids) || !section.readArray(counts))
+            return false;
 
-            influenceHierarchy[i][j].resize(kSize);
-            if (kSize > 0)
-            {
-                loadFile.read((char*)&influenceHierarchy[i][j].front(), kSize * sizeof(uint32_t));
-            }
-        }
-    }
+        if (ids.size() != counts.size() * k || std::any_of(counts.begin(), counts.end(), [k](const uint32_t count) { return count > k; }))
+            return false;
 
-    loadFile.close();
+        nnOnScale = NeighborMatrix(k, std::move(ids), std::move(counts));
+    }
 
     return true;
 
 }
 
-bool HsneHierarchy::loadCacheHsneTransitionNNOnScale(std::string fileName) {
-    if (!_hsne) return false;
+std::string HsneHierarchy::getCacheKnnParameters() const {
+    nlohmann::json parameters;
+    parameters["## VERSION ##"] = _PARAMETERS_CACHE_VERSION_;
 
-    std::ifstream loadFile(fileName.c_str(), std::ios::in | std::ios::binary);
+    parameters["Data hash"] = utils::hashToString(_dataHash);
+    parameters["Number of points"] = _numPoints;
+    parameters["Number of dimensions"] = _numDimensions;
 
-    if (!loadFile.is_open()) return false;
+    parameters["Knn library"] = _params._aknn_algorithm;
+    parameters["Knn exact"] = _exactKnn;
+    parameters["Knn distance metric"] = _params._aknn_metric;
+    parameters["Knn number of neighbors"] = _params._num_neighbors;
 
-    Log::info("Loading " + fileName);
+    // the approximate kNN graph depends on the library settings
+    if (!_exactKnn)
+    {
+        parameters["Nr. Trees for AKNN (Annoy)"] = _params._aknn_annoy_num_trees;
+        parameters["Parameter M (HNSW)"] = _params._aknn_hnsw_M;
+        parameters["Parameter eff (HNSW)"] = _params._aknn_hnsw_eff;
+        parameters["Seed for random algorithms"] = _params._seed;
+    }
 
-    // type of _transitionNNOnScale is 
-    // std::vector<std::vector<std::vector<uint32_t>>>
-    //     scales     landmarks      kNN    ID (local on scale)
+    return parameters.dump(4);
+}
 
-    // TODO: check if hsne matches data
-    size_t iSize = 0;
-    loadFile.read((char*)&iSize, sizeof(decltype(iSize)));  // load number of scales
-    _transitionNNOnScale.resize(iSize);
+void HsneHierarchy::saveCacheSimilarities(const HsneMatrix& similarities) const {
+    if (!std::filesystem::exists(_cachePath))
+        std::filesystem::create_directory(_cachePath);
 
-    for (size_t i = 0; i < _transitionNNOnScale.size(); i++)
+    const Path cacheFile = _cacheKnnPathFileName.string() + _KNN_CACHE_EXTENSION_;
+
+    Log::info("HsneHierarchy::saveCacheSimilarities(): save similarities to " + cacheFile.string());
+
+    cache::CacheWriter writer(cacheFile, _CACHE_FORMAT_VERSION_);
+
+    if (!writer.isOpen())
     {
-        size_t jSize = 0;
-        loadFile.read((char*)&jSize, sizeof(decltype(jSize)));  // load number of landmarks on scale
-        _transitionNNOnScale[i].resize(jSize);
+        Log::error("Caching failed. File could not be opened. ");
+        return;
+    }
 
-        for (size_t j = 0; j < _transitionNNOnScale[i].size(); j++)
-        {
-            size_t kSize = 0;
-            loadFile.read((char*)&kSize, sizeof(decltype(kSize)));  // load number of kNN of landmarks on scale
+    writer.beginSection(CacheSection::PARAMETERS);
+    writer.writeString(getCacheKnnParameters());
+    writer.endSection();
 
-            _transitionNNOnScale[i][j].resize(kSize);
-            if (kSize > 0)
-            {
-                loadFile.read((char*)&_transitionNNOnScale[i][j].front(), kSize * sizeof(uint32_t));
-            }
+    // store the sparse similarity matrix in CSR format
+    std::vector<uint64_t> offsets(similarities.size() + 1, 0);
+    for (size_t i = 0; i < similarities.size(); i++)
+        offsets[i + 1] = offsets[i] + static_cast<uint64_t>(similarities[i].memory().nonZeros());
+
+    std::vector<uint32_t> indices(offsets.back());
+    std::vector<float> values(offsets.back());
+
+    utils::parallel_for(similarities.size(), [&](const auto i) {
+        size_t pos = offsets[i];
+        for (Eigen::SparseVector<float>::InnerIterator it(similarities[i].memory()); it; ++it, ++pos) {
+            indices[pos] = static_cast<uint32_t>(it.index());
+            values[pos] = it.value();
         }
+        });
+
+    writer.beginSection(CacheSection::SIMILARITIES);
+    writer.writeArray(offsets);
+    writer.writeArray(indices);
+    writer.writeArray(values);
+    writer.endSection();
+
+    if (!writer.commit())
+        Log::error("Caching failed. Could not write " + cacheFile.string());
+}
+
+bool HsneHierarchy::loadCacheSimilarities() {
+    const Path cacheFile = _cacheKnnPathFileName.string() + _KNN_CACHE_EXTENSION_;
+
+    if (!(std::filesystem::exists(cacheFile)))
+        return false;
+
+    cache::CacheReader reader(cacheFile, _CACHE_FORMAT_VERSION_);
+
+    std::string parameters;
+    if (!reader.isValid() || !reader.section(CacheSection::PARAMETERS).readString(parameters) || parameters != getCacheKnnParameters())
+    {
+        Log::info("HsneHierarchy::loadCacheSimilarities(): cached similarities do not correspond to current settings: " + cacheFile.string());
+        return false;
     }
 
-    loadFile.close();
+    Log::info("HsneHierarchy::loadCacheSimilarities(): load similarities from " + cacheFile.string());
 
-    return true;
+    cache::SectionReader section = reader.section(CacheSection::SIMILARITIES);
 
-}
+    std::span<const uint64_t> offsets;
+    std::span<const uint32_t> indices;
+    std::span<const float> values;
 
-bool HsneHierarchy::checkCacheParameters(std::string fileName) const {
-    if (!_hsne) return false;
+    if (!section.viewArray(offsets) || !section.viewArray(indices) || !section.viewArray(values))
+        return false;
+
+    if (offsets.size() != static_cast<size_t>(_numPoints) + 1 || offsets.front() != 0 || offsets.back() != indices.size() || indices.size() != values.size() || !std::is_sorted(offsets.begin(), offsets.end()) ||
+        std::any_of(indices.begin(), indices.end(), [this](const uint32_t index) { return index >= _numPoints; }))
+    {
+        Log::error("HsneHierarchy::loadCacheSimilarities(): corrupt cache file " + cacheFile.string());
+        return false;
+    }
 
-    std::ifstream loadFile(fileName.c_str(), std::ios::in);
+    _similarities.clear();
+    _similarities.resize(_numPoints);
 
-    if (!loadFile.is_open()) return false;
+    // indices are stored in ascending order per row, i.e. entries are appended
+    utils::parallel_for(_numPoints, [&](const auto i) {
+        _similarities[i].resize(_numPoints);
+        for (size_t pos = offsets[i]; pos < offsets[i + 1]; pos++)
+            _similarities[i][indices[pos]] = values[pos];
+        });
 
-    Log::info("Loading " + fileName);
+    return true;
+}
 
-    // read a JSON file
-    nlohmann::json parameters;
-    loadFile >> parameters;
+bool HsneHierarchy::checkCacheParameters(const std::string& parametersJson) const {
+    if (!_hsne) return false;
+
+    // parse the JSON parameters
+    nlohmann::json parameters = nlohmann::json::parse(parametersJson, nullptr, /* allow_exceptions = */ false);
+
+    if (parameters.is_discarded())
+    {
+        Log::info("Cached parameters could not be parsed. Cannot load cache.");
+        return false;
+    }
 
     if (!parameters.contains("## VERSION ##") || parameters["## VERSION ##"] != _PARAMETERS_CACHE_VERSION_)
     {
-        Log::info("Version of the cache (" + std::string(parameters["## VERSION ##"]) + ") differs from analysis version (" + _PARAMETERS_CACHE_VERSION_ + "). Cannot load cache)");
+        Log::info("Version of the cache (" + parameters.value("## VERSION ##", std::string("unknown")) + ") differs from analysis version (" + _PARAMETERS_CACHE_VERSION_ + "). Cannot load cache)");
         return false;
     }
 
@@ -670,7 +914,7 @@ bool HsneHierarchy::checkCacheParameters(std::string fileName) const {
         return true;
     };
 
-    if (!checkParam("Input data name", _inputDataName.toStdString()) ) return false;
+    if (!checkParam("Data hash", utils::hashToString(_dataHash)) ) return false;
     if (!checkParam("Number of points", _numPoints) ) return false;
     if (!checkParam("Number of dimensions", _numDimensions) ) return false;
 
@@ -706,47 +950,47 @@ bool HsneHierarchy::checkCacheParameters(std::string fileName) const {
     return true;
 }
 
-void HsneHierarchy::computeTransitionNN() {
-    Log::info("HsneHierarchy: computeTransitionNN");
+void HsneHierarchy::computeTransitionNN(const uint32_t scale) {
+    Log::info("HsneHierarchy: computeTransitionNN on scale " + std::to_string(scale));
 
-    // type of _transitionNNOnScale is 
-    // std::vector<std::vector<std::vector<uint32_t>>>
-    //     scales     landmarks      kNN     ID (local on scale)
-    _transitionNNOnScale.resize(_numScales);
+    // _transitionNNOnScale is sized for all scales beforehand, each scale only writes its own entry
+    // for each landmark, keep the (up to) nn landmarks with the highest transition values, sorted descending
 
     const size_t nn = _params._num_neighbors;                                   // use same number of neighbors as t-SNE
 
-    auto range = utils::pyrange(_numScales);
-    std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const auto i) {
-        HsneMatrix& fullTransitionMatrix = getScale(i)._transition_matrix;      // transition matrix for landmarks at scale i
-        std::vector<std::vector<uint32_t>>& nnOnScale = _transitionNNOnScale[i];
+    const HsneMatrix& fullTransitionMatrix = getScale(scale)._transition_matrix; // transition matrix for landmarks at scale
+    const uint32_t numLandmarks = static_cast<uint32_t>(fullTransitionMatrix.size());
 
-        nnOnScale.reserve(fullTransitionMatrix.size());                         // resize with the number of landmarks on the scale
+    NeighborMatrix nnOnScale(numLandmarks, nn);
 
-        transitionVec sortedNN(nn);
+    constexpr uint32_t blockSize = 1024;           // landmarks per task, amortizes the scratch allocation
+    const uint32_t numBlocks = (numLandmarks + blockSize - 1) / blockSize;
 
-        for (auto& transitionValues : fullTransitionMatrix)                     // the MapMemEff is basically a std::vector<std::pair<Key,T>>
+    utils::parallel_for(numBlocks, [&](const auto block) {
+        transitionVec transitionValues;            // scratch, reused for all rows of the block
+
+        const uint32_t blockEnd = std::min(numLandmarks, (block + 1) * blockSize);
+        for (uint32_t landmark = block * blockSize; landmark < blockEnd; landmark++)
         {
-            transitionVec temp_vec;
-            for (Eigen::SparseVector<float>::InnerIterator it(transitionValues.memory()); it; ++it) {
-                temp_vec.emplace_back(it.index(), it.value());
+            transitionValues.clear();
+            for (Eigen::SparseVector<float>::InnerIterator it(fullTransitionMatrix[landmark].memory()); it; ++it) {
+                transitionValues.emplace_back(static_cast<uint32_t>(it.index()), it.value());
             }
 
-            // sort values and store in sortedNN
-            std::partial_sort_copy(temp_vec.begin(), temp_vec.end(),
-                sortedNN.begin(), sortedNN.end(),
-                [](const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b) {return a.second > b.second; });
+            // sort the largest values to the front, ties are broken by ID
+            const size_t numValid = std::min(nn, transitionValues.size());
+            std::partial_sort(transitionValues.begin(), transitionValues.begin() + numValid, transitionValues.end(),
+                [](const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b) { return a.second > b.second || (a.second == b.second && a.first < b.first); });
 
-            // copy first IDs entries of sortedNN and store in sortedIDs
-            std::vector<uint32_t> sortedIDs;
-            for (const auto& [sortedID, sortedVal] : sortedNN)
-                sortedIDs.push_back(sortedID);
+            uint32_t* row = nnOnScale.rowData(landmark);
+            for (size_t n = 0; n < numValid; n++)
+                row[n] = transitionValues[n].first;
 
-            // save IDs
-            nnOnScale.push_back(sortedIDs);
+            nnOnScale.setRowSize(landmark, static_cast<uint32_t>(numValid));
         }
-        });
+        }, 1);
 
+    _transitionNNOnScale[scale] = std::move(nnOnScale);
 }
 
 void HsneHierarchy::computeSimilarities(const std::vector<float>& data)
@@ -758,8 +1002,12 @@ void HsneHierarchy::computeSimilarities(const std::vector<float>& data)
 
     size_t nn = static_cast<size_t>(_params._num_neighbors) + 1;
 
+    utils::DistanceMetric metric = utils::DistanceMetric::L2Sqr;
+    if (!utils::convertFromHDILibMetric(_params._aknn_metric, metric))
+        Log::warn("HsneHierarchy::computeSimilarities: distance metric not supported for exact knn, using Euclidean");
+
     utils::timer([&]() {
-        utils::computeExactKNN(data, data, _numPoints, _numPoints, _numDimensions, nn, distance_based_probabilities, neighborhood_graph);
+        utils::computeExactKNN(data, data, _numPoints, _numPoints, _numDimensions, nn, distance_based_probabilities, neighborhood_graph, metric);
         },
     "computeExactKNN");
 
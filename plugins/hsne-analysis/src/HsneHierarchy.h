@@ -14,11 +14,19 @@
 #include <memory>
 #include <string>
 #include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <future>
 
 class Points;
 class HsneParameters;
 class HsneHierarchy;
 
+namespace cache {
+    class CacheWriter;
+    class SectionReader;
+}
+
 using Path = std::filesystem::path;
 
 /**
@@ -31,13 +39,17 @@ using Path = std::filesystem::path;
 class InfluenceHierarchy
 {
 public:
+    /** Computes the bottom-up maps of all scales, the top-down maps are built per scale with initializeScale() */
     void initialize(const HsneHierarchy& hierarchy);
 
+    /** Builds the top-down map of a scale from its bottom-up map */
+    void initializeScale(const HsneHierarchy& hierarchy, const uint32_t scale);
+
     std::vector<LandmarkMap>& getMapTopDown() { return _influenceMapTopDown; }
     const std::vector<LandmarkMap>& getMapTopDown() const { return _influenceMapTopDown; }
 
-    std::vector<LandmarkMap>& getMapBottomUp() { return _influenceMapBottomUp; }
-    const std::vector<LandmarkMap>& getMapBottomUp() const { return _influenceMapBottomUp; }
+    std::vector<LandmarkMapSingle>& getMapBottomUp() { return _influenceMapBottomUp; }
+    const std::vector<LandmarkMapSingle>& getMapBottomUp() const { return _influenceMapBottomUp; }
 
 private:
     /** Size: number of scales.
@@ -49,11 +61,11 @@ private:
 
     /** Reverse mapping of _influenceMapTopDown
     * Size: number of scales.
-    * For each scale a Landmarkmap: each Landmarkmap is of the size data points
-    * landmarkMap[i] is a vector of landmarks IDs (on scale) which influence data point i the most, this is either 0 or 1 landmark
-    * _influenceMapBottomUp[scale][dataPointID] -> vector of (scale-relative) landmarks that influence dataPointID
+    * For each scale a flat label array of the size data points
+    * landmarkMapSingle[i] is the landmark ID (on scale) which influences data point i the most, or NO_LANDMARK
+    * _influenceMapBottomUp[scale][dataPointID] -> (scale-relative) landmark that influences dataPointID
     */
-    std::vector<LandmarkMap> _influenceMapBottomUp;
+    std::vector<LandmarkMapSingle> _influenceMapBottomUp;
 };
 
 /**
@@ -105,11 +117,36 @@ public:
         return _influenceHierarchy;
     }
 
-    const std::vector<std::vector<uint32_t>>& getTransitionNNOnScale(uint32_t scale) const
+    /** Top-down influence map of a scale, blocks until the scale is prepared */
+    const LandmarkMap& getInfluenceMapTopDown(uint32_t scale) const
+    {
+        waitForScale(scale);
+        return _influenceHierarchy.getMapTopDown()[scale];
+    }
+
+    /** Bottom-up influence map of a scale, blocks until the scale is prepared */
+    const LandmarkMapSingle& getInfluenceMapBottomUp(uint32_t scale) const
+    {
+        waitForScale(scale);
+        return _influenceHierarchy.getMapBottomUp()[scale];
+    }
+
+    /** Transition nearest neighbors of the landmarks on a scale, blocks until the scale is prepared */
+    const NeighborMatrix& getTransitionNNOnScale(uint32_t scale) const
     {
+        waitForScale(scale);
         return _transitionNNOnScale[scale];
     }
 
+    /** 
+     * The top scale is prepared in initialize(), all other scales in the background.
+     * Blocks until the influence maps and transition NN of a scale are available
+     */
+    void waitForScale(const uint32_t scale) const;
+
+    /** Whether the influence maps and transition NN of a scale are available */
+    bool isScaleReady(const uint32_t scale) const;
+
     /**
      * Returns a map of landmark indices and influences on the refined scale (currentScale - 1) in the hierarchy,
      * that are influenced by landmarks specified by their index in the current scale.
@@ -173,6 +210,7 @@ public:
     QString getInputDataName() const { return _inputDataName; }
     uint32_t getNumPoints() const { return _numPoints; }
     uint32_t getNumDimensions() const { return _numDimensions; }
+    int getSeed() const { return _params._seed; }
 
     /** Save HSNE hierarchy from this class to disk */
     void saveCacheHsne() const;
@@ -181,29 +219,48 @@ public:
     bool loadCache();
 
 private:
-    /** Save HsneHierarchy to disk */
-    void saveCacheHsneHierarchy(std::string fileName) const;
-    /** Save InfluenceHierarchy to disk */
-    void saveCacheHsneInfluenceHierarchy(std::string fileName, const std::vector<LandmarkMap>& influenceHierarchy) const;
-    /** Save InfluenceHierarchy to disk */
-    void saveCacheHsneTransitionNNOnScale(std::string fileName) const;
-    /** Save HSNE parameters to disk */
-    void saveCacheParameters(std::string fileName) const;
+    /** Save HsneHierarchy to cache file */
+    void saveCacheHsneHierarchy(cache::CacheWriter& writer) const;
+    /** Save InfluenceHierarchy to cache file */
+    void saveCacheHsneInfluenceHierarchy(cache::CacheWriter& writer, const std::vector<LandmarkMap>& influenceHierarchy) const;
+    /** Save bottom-up InfluenceHierarchy to cache file */
+    void saveCacheHsneInfluenceHierarchy(cache::CacheWriter& writer, const std::vector<LandmarkMapSingle>& influenceHierarchy) const;
+    /** Save transition nearest neighbors to cache file */
+    void saveCacheHsneTransitionNNOnScale(cache::CacheWriter& writer) const;
+    /** HSNE parameters and data hash as JSON, used for the cache key and stored in the cache file */
+    std::string getCacheParameters() const;
+    /** Save HSNE parameters to cache file */
+    void saveCacheParameters(cache::CacheWriter& writer) const;
 
     /** Check whether HSNE parameters of the cached values on disk correspond with the current settings */
-    bool checkCacheParameters(std::string fileName) const;
-    /** Load HsneHierarchy from disk */
-    bool loadCacheHsneHierarchy(std::string fileName);
-    /** Load InfluenceHierarchy from disk */
-    bool loadCacheHsneInfluenceHierarchy(std::string fileName, std::vector<LandmarkMap>& influenceHierarchy);
-    /** Load InfluenceHierarchy from disk */
-    bool loadCacheHsneTransitionNNOnScale(std::string fileName);
+    bool checkCacheParameters(const std::string& parametersJson) const;
+    /** Load HsneHierarchy from cache file section */
+    bool loadCacheHsneHierarchy(cache::SectionReader section);
+    /** Load InfluenceHierarchy from cache file section */
+    bool loadCacheHsneInfluenceHierarchy(cache::SectionReader section, std::vector<LandmarkMap>& influenceHierarchy);
+    /** Load bottom-up InfluenceHierarchy from cache file section */
+    bool loadCacheHsneInfluenceHierarchy(cache::SectionReader section, std::vector<LandmarkMapSingle>& influenceHierarchy);
+    /** Load transition nearest neighbors from cache file section */
+    bool loadCacheHsneTransitionNNOnScale(cache::SectionReader section);
+
+    /** kNN parameters and data hash as JSON, used for the similarity cache key. Independent of the hierarchy settings */
+    std::string getCacheKnnParameters() const;
+    /** Save the kNN-based similarities (the transition matrix of the data scale) to their own cache file */
+    void saveCacheSimilarities(const HsneMatrix& similarities) const;
+    /** Load the kNN-based similarities from disk into _similarities */
+    bool loadCacheSimilarities();
 
     /** Sets the hsne parameter member variables */
     void setParameters(const HsneParameters& params);
 
-    /** Compute the nearest neighbor for each landmark on each scale based on the transition matrices */
-    void computeTransitionNN();
+    /** Compute the nearest neighbor for each landmark on a scale based on the transition matrix */
+    void computeTransitionNN(const uint32_t scale);
+
+    /** Build the top-down influence map and transition NN of a scale and mark it as ready */
+    void prepareScale(const uint32_t scale);
+
+    /** Mark all scales as (not) ready */
+    void setScalesReady(const bool ready);
 
     void computeSimilarities(const std::vector<float>& data);
 
@@ -216,20 +273,26 @@ private:
     std::unique_ptr<Hsne> _hsne;                /**  */
     InfluenceHierarchy _influenceHierarchy;     /**  */
 
-    //   scales     landmarks      kNN      ID 
-    std::vector<std::vector<std::vector<uint32_t>>> _transitionNNOnScale;   /**  */
+    std::vector<NeighborMatrix> _transitionNNOnScale;   /** For each scale the landmarks with the highest transition values per landmark (local IDs on scale) */
 
     std::unique_ptr<hdi::utils::CoutLog> _log;  /**  */
 
     QString _inputDataName;                     /**  */
+    uint64_t _dataHash;                         /** Content hash of the enabled dimensions of the input data */
 
     uint32_t _numScales;                    /**  */
 
     uint32_t _numPoints;                    /**  */
     uint32_t _numDimensions;                /**  */
 
-    HsneMatrix _similarities;                   /** only populated if exact knn are asked for */
+    HsneMatrix _similarities;                   /** only populated during initialization, if exact knn are asked for or loaded from cache */
 
     Path _cachePath;                            /** Path for saving and loading cache */
-    Path _cachePathFileName;                    /** cachePath() + data name */
+    Path _cachePathFileName;                    /** cachePath() + hash of data and parameters */
+    Path _cacheKnnPathFileName;                 /** cachePath() + hash of data and kNN parameters */
+
+    mutable std::mutex _scaleReadyMutex;                    /** Guards _scaleReady */
+    mutable std::condition_variable _scaleReadyCondition;   /** Notified when a scale becomes ready */
+    std::vector<bool> _scaleReady;                          /** Whether influence maps and transition NN of a scale are prepared */
+    std::future<void> _scalePreparation;                    /** Background preparation of the lower scales, declared last such that it finishes before other members are destroyed */
 };
@@ -79,6 +79,11 @@ HsneScaleAction::HsneScaleAction(QObject* parent, InteractiveHsnePlugin* hsneAna
     _recomputeScale(this, "Recompute scale embedding"),
     _embScalingSlider(this, "Scaling multiplier"),
     _noExaggerationUpdate(this, "No exaggeration for new embeddings", false),
+    _initAwareSchedule(this, "Init-aware schedule", true),
+    _anchorReusedPoints(this, "Anchor reused points", false),
+    _onlineUpdates(this, "Online updates", true),
+    _prefetchViewports(this, "Prefetch viewports", true),
+    _viewportCacheSize(this, "Viewport cache (MB)"),
     _randomInitMeta(this, "Update init meta data", false),
     _compRepresents(this, "Compute representations"),
     _copySelectedAttributes(this, "Selection to Dataset"),
@@ -96,7 +101,11 @@ HsneScaleAction::HsneScaleAction(QObject* parent, InteractiveHsnePlugin* hsneAna
     _updateRoiImageLock(10),
     _tsneAnalysis("HSNE"),
     _RoiGoodForUpdate(true),
-    _updateMetaDataset(false)
+    _updateMetaDataset(false),
+    _initTypeFractions(),
+    _awaitingEmbeddingUpdate(false),
+    _deferredUpdate(false),
+    _deferredUpdateDirection(utils::TraversalDirection::AUTO)
 {
     /// UI set up: global values
     setText("HSNE scale");
@@ -108,7 +117,7 @@ HsneScaleAction::HsneScaleAction(QObject* parent, InteractiveHsnePlugin* hsneAna
         &_visBudgetMinAction, &_visBudgetMaxAction, &_visBudgetTargetAction, &_rangeHeuristicAction, &_currentScaleAction,
         & _scaleUpDownActions,& _fixScaleAction,& _landmarkFilterSlider,& _landmarkFilterToggle,& _colorMapRoiEmbAction,
         _colorMapFirstEmbAction,& _recolorDuringUpdates,& _embScalingSlider,& _embScaleFac,& _embCurrExt,& _embMaxExt,
-        & _noExaggerationUpdate,& _recomputeScale,& _randomInitMeta,& _compRepresents,& _copySelectedAttributes })
+        & _noExaggerationUpdate,& _initAwareSchedule,& _anchorReusedPoints,& _onlineUpdates,& _prefetchViewports,& _viewportCacheSize,& _recomputeScale,& _randomInitMeta,& _compRepresents,& _copySelectedAttributes })
         addAction(action);
 
     /// UI set up: _updateStopAction
@@ -122,6 +131,28 @@ HsneScaleAction::HsneScaleAction(QObject* parent, InteractiveHsnePlugin* hsneAna
     /// UI set up: _noExaggerationUpdate
     _noExaggerationUpdate.setToolTip("Use no exaggeration for each new embedding.");
 
+    /// UI set up: _initAwareSchedule
+    _initAwareSchedule.setToolTip("Shorten exaggeration, iterations and learning rate of new embeddings by the fraction of points reused from the previous embedding.");
+
+    /// UI set up: _anchorReusedPoints
+    _anchorReusedPoints.setToolTip("Keep points reused from the previous embedding in place during the first iterations, while new points settle. Requires the CPU gradient descent.");
+
+    /// UI set up: _onlineUpdates
+    _onlineUpdates.setToolTip("Hand the landmarks of a scale update to the running gradient descent instead of starting a new one. Reused points keep their optimizer state. Requires the CPU gradient descent.");
+
+    /// UI set up: _prefetchViewports
+    _prefetchViewports.setToolTip("While the gradient descent runs, compute the landmarks of the viewports that are likely next, from the recent panning and zooming or the viewport sequence.");
+
+    /// UI set up: _viewportCacheSize
+    _viewportCacheSize.setToolTip("Memory for the landmarks and layouts of visited viewports. Revisiting a viewport, e.g. stepping through the viewport sequence, restores its layout. 0 disables the cache.");
+    _viewportCacheSize.setDefaultWidgetFlags(IntegralAction::SpinBox);
+    _viewportCacheSize.initialize(0, 16'384, 512);
+    _hsneScaleUpdate.setCacheSize(static_cast<size_t>(_viewportCacheSize.getValue()) * 1024 * 1024);
+
+    connect(&_viewportCacheSize, &IntegralAction::valueChanged, this, [this](const int32_t& val) {
+        _hsneScaleUpdate.setCacheSize(static_cast<size_t>(val) * 1024 * 1024);
+        });
+
     /// UI set up: landmark influence heuristic and thresholding
     {
         // INFO: Currently not used
@@ -251,6 +282,9 @@ HsneScaleAction::HsneScaleAction(QObject* parent, InteractiveHsnePlugin* hsneAna
             Log::info("HsneScaleAction::TsneAnalysis::finished");
             utils::ScopedTimer TsneAnalysisFinished("HsneScaleAction::TsneAnalysis::finished connection");
 
+            // e.g. the gradient descent could not be initialized
+            showInitialEmbedding();
+
             // compute new embedding extends
             const auto& embContainer = _tsneAnalysis.getEmbedding();
             setCurrentEmbExtends(utils::computeExtends(embContainer.getData()));
@@ -306,93 +340,28 @@ HsneScaleAction::HsneScaleAction(QObject* parent, InteractiveHsnePlugin* hsneAna
 
         connect(&_tsneAnalysis, &TsneAnalysis::publishExtends, this, &HsneScaleAction::setRefEmbExtends);
 
-        // Update embedding points when the TSNE analysis produces new data
-        connect(&_tsneAnalysis, &TsneAnalysis::embeddingUpdate, this, [this](const std::vector<float>& emb, const uint32_t& numPoints, const uint32_t& numDimensions) {
-
-            // Update the refine embedding with new data
-            _embedding->setData(emb, numDimensions);
-
-            // Set updated interation count in UI
-            _tsneSettingsAction.getGeneralTsneSettingsAction().getNumComputatedIterationsAction().setValue(_tsneAnalysis.getNumIterations() - 1);
-
-            // Update the color map every 100 iterations
-            if (_recolorDuringUpdates.isChecked() && !utils::CyclicLock::isLocked(++_updateRoiImageLock))
-                _hsneAnalysisPlugin->setColorMapDataRoiHSNE();
-
-            // Notify others that the embedding points have changed
-            events().notifyDatasetDataChanged(_embedding);
-
-            // Update meta data only once, at the first embeddingUpdate after _hsneScaleUpdate is finished in order to resize the datasets correctly
-            // Meta data is not updated for the top level embedding, it is set earlier in computeTopLevelEmbedding()
-            if (_updateMetaDataset)
-            {
-                assert(_hsneScaleUpdate.getInitTypes().size() == numPoints);
-                _pointInitTypes->setData(_hsneScaleUpdate.getInitTypes().data(), numPoints, 1);
-                events().notifyDatasetDataChanged(_pointInitTypes);
-
-                assert(_hsneScaleUpdate.getRoiRepresentationFractions().size() == numPoints);
-                _roiRepresentation->setData(_hsneScaleUpdate.getRoiRepresentationFractions().data(), numPoints, 1);
-                events().notifyDatasetDataChanged(_roiRepresentation);
-
-                assert(_hsneScaleUpdate.getNumberTransitions().size() == numPoints);
-                _numberTransitions->setData(_hsneScaleUpdate.getNumberTransitions().data(), numPoints, 1);
-                events().notifyDatasetDataChanged(_numberTransitions);
-
-                std::vector<float> tempResize(numPoints * 3u, 0.0f);
-                _colorScatterRoiHSNE->setData(tempResize.data(), numPoints, 3);
-                events().notifyDatasetDataChanged(_colorScatterRoiHSNE);
-
-                // save color image as prev
-                _hsneAnalysisPlugin->saveCurrentColorImageAsPrev();
-
-                // compute new color image
-                _hsneAnalysisPlugin->setColorMapDataRoiHSNE();
-
-                // compute new emb colors based on representative landmarks in top level embedding  
-                _hsneAnalysisPlugin->setScatterColorBasedOnTopLevel();
-
-                // set currentLevelLandmarkData and respective selection mappings. TODO: reduce code duplication
-                {
-                    std::vector<float> dataLandmarks;
-                    std::vector<uint32_t> enabledDimensionsIDs;
-                    size_t numEnabledDimensions;
-                    std::vector<uint32_t> imageIDs;
-
-                    // Set selection linking for landmark data
-                    auto& mapCurrentLevelDataLocalToBottom = _hsneAnalysisPlugin->getSelectionMapCurrentLevelDataLocalToBottom();
-                    auto& mapCurrentLevelDataBottomToLocal = _hsneAnalysisPlugin->getSelectionMapCurrentLevelDataBottomToLocal();
-                    mapCurrentLevelDataLocalToBottom.clear();
-                    mapCurrentLevelDataLocalToBottom.resize(_idMap.size());
-                    mapCurrentLevelDataBottomToLocal.clear();
-                    mapCurrentLevelDataBottomToLocal.resize(_input->getNumPoints());
-
-                    // Get global landmark IDs
-                    for (const auto& [dataID, embIdAndPos] : _idMap)
-                    {
-                        // add selection map entry
-                        mapCurrentLevelDataLocalToBottom[embIdAndPos.posInEmbedding].emplace_back(dataID);
-                        mapCurrentLevelDataBottomToLocal[dataID] = embIdAndPos.posInEmbedding;
+        connect(&_tsneAnalysis, &TsneAnalysis::updateApplied, this, [this](bool success) {
+            // stoptSNEAnalysis() no longer waits for the update and shows its points itself
+            if (!_awaitingEmbeddingUpdate)
+                return;
 
-                        // copy data ID
-                        imageIDs.emplace_back(dataID);
-                    }
-                    std::sort(utils::exec_policy, imageIDs.begin(), imageIDs.end());
+            _awaitingEmbeddingUpdate = false;
 
-                    // Get dimensions
-                    std::tie(enabledDimensionsIDs, numEnabledDimensions) = _hsneAnalysisPlugin->enabledDimensions();
+            if (success)
+                return;
 
-                    // get data
-                    dataLandmarks.resize(enabledDimensionsIDs.size()* imageIDs.size());
-                    _input->populateDataForDimensions<std::vector<float>, std::vector<uint32_t>, std::vector<uint32_t>>(dataLandmarks, enabledDimensionsIDs, imageIDs);
+            Log::warn("HsneScaleAction::TsneAnalysis::updateApplied: unsuccessful, start a new gradient descent");
+            starttSNEAnalysis();
+            });
 
-                    auto currentLevelLandmarkData = _hsneAnalysisPlugin->getRoiEmbLandmarkDataDataset();
-                    currentLevelLandmarkData->setData(dataLandmarks.data(), imageIDs.size(), numEnabledDimensions);
-                    events().notifyDatasetDataChanged(currentLevelLandmarkData);
-                }
+        // Update embedding points when the TSNE analysis produces new data
+        connect(&_tsneAnalysis, &TsneAnalysis::embeddingUpdate, this, [this](const std::vector<float>& emb, const uint32_t& numPoints, const uint32_t& numDimensions) {
 
-                _updateMetaDataset = false;
-            }
+            // The scale update reads the current embedding and the points of a running gradient descent are about to be replaced
+            if (_awaitingEmbeddingUpdate)
+                return;
 
+            updateEmbedding(emb, numPoints, numDimensions);
             });
     }
 
@@ -498,10 +467,25 @@ HsneScaleAction::HsneScaleAction(QObject* parent, InteractiveHsnePlugin* hsneAna
             {
                 Log::info("HsneScaleWorker::finished successful");
                 _updateMetaDataset = true;
+
+                // A viewport change that could not cancel this update is computed once its embedding is shown
+                if (_hsneScaleUpdate.hasDeferredRequest())
+                {
+                    _deferredUpdate = true;
+                    _deferredUpdateDirection = utils::TraversalDirection::AUTO;
+                }
+
+                _initTypeFractions = _hsneScaleUpdate.getInitTypeFractions();
                 emit starttSNE();
+
+                if (!_deferredUpdate)
+                    prefetchViewports();
             }
             else
+            {
                 Log::warn("HsneScaleWorker::finished unsuccessful");
+                _awaitingEmbeddingUpdate = false;
+            }
 
             });
 
@@ -550,6 +534,9 @@ void HsneScaleAction::initImageSize(const QSize imgSize) {
 
     // inform scale update about image size
     _hsneScaleUpdate.setImageSize(_inputImageSize);
+
+    _viewportPredictor.setImageSize(_inputImageSize.width(), _inputImageSize.height());
+    _viewportPredictor.addViewport(_roi);
 }
 
 void HsneScaleAction::setScale(uint32_t scale)
@@ -639,14 +626,6 @@ utils::VisualBudgetRange HsneScaleAction::getVisualBudgetRange() const {
 
 void HsneScaleAction::update()
 {
-    // If scale worker is still busy, don't start it again
-    if (_hsneScaleUpdate.isRunning())
-    {
-        Log::debug("HsneScaleAction:: hsne Scale Worker is still busy");
-        emit noUpdate(NoUpdate::ISRUNNING);
-        return;
-    }
-
     // see setROI() for checks: 
     // when zooming out, there should be an update but when panning with the full image in view, there should not
     // same for viewport outside image
@@ -672,16 +651,34 @@ void HsneScaleAction::update()
     // update the roi in the sequence viewer
     emit setRoiInSequenceView(_roi);
 
+    _viewportPredictor.addViewport(_roi);
+
     // start the update
     computeUpdate();
 }
 
 void HsneScaleAction::computeUpdate(const utils::TraversalDirection direction /*= utils::TraversalDirection::AUTO*/)
 {
+    // The next update reads the embedding, which must show the points of the last update first
+    if (_updateMetaDataset && !_hsneScaleUpdate.isRunning())
+    {
+        Log::debug("HsneScaleAction::computeUpdate: deferred until the embedding shows the last update");
+        _deferredUpdate = true;
+        _deferredUpdateDirection = direction;
+        return;
+    }
+
     emit started();
 
-    // If gradient descent is currently running for a previous scale update, stop it
-    emit stoptSNE();
+    // Cache the layout of the last update as shown, revisiting its viewport restores it
+    if (!_awaitingEmbeddingUpdate && _viewportCacheSize.getValue() > 0)
+        _hsneScaleUpdate.cacheEmbedding(_embedding);
+
+    // If gradient descent is currently running for a previous scale update, stop it, unless it continues with the new points
+    if (!(_onlineUpdates.isChecked() && _tsneAnalysis.canUpdateOnline()))
+        emit stoptSNE();
+
+    _awaitingEmbeddingUpdate = true;
 
     // Deselect all items (resizing datasets with active selections might cause problems)
     _hsneAnalysisPlugin->deselectAll();
@@ -689,13 +686,26 @@ void HsneScaleAction::computeUpdate(const utils::TraversalDirection direction /*
     // Get current visual budget, as defined in the UI
     const auto visualBudget = getVisualBudgetRange();
 
-    // start worker and stop t-SNE (if is it computing in the background)
+    // start worker, a running update is cancelled and continues with the latest viewport
     _hsneScaleUpdate.startComputation(_embedding, _roi, _imageIndices, _idMap, _fixScaleAction.isChecked(), _tresh_influence, visualBudget, _embScaling, _currentEmbExtends,
         getLandmarkFilterNumber(), direction, _hsneAnalysisPlugin->getSelectionMapBottomToLocal(), _hsneAnalysisPlugin->getSelectionMapLocalToBottom(),
         _initEmbedding, _newTransitionMatrix);
 
 }
 
+void HsneScaleAction::prefetchViewports()
+{
+    if (!_prefetchViewports.isChecked() || _updateStopAction.isChecked())
+        return;
+
+    // Two steps ahead covers continued panning and zooming, the worker drops predictions that are not repeated
+    const auto predictedViewports = _viewportPredictor.predict(2);
+
+    Log::debug(fmt::format("HsneScaleAction::prefetchViewports: {} predicted viewports", predictedViewports.size()));
+
+    _hsneScaleUpdate.prefetch(predictedViewports, _imageIndices, _fixScaleAction.isChecked(), _tresh_influence, getVisualBudgetRange(), getLandmarkFilterNumber());
+}
+
 void HsneScaleAction::computeTopLevelEmbedding()
 {
     Log::info("HsneScaleAction::computeTopLevelEmbedding");
@@ -711,6 +721,9 @@ void HsneScaleAction::computeTopLevelEmbedding()
     // UI set up: set max scale to go up and down manually //
     _scaleUpDownActions.setNumScales(topScaleIndex);
 
+    // Cached updates belong to the previous hierarchy
+    _hsneScaleUpdate.clearCache();
+
     // Set scale and visual range in UI based on number of landmarks in top scale: vismin = numLandmarks - (range/2)
     // DEPRECATED
     _hsneScaleUpdate.setInitalTopLevelScale(topScaleIndex);
@@ -737,8 +750,7 @@ void HsneScaleAction::computeTopLevelEmbedding()
         // Set selection linking for landmark data
         auto& mapTopLevelDataLocalToBottom = _hsneAnalysisPlugin->getSelectionMapTopLevelDataLocalToBottom();
         auto& mapTopLevelDataBottomToLocal = _hsneAnalysisPlugin->getSelectionMapTopLevelDataBottomToLocal();
-        mapTopLevelDataLocalToBottom.clear();
-        mapTopLevelDataLocalToBottom.resize(_idMap.size());
+        std::vector<uint32_t> topLevelDataIDs(_idMap.size());
         mapTopLevelDataBottomToLocal.clear();
         mapTopLevelDataBottomToLocal.resize(_input->getNumPoints());
 
@@ -747,13 +759,15 @@ void HsneScaleAction::computeTopLevelEmbedding()
         for (const auto& [dataID, embIdAndPos] : _idMap)
         {
             // add selection map entry
-            mapTopLevelDataLocalToBottom[embIdAndPos.posInEmbedding].emplace_back(dataID);
+            topLevelDataIDs[embIdAndPos.posInEmbedding] = dataID;
             mapTopLevelDataBottomToLocal[dataID] = embIdAndPos.posInEmbedding;
 
             // copy data ID
             imageSelectionIDs.emplace_back(dataID);
         }
-        std::sort(utils::exec_policy, imageSelectionIDs.begin(), imageSelectionIDs.end());
+        utils::parallel_sort(imageSelectionIDs.begin(), imageSelectionIDs.end());
+
+        mapTopLevelDataLocalToBottom = LandmarkMap::fromSingleIDs(std::move(topLevelDataIDs));
 
         // Get dimensions
         std::vector<uint32_t> enabledDimensionsIDs;
@@ -792,15 +806,7 @@ void HsneScaleAction::computeTopLevelEmbedding()
         if(pca_success != true)
         {
             Log::info("HsneScaleAction::computeTopLevelEmbedding:: Random init embedding... ");
-            initEmbedding.resize(2ull * numLandmarks);
-            auto range = utils::pyrange(static_cast<size_t>(numLandmarks));
-            std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const size_t i) {
-                auto randomPoint = utils::randomVec(1, 1);
-
-                initEmbedding[2u * i + 0u] = randomPoint.x;
-                initEmbedding[2u * i + 1u] = randomPoint.y;
-                }
-            );
+            utils::randomEmbedding(numLandmarks, 1, 1, utils::randomSeed(_hsneHierarchy.getSeed()), initEmbedding);
         }
         },
         "compute init emebdding");
@@ -851,7 +857,7 @@ void HsneScaleAction::computeTopLevelEmbedding()
 
         // Add linked selection between the upper embedding and the bottom layer
         {
-            LandmarkMap& landmarkMap = _hsneHierarchy.getInfluenceHierarchy().getMapTopDown()[topScaleIndex];
+            const LandmarkMap& landmarkMap = _hsneHierarchy.getInfluenceMapTopDown(topScaleIndex);
 
             mv::SelectionMap mapping;
 
@@ -860,7 +866,7 @@ void HsneScaleAction::computeTopLevelEmbedding()
                 for (int i = 0; i < landmarkMap.size(); i++)
                 {
                     int bottomLevelIdx = _hsneHierarchy.getScale(topScaleIndex)._landmark_to_original_data_idx[i];
-                    mapping.getMap()[bottomLevelIdx] = landmarkMap[i];
+                    mapping.getMap()[bottomLevelIdx] = std::vector<unsigned int>(landmarkMap[i].begin(), landmarkMap[i].end());
                 }
             }
             else
@@ -869,7 +875,7 @@ void HsneScaleAction::computeTopLevelEmbedding()
                 _input->getGlobalIndices(globalIndices);
                 for (int i = 0; i < landmarkMap.size(); i++)
                 {
-                    std::vector<unsigned int> bottomMap = landmarkMap[i];
+                    std::vector<unsigned int> bottomMap(landmarkMap[i].begin(), landmarkMap[i].end());
                     for (int j = 0; j < bottomMap.size(); j++)
                     {
                         bottomMap[j] = globalIndices[bottomMap[j]];
@@ -935,24 +941,16 @@ void HsneScaleAction::recomputeScaleEmbedding(bool randomInitMeta)
 
     Log::info(fmt::format("recomputeScaleEmbedding: Init new embedding in min/max x: {0}, y: {1} (Current extends * Scaling factor)", rad_randomMax_X, rad_randomMax_Y));
 
-    // random init of the embedding
-    auto rangeEmbPoints = utils::pyrange(numEmbPoints);
-    _initEmbedding.resize(numEmbPoints * 2u);
-    std::for_each(std::execution::par, rangeEmbPoints.begin(), rangeEmbPoints.end(), [&](const size_t i) {
-        auto randomPoint = utils::randomVec(rad_randomMax_X, rad_randomMax_Y);
-
-        _initEmbedding[2u * i + 0u] = randomPoint.x;
-        _initEmbedding[2u * i + 1u] = randomPoint.y;
-        }
-    );
+    // random init of the embedding, different for each scale
+    const uint64_t seed = utils::splitmix64(utils::randomSeed(_hsneHierarchy.getSeed()), _currentScaleLevel);
+    utils::randomEmbedding(numEmbPoints, rad_randomMax_X, rad_randomMax_Y, seed, _initEmbedding);
     _embedding->setData(_initEmbedding.data(), _embedding->getNumPoints(), 2);
 
     // reset all interpolated point types to random
     if (randomInitMeta)
     {
         _pointInitTypes->visitData([&](auto pointData) {
-            auto range = utils::pyrange(_pointInitTypes->getNumPoints());
-            std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const uint i) {
+            utils::parallel_for(_pointInitTypes->getNumPoints(), [&](const uint i) {
                 pointData[i][0] = 2.0f;
                 });
             });
@@ -963,6 +961,9 @@ void HsneScaleAction::recomputeScaleEmbedding(bool randomInitMeta)
     assert(_newTransitionMatrix.size() == _embedding->getNumPoints());
     assert(_newTransitionMatrix.size() == _initEmbedding.size() / 2);
 
+    // all points are placed randomly
+    _initTypeFractions = { 0.0f, 0.0f, 1.0f };
+
     // save color image as prev
     _hsneAnalysisPlugin->saveCurrentColorImageAsPrev();
 
@@ -979,7 +980,7 @@ void HsneScaleAction::publishSelectionData()
     if (selectionIDs.size() == 0)
         return;
 
-    std::sort(utils::exec_policy, selectionIDs.begin(), selectionIDs.end());
+    utils::parallel_sort(selectionIDs.begin(), selectionIDs.end());
 
     Log::info(fmt::format("publishSelectionData: get {} data points", selectionIDs.size()));
 
@@ -1002,27 +1003,30 @@ void HsneScaleAction::publishSelectionData()
     // Set selection linking for landmark data
     auto& mapSelectionDataLocalToBottom = _hsneAnalysisPlugin->getSelectionMapSelectionDataLocalToBottom();
     auto& mapSelectionDataBottomToLocal = _hsneAnalysisPlugin->getSelectionMapSelectionDataBottomToLocal();
-    mapSelectionDataLocalToBottom.clear();
-    mapSelectionDataLocalToBottom.resize(selectionIDs.size());
     mapSelectionDataBottomToLocal.clear();
     mapSelectionDataBottomToLocal.resize(_input->getNumPoints());
 
     // Add selection map entry
+    mapSelectionDataLocalToBottom = LandmarkMap::fromSingleIDs(selectionIDs);
     for (uint32_t i = 0; i < selectionIDs.size(); i++)
-    {
-        mapSelectionDataLocalToBottom[i].emplace_back(selectionIDs[i]);
         mapSelectionDataBottomToLocal[selectionIDs[i]] = i;
-    }
 
 }
 
 
 void HsneScaleAction::starttSNEAnalysis()
 {
-    _tsneAnalysis.stopComputation();
-    
     // per default, HSNE scale embedding are computed without exaggeration here
     TsneParameters tsneParameters = _tsneSettingsAction.getTsneParameters();
+
+    if (_initAwareSchedule.isChecked())
+    {
+        tsneParameters.adaptScheduleToInitialization(_initTypeFractions.interpolPos, _initTypeFractions.randomPos);
+        Log::info(fmt::format("HsneScaleAction::starttSNEAnalysis: Init types previous {0:.2f}, interpolated {1:.2f}, random {2:.2f}: {3} iterations, {4} exaggeration iterations, learning rate {5}",
+            _initTypeFractions.previousPos, _initTypeFractions.interpolPos, _initTypeFractions.randomPos,
+            tsneParameters.getNumIterations(), tsneParameters.getExaggerationIter(), tsneParameters.getLearningRate()));
+    }
+
     if (_noExaggerationUpdate.isChecked())
     {
         tsneParameters.setExaggerationFactor(0);
@@ -1030,18 +1034,170 @@ void HsneScaleAction::starttSNEAnalysis()
         tsneParameters.setExponentialDecayIter(0);
     }
 
+    // Reused points hold their position while interpolated and random points settle
+    std::vector<float> mobility;
+    if (_anchorReusedPoints.isChecked() && _initTypeFractions.previousPos > 0 && _initTypeFractions.randomPos + _initTypeFractions.interpolPos > 0)
+    {
+        const std::vector<float> initTypes = _hsneScaleUpdate.getInitTypes();
+        assert(initTypes.size() == _newTransitionMatrix.size());
+
+        mobility.resize(initTypes.size());
+        for (size_t i = 0; i < initTypes.size(); i++)
+            mobility[i] = (initTypes[i] == utils::initTypeToFloat(utils::POINTINITTYPE::previousPos)) ? tsneParameters.getAnchorMobility() : 1.0f;
+    }
+
+    // A revisited viewport restores its cached layout: a single step without movement publishes it like any other embedding.
+    // The CPU gradient descent starts without momentum, such that the points stay exactly in place
+    const bool restoreEmbedding = _hsneScaleUpdate.isRestoredEmbedding();
+    if (restoreEmbedding)
+    {
+        Log::info("HsneScaleAction::starttSNEAnalysis: Restore the cached embedding of a revisited viewport");
+        tsneParameters.setNumIterations(1);
+        tsneParameters.setLearningRate(0);
+        tsneParameters.setExaggerationFactor(0);
+        tsneParameters.setExaggerationIter(0);
+        tsneParameters.setExponentialDecayIter(0);
+        tsneParameters.setGradientDescentType(GradientDescentType::CPU_BarnesHut);
+        mobility.clear();
+    }
+
+    // Continue the running gradient descent with the new points, embedding updates are shown again once they are applied
+    const auto numPoints = static_cast<uint32_t>(_newTransitionMatrix.size());
+    if (_onlineUpdates.isChecked() && _awaitingEmbeddingUpdate && !restoreEmbedding && _tsneAnalysis.canUpdateOnline(tsneParameters, numPoints))
+    {
+        Log::info("HsneScaleAction::starttSNEAnalysis: Update the running gradient descent");
+        _tsneAnalysis.updateComputation(tsneParameters, _newTransitionMatrix, _initEmbedding, _hsneScaleUpdate.getPreviousIndices(), mobility);
+        return;
+    }
+
+    _awaitingEmbeddingUpdate = false;
+    _tsneAnalysis.stopComputation();
+
     // Start the embedding process
-    _tsneAnalysis.startComputation(tsneParameters, _newTransitionMatrix, _initEmbedding, static_cast<uint32_t>(_newTransitionMatrix.size()));
+    _tsneAnalysis.startComputation(tsneParameters, _newTransitionMatrix, _initEmbedding, numPoints, mobility);
 }
 
 void HsneScaleAction::stoptSNEAnalysis()
 {
+    _awaitingEmbeddingUpdate = false;
     _tsneAnalysis.stopComputation();
+
+    showInitialEmbedding();
+}
+
+void HsneScaleAction::updateEmbedding(const std::vector<float>& emb, const uint32_t numPoints, const uint32_t numDimensions)
+{
+    // Update the refine embedding with new data
+    _embedding->setData(emb, numDimensions);
+
+    // Set updated interation count in UI
+    _tsneSettingsAction.getGeneralTsneSettingsAction().getNumComputatedIterationsAction().setValue(_tsneAnalysis.getNumIterations() - 1);
+
+    // Update the color map every 100 iterations
+    if (_recolorDuringUpdates.isChecked() && !utils::CyclicLock::isLocked(++_updateRoiImageLock))
+        _hsneAnalysisPlugin->setColorMapDataRoiHSNE();
+
+    // Notify others that the embedding points have changed
+    events().notifyDatasetDataChanged(_embedding);
+
+    // Update meta data only once, at the first embeddingUpdate after _hsneScaleUpdate is finished in order to resize the datasets correctly
+    // Meta data is not updated for the top level embedding, it is set earlier in computeTopLevelEmbedding()
+    if (_updateMetaDataset)
+    {
+        assert(_hsneScaleUpdate.getInitTypes().size() == numPoints);
+        _pointInitTypes->setData(_hsneScaleUpdate.getInitTypes().data(), numPoints, 1);
+        events().notifyDatasetDataChanged(_pointInitTypes);
+
+        assert(_hsneScaleUpdate.getRoiRepresentationFractions().size() == numPoints);
+        _roiRepresentation->setData(_hsneScaleUpdate.getRoiRepresentationFractions().data(), numPoints, 1);
+        events().notifyDatasetDataChanged(_roiRepresentation);
+
+        assert(_hsneScaleUpdate.getNumberTransitions().size() == numPoints);
+        _numberTransitions->setData(_hsneScaleUpdate.getNumberTransitions().data(), numPoints, 1);
+        events().notifyDatasetDataChanged(_numberTransitions);
+
+        std::vector<float> tempResize(numPoints * 3u, 0.0f);
+        _colorScatterRoiHSNE->setData(tempResize.data(), numPoints, 3);
+        events().notifyDatasetDataChanged(_colorScatterRoiHSNE);
+
+        // save color image as prev
+        _hsneAnalysisPlugin->saveCurrentColorImageAsPrev();
+
+        // compute new color image
+        _hsneAnalysisPlugin->setColorMapDataRoiHSNE();
+
+        // compute new emb colors based on representative landmarks in top level embedding  
+        _hsneAnalysisPlugin->setScatterColorBasedOnTopLevel();
+
+        // set currentLevelLandmarkData and respective selection mappings. TODO: reduce code duplication
+        {
+            std::vector<float> dataLandmarks;
+            std::vector<uint32_t> enabledDimensionsIDs;
+            size_t numEnabledDimensions;
+            std::vector<uint32_t> imageIDs;
+
+            // Set selection linking for landmark data
+            auto& mapCurrentLevelDataLocalToBottom = _hsneAnalysisPlugin->getSelectionMapCurrentLevelDataLocalToBottom();
+            auto& mapCurrentLevelDataBottomToLocal = _hsneAnalysisPlugin->getSelectionMapCurrentLevelDataBottomToLocal();
+            std::vector<uint32_t> currentLevelDataIDs(_idMap.size());
+            mapCurrentLevelDataBottomToLocal.clear();
+            mapCurrentLevelDataBottomToLocal.resize(_input->getNumPoints());
+
+            // Get global landmark IDs
+            for (const auto& [dataID, embIdAndPos] : _idMap)
+            {
+                // add selection map entry
+                currentLevelDataIDs[embIdAndPos.posInEmbedding] = dataID;
+                mapCurrentLevelDataBottomToLocal[dataID] = embIdAndPos.posInEmbedding;
+
+                // copy data ID
+                imageIDs.emplace_back(dataID);
+            }
+            utils::parallel_sort(imageIDs.begin(), imageIDs.end());
+
+            mapCurrentLevelDataLocalToBottom = LandmarkMap::fromSingleIDs(std::move(currentLevelDataIDs));
+
+            // Get dimensions
+            std::tie(enabledDimensionsIDs, numEnabledDimensions) = _hsneAnalysisPlugin->enabledDimensions();
+
+            // get data
+            dataLandmarks.resize(enabledDimensionsIDs.size()* imageIDs.size());
+            _input->populateDataForDimensions<std::vector<float>, std::vector<uint32_t>, std::vector<uint32_t>>(dataLandmarks, enabledDimensionsIDs, imageIDs);
+
+            auto currentLevelLandmarkData = _hsneAnalysisPlugin->getRoiEmbLandmarkDataDataset();
+            currentLevelLandmarkData->setData(dataLandmarks.data(), imageIDs.size(), numEnabledDimensions);
+            events().notifyDatasetDataChanged(currentLevelLandmarkData);
+        }
+
+        _updateMetaDataset = false;
+
+        // The latest viewport change during the last update
+        if (_deferredUpdate)
+        {
+            _deferredUpdate = false;
+            computeUpdate(_deferredUpdateDirection);
+        }
+    }
+}
+
+void HsneScaleAction::showInitialEmbedding()
+{
+    // The running gradient descent may still show the points, a running scale update reads the embedding
+    if (!_updateMetaDataset || _tsneAnalysis.hasPendingUpdate() || _hsneScaleUpdate.isRunning())
+        return;
+
+    Log::info("HsneScaleAction::showInitialEmbedding: The gradient descent stopped before the embedding showed the last scale update");
+
+    // A deferred viewport change would start a new gradient descent
+    _deferredUpdate = false;
+    _awaitingEmbeddingUpdate = false;
+
+    updateEmbedding(_initEmbedding, static_cast<uint32_t>(_initEmbedding.size() / 2), 2);
 }
 
 void HsneScaleAction::traverseHierarchyForView(utils::TraversalDirection direction) {
-    // If scale worker is still busy, don't start it again
-    if (_hsneScaleUpdate.isRunning())
+    // If scale worker is still busy or the embedding does not yet show its points, don't start it again
+    if (_hsneScaleUpdate.isRunning() || _updateMetaDataset)
     {
         Log::debug("HsneScaleAction:: hsne Scale Worker is still busy");
         return;
@@ -26,7 +26,6 @@ class HsneHierarchy;
 class TsneSettingsAction;
 
 enum class NoUpdate {
-    ISRUNNING,
     ROINOTGOODFORUPDATE,
     SEITINUI
 };
@@ -132,6 +131,9 @@ public:
     /* Without changing the viewport, go up of down the hierarchy */
     void traverseHierarchyForView(utils::TraversalDirection direction);
 
+    /** Interrupt the gradient descent, the embedding keeps the points of the last scale update */
+    void stoptSNEAnalysis();
+
 public: // Action getters
 
     TsneSettingsAction& getTsneSettingsAction() { return _tsneSettingsAction; }
@@ -199,6 +201,9 @@ public: // Setter
     /** Set Min visual value, Max is determined from range, which is kept*/
     void setVisualBudgetRange(const uint32_t visBudgetMin);
 
+    /** Viewports that are likely next independent of the viewport motion, e.g. the neighbouring rows of the viewport sequence. They are prefetched after each update */
+    void setSequenceViewports(const std::vector<utils::ROI>& rois) { _viewportPredictor.setSequenceViewports(rois); }
+
 protected:
     void setIDMap(const IDMapping& idMap) {
         _idMap = idMap;
@@ -220,9 +225,6 @@ private slots:
 
     void starttSNEAnalysis();
 
-    /** Interrupt the gradient descent */
-    void stoptSNEAnalysis();
-
     void refineView();
 
     void coarsenView();
@@ -233,6 +235,15 @@ private slots:
 
     void computeUpdate(const utils::TraversalDirection direction = utils::TraversalDirection::AUTO);
 
+    /** Show the embedding points of the gradient descent, the first points after a scale update also update the meta data */
+    void updateEmbedding(const std::vector<float>& emb, const uint32_t numPoints, const uint32_t numDimensions);
+
+    /** The gradient descent stopped before the embedding showed the points of the last scale update: show their initial positions, such that the embedding matches the ID map and selection maps */
+    void showInitialEmbedding();
+
+    /** Prepare the landmarks of the predicted next viewports while the gradient descent runs */
+    void prefetchViewports();
+
     void publishSelectionData();
 
 protected:
@@ -273,6 +284,11 @@ protected: // UI elements
     StatusAction            _embCurrExt;            /** Embedding current extends */
     StatusAction            _embMaxExt;             /** Embedding max extends */
     ToggleAction            _noExaggerationUpdate;  /** Whether to set exageration to zero for each new embedding */
+    ToggleAction            _initAwareSchedule;     /** Whether to shorten the t-SNE schedule depending on how many points are reused, see TsneParameters::adaptScheduleToInitialization */
+    ToggleAction            _anchorReusedPoints;    /** Whether reused points stay in place while new points settle, see TsneGradientDescentCPU::setMobility */
+    ToggleAction            _onlineUpdates;         /** Whether scale updates continue the running gradient descent, see TsneAnalysis::updateComputation */
+    ToggleAction            _prefetchViewports;     /** Whether the landmarks of predicted next viewports are computed in the background, see HsneScaleUpdate::prefetch */
+    IntegralAction          _viewportCacheSize;     /** Memory in MB for the results and layouts of visited viewports, see HsneScaleUpdateWorker::cacheEmbedding */
     TriggerAction           _recomputeScale;        /** Recompute Scale Embedding trigger */
     ToggleAction            _randomInitMeta;        /** Whether the random init should reset the init meta data */
     TriggerAction           _compRepresents;        /** compute representative landmarks on top scale */
@@ -290,8 +306,13 @@ private:
     IDMapping               _idMap;                 /** Maps global IDs (key) to their position in embedding (array) */
 
     utils::ROI              _roi;                   /** (0,0) is buttom left from user perspective, x-axis goes to the right */
+    utils::ViewportPredictor _viewportPredictor;    /** Predicts the next viewports from the recent viewport changes */
     bool                    _RoiGoodForUpdate;      /** Lock that decides whether a scale update should be computed */
     bool                    _updateMetaDataset;     /** Lock that decides whether _pointInitTypes shoule updated, happens on first embedding update */
+    utils::InitTypeFractions _initTypeFractions;    /** How the points of the next embedding are initialized */
+    bool                    _awaitingEmbeddingUpdate;/** A scale update is computed or handed to the running gradient descent, its embedding updates do not match the new points */
+    bool                    _deferredUpdate;        /** A viewport change arrived before the embedding showed the last update, see computeUpdate */
+    utils::TraversalDirection _deferredUpdateDirection;
 
     InteractiveHsnePlugin*  _hsneAnalysisPlugin;    /** Pointer to HSNE analysis plugin */
 
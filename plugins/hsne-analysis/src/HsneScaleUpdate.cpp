@@ -4,16 +4,83 @@
 #include <algorithm>
 #include <cmath>
 #include <iterator>
+#include <limits>
 #include <numeric>
 
+/// ////////////// ///
+/// ScaleUpdateKey ///
+/// ////////////// ///
+
+ScaleUpdateKey::ScaleUpdateKey(const utils::ROI& roi, const uint32_t currentScaleLevel, const bool fixScale, const float tresh_influence, const utils::VisualBudgetRange& visualBudget, const uint32_t landmarkFilterNumber) :
+    bottomLeftX(static_cast<int32_t>(std::round(roi.layerBottomLeft.x()))),
+    bottomLeftY(static_cast<int32_t>(std::round(roi.layerBottomLeft.y()))),
+    topRightX(static_cast<int32_t>(std::round(roi.layerTopRight.x()))),
+    topRightY(static_cast<int32_t>(std::round(roi.layerTopRight.y()))),
+    startScaleLevel(fixScale ? currentScaleLevel : 0),     // without a fixed scale, the landmarks are searched bottom up
+    fixScale(fixScale),
+    tresh_influence(tresh_influence),
+    visualTarget(fixScale ? 0 : visualBudget.getTarget()),
+    visualTargetHeuristic(fixScale ? false : visualBudget.getHeuristic()),
+    landmarkFilterNumber(landmarkFilterNumber)
+{
+}
+
+utils::ROI ScaleUpdateKey::roi() const
+{
+    return utils::ROI(utils::Vector2D(static_cast<float>(bottomLeftX), static_cast<float>(bottomLeftY)), utils::Vector2D(static_cast<float>(topRightX), static_cast<float>(topRightY)));
+}
+
+
+/// ///////////////// ///
+/// CachedScaleUpdate ///
+/// ///////////////// ///
+
+size_t CachedScaleUpdate::numBytes() const
+{
+    size_t numBytes = sizeof(CachedScaleUpdate);
+
+    numBytes += viewportUpdate.localIDsOnNewScale.size() * sizeof(uint32_t);
+
+    for (const auto& row : viewportUpdate.transitionMatrix)
+        numBytes += sizeof(row) + row.memory().nonZeros() * (sizeof(uint32_t) + sizeof(float));
+
+    for (const auto& [representation, ids] : viewportUpdate.idRoiRepresentation)
+        numBytes += sizeof(representation) + sizeof(ids) + ids.size() * sizeof(uint32_t);
+
+    // unordered_map nodes hold the value and a pointer to the next node, each bucket holds one pointer
+    numBytes += viewportUpdate.idMap.size() * (sizeof(IDMapping::value_type) + 2 * sizeof(void*));
+
+    numBytes += viewportUpdate.mappingBottomToLocal.size() * sizeof(uint32_t);
+    numBytes += viewportUpdate.mappingLocalToBottom.getOffsets().size() * sizeof(size_t) + viewportUpdate.mappingLocalToBottom.numIDs() * sizeof(uint32_t);
+
+    numBytes += embedding.size() * sizeof(float);
+
+    return numBytes;
+}
+
+
 /// ///////////////////// ///
 /// HsneScaleUpdateWorker ///
 /// ///////////////////// ///
 
 HsneScaleUpdateWorker::HsneScaleUpdateWorker(const HsneHierarchy& hsneHierarchy) :
+    _pendingRequest(),
+    _hasPendingRequest(false),
+    _pendingPrefetch(),
+    _hasPendingPrefetch(false),
+    _requestGeneration(0),
+    _prefetchGeneration(0),
+    _prefetchKey(),
+    _isPrefetching(false),
+    _prefetched(),
+    _cache(0, [](const CachedScaleUpdate& cached) { return cached.numBytes(); }),
+    _cacheMutex(),
+    _lastKey(),
+    _lastUpdateCached(false),
+    _restoredEmbedding(false),
     _hsneHierarchy(hsneHierarchy),
     _embedding(nullptr),
-    _roi(nullptr),
+    _roi(),
     _imageIndices(nullptr),
     _mappingBottomToLocal(nullptr),
     _mappingLocalToBottom(nullptr),
@@ -28,6 +95,7 @@ HsneScaleUpdateWorker::HsneScaleUpdateWorker(const HsneHierarchy& hsneHierarchy)
     _IdRoiRepresentation(),
     _initEmbedding(nullptr),
     _initTypes(),
+    _previousIndices(),
     _newTransitionMatrix(nullptr)
 {
 
@@ -38,53 +106,205 @@ void HsneScaleUpdateWorker::setData(Dataset<Points> embedding, const utils::ROI&
     uint32_t landmarkFilterNumber, const utils::TraversalDirection direction, LandmarkMapSingle& mappingBottomToLocal, LandmarkMap& mappingLocalToBottom,
     std::vector<float>& initEmbedding, HsneMatrix& transitionMatrix)
 {
-    _embedding = embedding;
-    _roi = &roi;
-    _imageIndices = &imageIndices;
-    _idMap = &idMap;
-    _fixScale = fixScale;
-    _tresh_influence = tresh_influence;
-    _landmarkFilterNumber = landmarkFilterNumber;
-    _visualBudget = visualBudget;
-    _embScalingFactors = embScalingFactors;
-    _currentEmbExtends = currentEmbExtends;
-    _mappingBottomToLocal = &mappingBottomToLocal;
-    _mappingLocalToBottom = &mappingLocalToBottom;
-    _traversalDirection = direction;
-    _initEmbedding = &initEmbedding;
-    _newTransitionMatrix = &transitionMatrix;
+    std::lock_guard<std::mutex> lock(_requestMutex);
+
+    _pendingRequest = { embedding, roi, &imageIndices, &idMap, fixScale, tresh_influence, visualBudget, embScalingFactors, currentEmbExtends,
+        landmarkFilterNumber, direction, &mappingBottomToLocal, &mappingLocalToBottom, &initEmbedding, &transitionMatrix };
+    _hasPendingRequest = true;
+
+    // cancels the running update
+    ++_requestGeneration;
+
+    // A prefetch of the requested viewport is about to finish, updateScale takes its result once it did.
+    // The prefetch key was computed on the current scale, which an update changes, but no update runs while prefetching
+    const bool isPrefetched = _isPrefetching && direction == utils::TraversalDirection::AUTO &&
+        ScaleUpdateKey(roi, _prefetchKey.startScaleLevel, fixScale, tresh_influence, visualBudget, landmarkFilterNumber) == _prefetchKey;
+
+    if (!isPrefetched)
+        ++_prefetchGeneration;
+}
+
+bool HsneScaleUpdateWorker::discardPendingRequest()
+{
+    std::lock_guard<std::mutex> lock(_requestMutex);
+
+    const bool hadPendingRequest = _hasPendingRequest;
+    _hasPendingRequest = false;
+
+    return hadPendingRequest;
 }
 
+utils::CancellationToken HsneScaleUpdateWorker::takeRequest()
+{
+    std::lock_guard<std::mutex> lock(_requestMutex);
+
+    if (_hasPendingRequest)
+    {
+        _embedding = _pendingRequest.embedding;
+        _roi = _pendingRequest.roi;
+        _imageIndices = _pendingRequest.imageIndices;
+        _idMap = _pendingRequest.idMap;
+        _fixScale = _pendingRequest.fixScale;
+        _tresh_influence = _pendingRequest.tresh_influence;
+        _landmarkFilterNumber = _pendingRequest.landmarkFilterNumber;
+        _visualBudget = _pendingRequest.visualBudget;
+        _embScalingFactors = _pendingRequest.embScalingFactors;
+        _currentEmbExtends = _pendingRequest.currentEmbExtends;
+        _mappingBottomToLocal = _pendingRequest.mappingBottomToLocal;
+        _mappingLocalToBottom = _pendingRequest.mappingLocalToBottom;
+        _traversalDirection = _pendingRequest.direction;
+        _initEmbedding = _pendingRequest.initEmbedding;
+        _newTransitionMatrix = _pendingRequest.transitionMatrix;
+
+        _hasPendingRequest = false;
+    }
+
+    return utils::CancellationToken(_requestGeneration);
+}
 
 void HsneScaleUpdateWorker::updateScale()
 {
     Log::info("HsneScaleUpdateWorker::updateScale()");
     utils::ScopedTimer updateScaleTimer("Total scale update");
 
+    // the user waits for this, take precedence over background work
+    utils::ScopedTaskPriority taskPriority(utils::TaskPriority::Interactive);
+
+    // Latest wins: a new request cancels the update at its next stage, then the newest request is computed
+    while (!computeScaleUpdate(takeRequest()))
+        Log::info("HsneScaleUpdateWorker::updateScale: cancelled by a newer request");
+
+    emit finished(true);
+}
+
+bool HsneScaleUpdateWorker::computeScaleUpdate(const utils::CancellationToken& cancellation)
+{
+    // All results are computed into local variables and only committed after the last stage,
+    // such that a cancelled update does not change the current embedding, ID map and selection maps
+
+    // Landmarks, transition matrix and selection maps of the viewport, possibly cached or prefetched.
+    // Updates that traverse the hierarchy manually depend on the current scale and are not cached
+    const ScaleUpdateKey key(_roi, _currentScaleLevel, _fixScale, _tresh_influence, _visualBudget, _landmarkFilterNumber);
+    const bool cacheable = _traversalDirection == utils::TraversalDirection::AUTO;
+    ViewportScaleUpdate viewportUpdate;
+    std::vector<float> cachedEmbedding;
+    bool isCached = false;
+
+    if (cacheable && findCached(key, viewportUpdate, cachedEmbedding))
+    {
+        Log::info(std::string("HsneScaleUpdateWorker::updateScale: use cached landmarks and transition matrix") + (cachedEmbedding.empty() ? "" : " and restore the cached embedding"));
+        isCached = true;
+    }
+    else if (cacheable && takePrefetched(key, viewportUpdate))
+        Log::info("HsneScaleUpdateWorker::updateScale: use prefetched landmarks and transition matrix");
+    else if (!computeViewportStages(key, _traversalDirection, *_imageIndices, cancellation, viewportUpdate))
+        return false;
+
+    if (cancellation.isCancelled())
+        return false;
+
+    const bool restoreEmbedding = !cachedEmbedding.empty();
+    std::vector<float> initEmbedding;
+    std::vector<utils::POINTINITTYPE> initTypes;
+    std::vector<uint32_t> previousIndices;
+
+    if (restoreEmbedding)
+    {
+        // A revisited viewport shows the layout it had before, it is not related to the current embedding
+        initEmbedding = std::move(cachedEmbedding);
+        initTypes.assign(viewportUpdate.localIDsOnNewScale.size(), utils::POINTINITTYPE::previousPos);
+        previousIndices.assign(viewportUpdate.localIDsOnNewScale.size(), std::numeric_limits<uint32_t>::max());
+    }
+    else
+    {
+        // Rescale embedding every update
+        std::vector<mv::Vector2f> embPosRescaled;
+        utils::EmbeddingExtends embExtendsRescaled;
+        utils::timer([&]() {
+            utils::rescaleEmbedding(_embedding, _embScalingFactors, _currentEmbExtends, embPosRescaled, embExtendsRescaled);
+            },
+            "rescaleEmbedding");
+
+        // Use previous embedding as init of new embedding
+        utils::timer([&]() {
+            utils::reinitializeEmbedding(_hsneHierarchy, embPosRescaled, *_idMap, embExtendsRescaled, viewportUpdate.scaleLevel, viewportUpdate.localIDsOnNewScale, initEmbedding, initTypes, previousIndices);
+            },
+            "reinitializeEmbedding");
+    }
+
+    // last chance to cancel, a request after this point is dropped, see discardPendingRequest()
+    if (cancellation.isCancelled())
+        return false;
+
+    // Cache the results, their embedding is added once it was shown, see cacheEmbedding()
+    {
+        std::lock_guard<std::mutex> lock(_cacheMutex);
+
+        if (cacheable && !isCached)
+            _cache.insert(key, { viewportUpdate, {} });
+
+        _lastKey = key;
+        _lastUpdateCached = cacheable;
+    }
+
+    // Commit the results
+    _restoredEmbedding = restoreEmbedding;
+    _newScaleLevel = viewportUpdate.scaleLevel;
+    _localIDsOnNewScale = std::move(viewportUpdate.localIDsOnNewScale);
+    _IdRoiRepresentation = std::move(viewportUpdate.idRoiRepresentation);
+    _initTypes = std::move(initTypes);
+    _previousIndices = std::move(previousIndices);
+    *_newTransitionMatrix = std::move(viewportUpdate.transitionMatrix);
+    *_initEmbedding = std::move(initEmbedding);
+    *_idMap = std::move(viewportUpdate.idMap);
+    *_mappingBottomToLocal = std::move(viewportUpdate.mappingBottomToLocal);
+    *_mappingLocalToBottom = std::move(viewportUpdate.mappingLocalToBottom);
+
+    emit scaleLevelComputed(_newScaleLevel);
+
+    Log::info("#corresponding landmarks at current scale: " + std::to_string(_localIDsOnNewScale.size()));
+    Log::info("Refining embedding...");
+
+    _currentScaleLevel = _newScaleLevel;
+
+    return true;
+}
+
+bool HsneScaleUpdateWorker::computeViewportStages(const ScaleUpdateKey& key, const utils::TraversalDirection direction, const Eigen::MatrixXui& imageIndices,
+    const utils::CancellationToken& cancellation, ViewportScaleUpdate& viewportUpdate) const
+{
+    const utils::ROI roi = key.roi();
+    viewportUpdate.key = key;
+
     // Get selecion IDs in current viewport on the image
     std::vector<uint32_t> imageSelectionIDs;
     utils::timer([&]() {
-        utils::extractIdBlock(_roi->layerBottomLeft, _roi->layerTopRight, *_imageIndices, imageSelectionIDs);
+        utils::extractIdBlock(roi.layerBottomLeft, roi.layerTopRight, imageIndices, imageSelectionIDs);
         },
         "selecion IDs in current viewport");
 
-    if (_traversalDirection == utils::TraversalDirection::AUTO)
+    if (cancellation.isCancelled())
+        return false;
+
+    uint32_t& newScaleLevel = viewportUpdate.scaleLevel;
+    std::vector<uint32_t>& localIDsOnNewScale = viewportUpdate.localIDsOnNewScale;
+    if (direction == utils::TraversalDirection::AUTO)
     {
         // Local indices on scale: Go up from bottom (image ID selection) to refinedScaleLevel or stay on fixed scale (if set in UI)
         utils::timer([&]() {
-            if (_fixScale)
+            if (key.fixScale)
             {
-                _newScaleLevel = _currentScaleLevel;
+                newScaleLevel = key.startScaleLevel;
 
-                if (_tresh_influence == -1.0f)
-                    utils::computeLocalIDsOnCoarserScaleHeuristic(_newScaleLevel, imageSelectionIDs, _hsneHierarchy, _localIDsOnNewScale);
+                if (key.tresh_influence == -1.0f)
+                    utils::computeLocalIDsOnCoarserScaleHeuristic(newScaleLevel, imageSelectionIDs, _hsneHierarchy, localIDsOnNewScale);
                 else
-                    utils::computeLocalIDsOnCoarserScale(_currentScaleLevel, imageSelectionIDs, _hsneHierarchy, _tresh_influence, _localIDsOnNewScale);
+                    utils::computeLocalIDsOnCoarserScale(key.startScaleLevel, imageSelectionIDs, _hsneHierarchy, key.tresh_influence, localIDsOnNewScale);
             }
             else
             {
-                _newScaleLevel = 0;
-                utils::localIDsOnCoarserScale(utils::VisualTarget(_visualBudget), imageSelectionIDs, _hsneHierarchy, _tresh_influence, _newScaleLevel, _localIDsOnNewScale);
+                newScaleLevel = 0;
+                utils::localIDsOnCoarserScale(utils::VisualTarget(key.visualTarget, key.visualTargetHeuristic), imageSelectionIDs, _hsneHierarchy, key.tresh_influence, newScaleLevel, localIDsOnNewScale);
             }
             },
             "computeLocalIDs");
@@ -92,64 +312,195 @@ void HsneScaleUpdateWorker::updateScale()
     else
     {
         utils::timer([&]() {
-            _newScaleLevel = _currentScaleLevel;
-            utils::applyTraversalDirection(_traversalDirection, _newScaleLevel);
-            utils::computeLocalIDsOnCoarserScaleHeuristic(_newScaleLevel, imageSelectionIDs, _hsneHierarchy, _localIDsOnNewScale);
+            newScaleLevel = _currentScaleLevel;
+            utils::applyTraversalDirection(direction, newScaleLevel);
+            utils::computeLocalIDsOnCoarserScaleHeuristic(newScaleLevel, imageSelectionIDs, _hsneHierarchy, localIDsOnNewScale);
             },
             "computeLocalIDsOnCoarserScaleHeuristic");
     }
 
-    emit scaleLevelComputed(_newScaleLevel);
+    if (cancellation.isCancelled())
+        return false;
 
-    Log::info("HsneScaleUpdateWorker::updateScale: " + std::to_string(_localIDsOnNewScale.size()) + " landmarks on scale " + std::to_string(_newScaleLevel) +
+    Log::info("HsneScaleUpdateWorker::updateScale: " + std::to_string(localIDsOnNewScale.size()) + " landmarks on scale " + std::to_string(newScaleLevel) +
         " (previously scale " + std::to_string(_currentScaleLevel) + ") for " + std::to_string(imageSelectionIDs.size()) + " data points in view");
 
 
     // Compute the transition matrix for the landmarks above the threshold
     utils::timer([&]() {
-            _hsneHierarchy.getTransitionMatrixForSelectionAtScale(_newScaleLevel, _landmarkFilterNumber, _localIDsOnNewScale, *_newTransitionMatrix);
+            _hsneHierarchy.getTransitionMatrixForSelectionAtScale(newScaleLevel, key.landmarkFilterNumber, localIDsOnNewScale, viewportUpdate.transitionMatrix);
         },
         "getTransitionMatrixForSelectionAtScale");
 
+    if (cancellation.isCancelled())
+        return false;
+
     // Compute landmarkRoiRepresentation: To what extend do the landmarks represent data points that are in roi vs outside
     utils::timer([&]() {
-        utils::landmarkRoiRepresentation(_imgSize, *_roi, _hsneHierarchy, _newScaleLevel, _localIDsOnNewScale, _IdRoiRepresentation);
+        utils::landmarkRoiRepresentation(_imgSize, roi, _hsneHierarchy, newScaleLevel, localIDsOnNewScale, viewportUpdate.idRoiRepresentation);
         },
         "landmarkRoiRepresentation");
 
-    // Rescale embedding every update
-    std::vector<mv::Vector2f> embPosRescaled;
-    utils::EmbeddingExtends embExtendsRescaled;
-    utils::timer([&]() {
-        utils::rescaleEmbedding(_embedding, _embScalingFactors, _currentEmbExtends, embPosRescaled, embExtendsRescaled);
-        },
-        "rescaleEmbedding");
-
-    // Use previous embedding as init of new embedding
-    utils::timer([&]() {
-        utils::reinitializeEmbedding(_hsneHierarchy, embPosRescaled, *_idMap, embExtendsRescaled, _newScaleLevel, _localIDsOnNewScale, *_initEmbedding, _initTypes);
-        },
-        "reinitializeEmbedding");
+    if (cancellation.isCancelled())
+        return false;
 
     // new ID mapping 
     utils::timer([&]() {
-        utils::recomputeIDMap(_hsneHierarchy.getScale(_newScaleLevel), _localIDsOnNewScale, *_idMap);
+        utils::recomputeIDMap(_hsneHierarchy.getScale(newScaleLevel), localIDsOnNewScale, viewportUpdate.idMap);
         },
         "new ID mapping");
 
     // selection map at scale based on ID mapping
     utils::timer([&]() {
-        _hsneHierarchy.computeSelectionMapsAtScale(_newScaleLevel, _localIDsOnNewScale, *_mappingBottomToLocal, *_mappingLocalToBottom);
+        _hsneHierarchy.computeSelectionMapsAtScale(newScaleLevel, localIDsOnNewScale, viewportUpdate.mappingBottomToLocal, viewportUpdate.mappingLocalToBottom);
         },
         "selection map at scale based on ID mapping");
 
-    Log::info("#selected image indices: " + std::to_string(imageSelectionIDs.size()));
-    Log::info("#corresponding landmarks at current scale: " + std::to_string(_localIDsOnNewScale.size()));
-    Log::info("Refining embedding...");
+    return !cancellation.isCancelled();
+}
 
-    _currentScaleLevel = _newScaleLevel;
+bool HsneScaleUpdateWorker::findCached(const ScaleUpdateKey& key, ViewportScaleUpdate& viewportUpdate, std::vector<float>& embedding)
+{
+    std::lock_guard<std::mutex> lock(_cacheMutex);
 
-    emit finished(true);
+    const CachedScaleUpdate* cached = _cache.find(key);
+
+    if (cached == nullptr)
+        return false;
+
+    viewportUpdate = cached->viewportUpdate;
+    embedding = cached->embedding;
+
+    return true;
+}
+
+void HsneScaleUpdateWorker::cacheEmbedding(const Dataset<Points>& embedding)
+{
+    std::vector<mv::Vector2f> positions;
+    embedding->extractDataForDimensions(positions, 0, 1);
+
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+
+    if (!_lastUpdateCached)
+        return;
+
+    _cache.modify(_lastKey, [&positions](CachedScaleUpdate& cached) {
+        // e.g. the gradient descent of the last update did not show its points yet
+        if (positions.size() != cached.viewportUpdate.localIDsOnNewScale.size())
+            return;
+
+        cached.embedding.resize(2 * positions.size());
+        for (size_t i = 0; i < positions.size(); i++)
+        {
+            cached.embedding[2 * i] = positions[i].x;
+            cached.embedding[2 * i + 1] = positions[i].y;
+        }
+        });
+}
+
+void HsneScaleUpdateWorker::setCacheSize(size_t numBytes)
+{
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    _cache.setMaxBytes(numBytes);
+}
+
+void HsneScaleUpdateWorker::clearCache()
+{
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    _cache.clear();
+    _lastUpdateCached = false;
+}
+
+bool HsneScaleUpdateWorker::takePrefetched(const ScaleUpdateKey& key, ViewportScaleUpdate& viewportUpdate)
+{
+    auto prefetched = std::find_if(_prefetched.begin(), _prefetched.end(), [&key](const ViewportScaleUpdate& entry) { return entry.key == key; });
+
+    if (prefetched == _prefetched.end())
+        return false;
+
+    viewportUpdate = std::move(*prefetched);
+    _prefetched.erase(prefetched);
+
+    return true;
+}
+
+void HsneScaleUpdateWorker::setPrefetchData(const std::vector<utils::ROI>& rois, const Eigen::MatrixXui& imageIndices, const bool fixScale, const float tresh_influence,
+    const utils::VisualBudgetRange visualBudget, uint32_t landmarkFilterNumber)
+{
+    std::lock_guard<std::mutex> lock(_requestMutex);
+
+    _pendingPrefetch = { rois, &imageIndices, fixScale, tresh_influence, visualBudget, landmarkFilterNumber };
+    _hasPendingPrefetch = true;
+
+    // cancels the running prefetch
+    ++_prefetchGeneration;
+}
+
+void HsneScaleUpdateWorker::prefetchScale()
+{
+    ScalePrefetchRequest prefetchRequest;
+    utils::CancellationToken cancellation;
+    {
+        std::lock_guard<std::mutex> lock(_requestMutex);
+
+        // already taken by an earlier call or an update is about to start
+        if (!_hasPendingPrefetch || _hasPendingRequest)
+            return;
+
+        prefetchRequest = std::move(_pendingPrefetch);
+        _hasPendingPrefetch = false;
+        cancellation = utils::CancellationToken(_prefetchGeneration);
+    }
+
+    // the user does not wait for this, yield to interactive work
+    utils::ScopedTaskPriority taskPriority(utils::TaskPriority::Background);
+
+    std::vector<ScaleUpdateKey> keys;
+    for (const auto& roi : prefetchRequest.rois)
+        keys.emplace_back(roi, _currentScaleLevel, prefetchRequest.fixScale, prefetchRequest.tresh_influence, prefetchRequest.visualBudget, prefetchRequest.landmarkFilterNumber);
+
+    // Only keep the results of the current predictions, which bounds the memory
+    std::erase_if(_prefetched, [&keys](const ViewportScaleUpdate& entry) { return std::find(keys.begin(), keys.end(), entry.key) == keys.end(); });
+
+    for (const auto& key : keys)
+    {
+        if (std::any_of(_prefetched.begin(), _prefetched.end(), [&key](const ViewportScaleUpdate& entry) { return entry.key == key; }))
+            continue;
+
+        {
+            std::lock_guard<std::mutex> lock(_cacheMutex);
+            if (_cache.contains(key))
+                continue;
+        }
+
+        // A request waits for this thread, setData() only lets the prefetch of its own viewport finish
+        {
+            std::lock_guard<std::mutex> lock(_requestMutex);
+            if (_hasPendingRequest)
+                return;
+
+            _prefetchKey = key;
+            _isPrefetching = true;
+        }
+
+        ViewportScaleUpdate viewportUpdate;
+        const bool computed = computeViewportStages(key, utils::TraversalDirection::AUTO, *prefetchRequest.imageIndices, cancellation, viewportUpdate);
+
+        {
+            std::lock_guard<std::mutex> lock(_requestMutex);
+            _isPrefetching = false;
+        }
+
+        if (!computed)
+        {
+            Log::debug("HsneScaleUpdateWorker::prefetchScale: cancelled");
+            return;
+        }
+
+        _prefetched.push_back(std::move(viewportUpdate));
+    }
+
+    Log::debug(fmt::format("HsneScaleUpdateWorker::prefetchScale: {} viewports prefetched", _prefetched.size()));
 }
 
 HsneScaleUpdateWorker::~HsneScaleUpdateWorker() {
@@ -199,7 +550,8 @@ std::vector<float> HsneScaleUpdateWorker::getInitTypesAsFloats() const
 HsneScaleUpdate::HsneScaleUpdate(const HsneHierarchy& hsneHierarchy) :
     _workerThread(),
     _hsneScaleWorker(nullptr),
-    _isRunning(false)
+    _isRunning(false),
+    _hasDeferredRequest(false)
 {
 
     _hsneScaleWorker = new HsneScaleUpdateWorker(hsneHierarchy);
@@ -207,11 +559,15 @@ HsneScaleUpdate::HsneScaleUpdate(const HsneHierarchy& hsneHierarchy) :
 
     // To-Worker signals
     connect(this, &HsneScaleUpdate::startWorker, _hsneScaleWorker, &HsneScaleUpdateWorker::updateScale);
+    connect(this, &HsneScaleUpdate::startPrefetch, _hsneScaleWorker, &HsneScaleUpdateWorker::prefetchScale);
 
     // From-Worker signals
     connect(_hsneScaleWorker, &HsneScaleUpdateWorker::started, this, [this]() { _isRunning = true; });
     connect(_hsneScaleWorker, &HsneScaleUpdateWorker::finished, this, [this](bool success) { 
         _isRunning = false;
+
+        // the embedding must show the points of this update before the next one reads it
+        _hasDeferredRequest = _hsneScaleWorker->discardPendingRequest();
         emit finished(success);
     });
 
@@ -233,6 +589,24 @@ void HsneScaleUpdate::startComputation(Dataset<Points> embedding, const utils::R
 {
     _hsneScaleWorker->setData(embedding, roi, imageIndices, idMap, fixScale, tresh_influence, visualBudgetRange, embScalingFactors, currentEmbExtends, 
         landmarkFilterNumber, direction, mappingBottomToLocal, mappingLocalToBottom, initEmbedding, transitionMatrix);
+
+    // a running update is cancelled by the new data and continues with it
+    if (_isRunning)
+        return;
+
+    _isRunning = true;
+    _hasDeferredRequest = false;
     emit startWorker();
 }
 
+
+void HsneScaleUpdate::prefetch(const std::vector<utils::ROI>& rois, const Eigen::MatrixXui& imageIndices, const bool fixScale, const float tresh_influence,
+    const utils::VisualBudgetRange visualBudget, uint32_t landmarkFilterNumber)
+{
+    // a prefetch would only delay the running update
+    if (_isRunning || rois.empty())
+        return;
+
+    _hsneScaleWorker->setPrefetchData(rois, imageIndices, fixScale, tresh_influence, visualBudget, landmarkFilterNumber);
+    emit startPrefetch();
+}
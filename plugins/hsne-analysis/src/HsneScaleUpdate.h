@@ -4,14 +4,107 @@
 #include "CommonTypes.h"
 #include "Utils.h"
 #include "UtilsScale.h"
+#include "LruCache.h"
 
 #include <QThread>
 #include <QPointer>
 
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
 using namespace mv;
 
 class HsneHierarchy;
 
+/**
+ * Inputs of a scale update, copied such that the viewport can change while an update is computed
+ */
+struct ScaleUpdateRequest
+{
+    Dataset<Points>                 embedding;
+    utils::ROI                      roi;
+    const Eigen::MatrixXui*         imageIndices = nullptr;
+    IDMapping*                      idMap = nullptr;
+    bool                            fixScale = false;
+    float                           tresh_influence = -1.0f;
+    utils::VisualBudgetRange        visualBudget;
+    std::pair<float, float>         embScalingFactors;
+    utils::EmbeddingExtends         currentEmbExtends;
+    uint32_t                        landmarkFilterNumber = 0;
+    utils::TraversalDirection       direction = utils::TraversalDirection::AUTO;
+    LandmarkMapSingle*              mappingBottomToLocal = nullptr;
+    LandmarkMap*                    mappingLocalToBottom = nullptr;
+    std::vector<float>*             initEmbedding = nullptr;
+    HsneMatrix*                     transitionMatrix = nullptr;
+};
+
+/**
+ * Viewports whose update stages are prepared before they are requested, see HsneScaleUpdateWorker::prefetchScale
+ */
+struct ScalePrefetchRequest
+{
+    std::vector<utils::ROI>         rois;
+    const Eigen::MatrixXui*         imageIndices = nullptr;
+    bool                            fixScale = false;
+    float                           tresh_influence = -1.0f;
+    utils::VisualBudgetRange        visualBudget;
+    uint32_t                        landmarkFilterNumber = 0;
+};
+
+/**
+ * Identifies the results of the viewport dependent update stages: the integer layer ROI and the settings they depend on
+ */
+struct ScaleUpdateKey
+{
+    ScaleUpdateKey() = default;
+    ScaleUpdateKey(const utils::ROI& roi, const uint32_t currentScaleLevel, const bool fixScale, const float tresh_influence, const utils::VisualBudgetRange& visualBudget, const uint32_t landmarkFilterNumber);
+
+    /** Layer ROI with the integer corners of this key */
+    utils::ROI roi() const;
+
+    friend bool operator==(const ScaleUpdateKey& lhs, const ScaleUpdateKey& rhs) = default;
+
+    int32_t                         bottomLeftX = 0;
+    int32_t                         bottomLeftY = 0;
+    int32_t                         topRightX = 0;
+    int32_t                         topRightY = 0;
+    uint32_t                        startScaleLevel = 0;    /** Scale level the landmarks are searched on with a fixed scale, 0 otherwise */
+    bool                            fixScale = false;
+    float                           tresh_influence = -1.0f;
+    size_t                          visualTarget = 0;
+    bool                            visualTargetHeuristic = false;
+    uint32_t                        landmarkFilterNumber = 0;
+};
+
+/**
+ * Results of the update stages that only depend on the viewport and not on the current embedding
+ */
+struct ViewportScaleUpdate
+{
+    ScaleUpdateKey                  key;
+    uint32_t                        scaleLevel = 0;
+    std::vector<uint32_t>           localIDsOnNewScale;
+    HsneMatrix                      transitionMatrix;
+    std::vector<std::pair<float, std::vector<uint32_t>>> idRoiRepresentation;
+    IDMapping                       idMap;
+    LandmarkMapSingle               mappingBottomToLocal;
+    LandmarkMap                     mappingLocalToBottom;
+};
+
+/**
+ * Cached results of an update and the embedding that was last shown for them
+ */
+struct CachedScaleUpdate
+{
+    ViewportScaleUpdate             viewportUpdate;
+    std::vector<float>              embedding;              /** Empty until the embedding of the update was shown, see HsneScaleUpdateWorker::cacheEmbedding */
+
+    /** Estimated memory in bytes */
+    size_t numBytes() const;
+};
+
 /**
  * HSNE interactive scale worker class
  *
@@ -28,6 +121,8 @@ public:
 
     // Setter
 
+    /** Store the inputs of the next update. A running update is cancelled at its next stage and continues with these.
+     *  A running prefetch of the same viewport finishes and hands its result over, other prefetches are cancelled. Thread-safe */
     void setData(Dataset<Points> embedding, const utils::ROI& roi, const Eigen::MatrixXui& imageIndices, IDMapping& idMap, const bool fixScale,
         const float tresh_influence, const utils::VisualBudgetRange visualBudget, const std::pair<float, float> embScalingFactors, const utils::EmbeddingExtends currentEmbExtends,
         uint32_t landmarkFilterNumber, const utils::TraversalDirection direction, LandmarkMapSingle& mappingBottomToLocal, LandmarkMap& mappingLocalToBottom,
@@ -47,23 +142,81 @@ public:
     std::vector<float> getRoiRepresentationFractions() const;
     std::vector<float> getNumberTransitions() const;
     std::vector<float> getInitTypesAsFloats() const;
+    utils::InitTypeFractions getInitTypeFractions() const { return utils::computeInitTypeFractions(_initTypes); }
+    std::vector<uint32_t> getPreviousIndices() const { return _previousIndices; }
     uint32_t getCurrentScaleLevel() const { return _currentScaleLevel; }
 
+    /** Drop a request that arrived after the last update could not be cancelled anymore, returns whether there was one. Thread-safe */
+    bool discardPendingRequest();
+
+    /** Store the embedding shown for the last update with its cached results, revisiting the viewport then restores this layout. Thread-safe */
+    void cacheEmbedding(const Dataset<Points>& embedding);
+
+    /** Memory bound of the cache of earlier updates in bytes, 0 disables it. Thread-safe */
+    void setCacheSize(size_t numBytes);
+
+    void clearCache();
+
+    /** Whether the last update restored the cached layout of a revisited viewport, its init embedding is the final layout */
+    bool isRestoredEmbedding() const { return _restoredEmbedding; }
+
+    /** Store viewports that are likely requested next, cancels a running prefetch. Must not be called while an update is running. Thread-safe */
+    void setPrefetchData(const std::vector<utils::ROI>& rois, const Eigen::MatrixXui& imageIndices, const bool fixScale, const float tresh_influence,
+        const utils::VisualBudgetRange visualBudget, uint32_t landmarkFilterNumber);
+
 public slots:
     /** Update the landmarks in the embedding based on the current viewport selection in the image */
     void updateScale();
 
+    /** Compute the viewport dependent stages of the prefetch viewports at background priority, updateScale uses them when one of the viewports is requested */
+    void prefetchScale();
+
 signals:
     void started();
     void finished(bool success);
     void scaleLevelComputed(uint32_t);
 
 private:
+    /** Copy the latest request into the members, the returned token is cancelled by the next request */
+    utils::CancellationToken takeRequest();
+
+    /** Compute all stages of an update, the results are only committed if it is not cancelled before the last stage */
+    bool computeScaleUpdate(const utils::CancellationToken& cancellation);
+
+    /** Landmarks, transition matrix, ROI representation, ID map and selection maps for a viewport, returns false if cancelled */
+    bool computeViewportStages(const ScaleUpdateKey& key, const utils::TraversalDirection direction, const Eigen::MatrixXui& imageIndices,
+        const utils::CancellationToken& cancellation, ViewportScaleUpdate& viewportUpdate) const;
+
+    /** Move a prefetched result for key into viewportUpdate, returns whether there was one */
+    bool takePrefetched(const ScaleUpdateKey& key, ViewportScaleUpdate& viewportUpdate);
+
+    /** Copy a cached result for key into viewportUpdate and its last shown embedding, which might be empty. Returns whether there was one */
+    bool findCached(const ScaleUpdateKey& key, ViewportScaleUpdate& viewportUpdate, std::vector<float>& embedding);
+
+private:
+    ScaleUpdateRequest              _pendingRequest;        /** Latest request, not yet taken by updateScale */
+    bool                            _hasPendingRequest;
+    ScalePrefetchRequest            _pendingPrefetch;       /** Latest prefetch viewports, not yet taken by prefetchScale */
+    bool                            _hasPendingPrefetch;
+    std::mutex                      _requestMutex;
+    std::atomic<uint64_t>           _requestGeneration;     /** Incremented by every request, cancels the running update */
+    std::atomic<uint64_t>           _prefetchGeneration;    /** Incremented by new prefetch viewports and by requests for other viewports, cancels the running prefetch */
+    ScaleUpdateKey                  _prefetchKey;           /** Viewport the running prefetch computes */
+    bool                            _isPrefetching;
+
+    std::deque<ViewportScaleUpdate> _prefetched;            /** Results of prefetchScale, at most one per prefetch viewport. Only accessed in the worker thread */
+
+    utils::LruCache<ScaleUpdateKey, CachedScaleUpdate> _cache;  /** Results of earlier updates and their last shown embeddings */
+    mutable std::mutex              _cacheMutex;
+    ScaleUpdateKey                  _lastKey;               /** Cache key of the last update */
+    bool                            _lastUpdateCached;      /** Whether the last update is in the cache, updates that traverse the hierarchy manually are not */
+    bool                            _restoredEmbedding;
+
     Dataset<Points>                 _embedding;
     QSize                           _imgSize;
 
     const HsneHierarchy&            _hsneHierarchy;
-    const utils::ROI*               _roi;
+    utils::ROI                      _roi;
     const Eigen::MatrixXui*         _imageIndices;
     float                           _tresh_influence;       // could be used in computeLocalIDsOnCoarserScale
 
@@ -89,6 +242,7 @@ private:
 
     std::vector<float>*             _initEmbedding;
     std::vector<utils::POINTINITTYPE>_initTypes;           /** init type of embedding points */
+    std::vector<uint32_t>           _previousIndices;       /** position of reused embedding points in the previous embedding */
 };
 
 
@@ -116,14 +270,30 @@ public:
     // Getter
     std::vector<uint32_t> getLocalIDsOnNewScale() const { return _hsneScaleWorker->getLocalIDsOnNewScale();}
     std::vector<float> getInitTypes() const { return _hsneScaleWorker->getInitTypesAsFloats(); }    // transforms utils::POINTINITTYPE to float
+    utils::InitTypeFractions getInitTypeFractions() const { return _hsneScaleWorker->getInitTypeFractions(); }
+    std::vector<uint32_t> getPreviousIndices() const { return _hsneScaleWorker->getPreviousIndices(); }
     std::vector<float> getRoiRepresentationFractions() const { return _hsneScaleWorker->getRoiRepresentationFractions(); }
     std::vector<float> getNumberTransitions() const { return _hsneScaleWorker->getNumberTransitions(); }
     
     bool isRunning() const { return _isRunning; }
 
+    /** See HsneScaleUpdateWorker::cacheEmbedding */
+    void cacheEmbedding(const Dataset<Points>& embedding) { _hsneScaleWorker->cacheEmbedding(embedding); }
+    void setCacheSize(size_t numBytes) { _hsneScaleWorker->setCacheSize(numBytes); }
+    void clearCache() { _hsneScaleWorker->clearCache(); }
+    bool isRestoredEmbedding() const { return _hsneScaleWorker->isRestoredEmbedding(); }
+
+    /** Prepare the landmarks of likely next viewports in the background while no update is running, see HsneScaleUpdateWorker::prefetchScale */
+    void prefetch(const std::vector<utils::ROI>& rois, const Eigen::MatrixXui& imageIndices, const bool fixScale, const float tresh_influence,
+        const utils::VisualBudgetRange visualBudget, uint32_t landmarkFilterNumber);
+
+    /** A request arrived after the last finished update could not be cancelled anymore and was dropped, it should be repeated once the update is shown */
+    bool hasDeferredRequest() const { return _hasDeferredRequest; }
+
 signals:
     // Local signals
     void startWorker();
+    void startPrefetch();
     void stopWorker();
 
     // Outgoing signals
@@ -134,5 +304,6 @@ private:
     QThread                         _workerThread;
     QPointer<HsneScaleUpdateWorker> _hsneScaleWorker;
     bool                            _isRunning;
+    bool                            _hasDeferredRequest;
 
 };
@@ -366,10 +366,14 @@ void InteractiveHsnePlugin::init()
         // Update the color map data set when ROI t-SNE is finished
         connect(&_tsneROIAnalysis, &TsneAnalysis::finished, this, &InteractiveHsnePlugin::setColorMapDataRoitSNE);
 
-        // Update the color map every 100 iterations
-        connect(&_tsneROIAnalysis, &TsneAnalysis::embeddingUpdate, this, [this](const std::vector<float>& emb, const uint32_t& numPoints, const uint32_t& numDimensions){
-            if (_tsneROIAnalysis.getNumIterations() % 100 == 0)
+        // Update the color map every 100 iterations, updates arrive time-based and skip iterations
+        connect(&_tsneROIAnalysis, &TsneAnalysis::embeddingUpdate, this, [this, colorMapStep = 0u](const std::vector<float>& emb, const uint32_t& numPoints, const uint32_t& numDimensions) mutable {
+            const uint32_t step = _tsneROIAnalysis.getNumIterations() / 100;
+            if (step != colorMapStep)
+            {
+                colorMapStep = step;
                 setColorMapDataRoitSNE();
+            }
             });
 
         connectMetaTsne(_tsneROIAnalysis, _tSNEofROI);
@@ -417,7 +421,12 @@ void InteractiveHsnePlugin::init()
     }
 
     // add ROI to sequence view when update is performed
-    connect(&hsneScaleAction, &HsneScaleAction::setRoiInSequenceView, &viewportAction, &ViewportSequence::appendROI);
+    connect(&hsneScaleAction, &HsneScaleAction::setRoiInSequenceView, this, [&hsneScaleAction, &viewportAction](const utils::ROI& roi) {
+        viewportAction.appendROI(roi);
+
+        // stepping back and forth in the sequence is likely, prefetch the neighbouring viewports
+        hsneScaleAction.setSequenceViewports(viewportAction.getNeighbouringROIs());
+        });
 
     // connect mean-shift analysis of top level embedding
     connect(&_hsneSettingsAction->getMeanShiftActionAction().getUseClusterColorsAction(), &ToggleAction::toggled, this, &InteractiveHsnePlugin::setColorMapDataTopLevelEmb);
@@ -427,9 +436,8 @@ void InteractiveHsnePlugin::init()
     connect(&hsneScaleAction.getColorMapFirstEmbAction(), &ColorMapAction::imageChanged, this, [this](const QImage& image) {setColorMapDataTopLevelEmb(); });
 
     // make sure that the viewport updates correctly after setting no update in UI, moving backwards, setting do update in UI again and then navigating in the image 
-    connect(&hsneScaleAction, &HsneScaleAction::noUpdate, this, [&viewportAction](const NoUpdate& reason) {
-        if (reason == NoUpdate::SEITINUI || reason == NoUpdate::ROINOTGOODFORUPDATE)
-            viewportAction.setLockedAddRoi(false);
+    connect(&hsneScaleAction, &HsneScaleAction::noUpdate, this, [&viewportAction](const NoUpdate&) {
+        viewportAction.setLockedAddRoi(false);
         });
 
     // Connect viewport update signal from image viewer (if connected)
@@ -531,8 +539,8 @@ void InteractiveHsnePlugin::selectionMapping(const mv::Dataset<Points> selection
         selectionIndices.insert(selectionIndices.end(), selectionMap[selectionIndex].begin(), selectionMap[selectionIndex].end());
     }
 
-    std::sort(utils::exec_policy, selectionIndices.begin(), selectionIndices.end());
-    auto last = std::unique(utils::exec_policy, selectionIndices.begin(), selectionIndices.end());
+    utils::parallel_sort(selectionIndices.begin(), selectionIndices.end());
+    auto last = std::unique(selectionIndices.begin(), selectionIndices.end());
     selectionIndices.erase(last, selectionIndices.end());
 
     Log::trace("Publish selection");
@@ -567,14 +575,14 @@ void InteractiveHsnePlugin::selectionMapping(const mv::Dataset<Points> selection
     // For all selected indices in the embedding, look up to which bottom level IDs they correspond
     for (const auto selectionIndex : selectionInput->indices)
     {
-        if (selectionMap[selectionIndex] == std::numeric_limits<uint32_t>::max())
+        if (selectionMap[selectionIndex] == NO_LANDMARK)
             continue;
 
         selectionIndices.insert(selectionIndices.end(), selectionMap[selectionIndex]);
     }
 
-    std::sort(utils::exec_policy, selectionIndices.begin(), selectionIndices.end());
-    auto last = std::unique(utils::exec_policy, selectionIndices.begin(), selectionIndices.end());
+    utils::parallel_sort(selectionIndices.begin(), selectionIndices.end());
+    auto last = std::unique(selectionIndices.begin(), selectionIndices.end());
     selectionIndices.erase(last, selectionIndices.end());
 
     Log::trace("Publish selection");
@@ -772,10 +780,11 @@ void InteractiveHsnePlugin::continueComputation()
 void InteractiveHsnePlugin::stopComputation()
 {
     Log::info("InteractiveHsnePlugin::stopComputation");
-    auto& tsneAnalysis = _hsneSettingsAction->getInteractiveScaleAction().getTsneAnalysis();
+    auto& scaleAction = _hsneSettingsAction->getInteractiveScaleAction();
 
-    if (tsneAnalysis.threadIsRunning())
-        tsneAnalysis.stopComputation();
+    // the scale action resolves a scale update that the stopped gradient descent did not show yet
+    if (scaleAction.getTsneAnalysis().threadIsRunning())
+        scaleAction.stoptSNEAnalysis();
 
     if (_tsneROIAnalysis.threadIsRunning())
         _tsneROIAnalysis.stopComputation();
@@ -811,10 +820,8 @@ void InteractiveHsnePlugin::computeTSNEforROI()
     // prepare selection mapping
     _tSNEofROI->selectNone();
     events().notifyDatasetDataSelectionChanged(_tSNEofROI);
-    _mappingROItSNEtoImage.clear();
-    _mappingROItSNEtoImage.resize(imageSelectionIDs.size());
     _mappingImageToROItSNE.clear();
-    _mappingImageToROItSNE.resize(inputData->getNumPoints());
+    _mappingImageToROItSNE.resize(inputData->getNumPoints(), NO_LANDMARK);
 
     // reset lock to enable correct mapping
     _selectionLocks.visit([this](std::string name, utils::CyclicLock& lock) ->void {lock.reset(); });
@@ -822,11 +829,12 @@ void InteractiveHsnePlugin::computeTSNEforROI()
     Log::trace("InteractiveHsnePlugin:: begin creating selection maps _mappingROItSNEtoImage and _mappingImageToROItSNE");
 
     // Create selection map
+    _mappingROItSNEtoImage = LandmarkMap::fromSingleIDs(imageSelectionIDs);
+
     uint32_t posInEmbedding = 0;
     for (const auto& imageSelectionID : imageSelectionIDs) {
         // add selection map entry
-        _mappingROItSNEtoImage[posInEmbedding].push_back(imageSelectionID);
-        _mappingImageToROItSNE[imageSelectionID].push_back(posInEmbedding);
+        _mappingImageToROItSNE[imageSelectionID] = posInEmbedding;
         posInEmbedding++;
     }
 
@@ -856,10 +864,8 @@ void InteractiveHsnePlugin::computeTSNEforLandmarks()
     // prepare selection mapping
     _tSNEofLandmarks->selectNone();
     events().notifyDatasetDataSelectionChanged(_tSNEofLandmarks);
-    _mappingLandmarktSNEtoImage.clear();
-    _mappingLandmarktSNEtoImage.resize(idMap.size());
     _mappingImageToLandmarktSNE.clear();
-    _mappingImageToLandmarktSNE.resize(inputData->getNumPoints());
+    _mappingImageToLandmarktSNE.resize(inputData->getNumPoints(), NO_LANDMARK);
 
     // reset lock to enable correct mapping
     _selectionLocks.visit([this](std::string name, utils::CyclicLock& lock) ->void {lock.reset(); });
@@ -868,16 +874,19 @@ void InteractiveHsnePlugin::computeTSNEforLandmarks()
 
     // create selecion maps and copy data
     std::vector<uint32_t> imageSelectionIDs;
+    std::vector<uint32_t> landmarktSNEtoImageIDs(idMap.size());
     for (const auto& [dataID, embIdAndPos] : idMap) // Key -> Data ID, Value -> EmbIdAndPos: localIdOnScale, posInEmbedding
     {
         // add selection map entry
-        _mappingLandmarktSNEtoImage[embIdAndPos.posInEmbedding].push_back(dataID);
-        _mappingImageToLandmarktSNE[dataID].push_back(embIdAndPos.posInEmbedding);
+        landmarktSNEtoImageIDs[embIdAndPos.posInEmbedding] = dataID;
+        _mappingImageToLandmarktSNE[dataID] = embIdAndPos.posInEmbedding;
 
         // selection IDs for data copying
         imageSelectionIDs.emplace_back(dataID);
     }
-    std::sort(utils::exec_policy, imageSelectionIDs.begin(), imageSelectionIDs.end());
+    utils::parallel_sort(imageSelectionIDs.begin(), imageSelectionIDs.end());
+
+    _mappingLandmarktSNEtoImage = LandmarkMap::fromSingleIDs(std::move(landmarktSNEtoImageIDs));
 
     // store data from of landmarks
     std::vector<float> dataLandmarks;
@@ -961,7 +970,7 @@ void InteractiveHsnePlugin::setColorMapData(Dataset<Points>& emb, LandmarkMap& m
     std::vector<std::uint8_t> imageMask(numImagePoints, 255);
 
     // fill with background color
-    std::fill(utils::exec_policy, imgColors.begin(), imgColors.end(), backgroundVal);
+    std::fill(imgColors.begin(), imgColors.end(), backgroundVal);
 
     assert(mapEmbToImg.size() == numEmbPoints);
 
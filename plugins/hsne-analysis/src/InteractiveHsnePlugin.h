@@ -216,12 +216,12 @@ private:
     Dataset<Points>         _colorScatterRoitSNE;       /** Color scatter dataset reference */
     TsneAnalysis            _tsneROIAnalysis;           /** TSNE ROI analysis */
     LandmarkMap             _mappingROItSNEtoImage;     /** Maps ROI t-SNE indices to image indices. */
-    LandmarkMap             _mappingImageToROItSNE;     /** Maps image indices to ROI t-SNE indices. */
+    LandmarkMapSingle       _mappingImageToROItSNE;     /** Maps image indices to ROI t-SNE indices. */
 
     Dataset<Points>         _tSNEofLandmarks;           /** t-SNE of landmarks */
     TsneAnalysis            _tsneLandmarksAnalysis;     /** TSNE Landmarks analysis */
     LandmarkMap             _mappingLandmarktSNEtoImage;/** Maps landmark t-SNE indices to image indices. */
-    LandmarkMap             _mappingImageToLandmarktSNE;/** Maps image indices to landmark t-SNE indices. */
+    LandmarkMapSingle       _mappingImageToLandmarktSNE;/** Maps image indices to landmark t-SNE indices. */
 
     std::vector<float>      _imgColorsRoiHSNE;          /** used to save the previous recoloring */
     std::vector<float>      _imgColorstSNE;
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>    // find_if
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <utility>      // move
+
+namespace utils {
+
+    /**
+     * Least recently used cache, bounded by the estimated memory of its values
+     *
+     * Keys only need operator==, lookups are linear, which suits caches of few but large values.
+     * When inserting a value exceeds the memory bound, the least recently used values are evicted.
+     * Not thread-safe
+     */
+    template <typename Key, typename Value>
+    class LruCache
+    {
+    public:
+        using SizeFunction = std::function<size_t(const Value&)>;
+
+        /**
+         * Constructor
+         * @param maxBytes Memory bound, 0 disables the cache
+         * @param sizeOf Estimates the memory of a value in bytes
+         */
+        LruCache(size_t maxBytes, SizeFunction sizeOf) : _entries(), _numBytes(0), _maxBytes(maxBytes), _sizeOf(std::move(sizeOf)) {}
+
+        /** Returns the value for key or nullptr, a found value becomes the most recently used */
+        Value* find(const Key& key)
+        {
+            auto entry = findEntry(key);
+            if (entry == _entries.end())
+                return nullptr;
+
+            _entries.splice(_entries.begin(), _entries, entry);
+            return &_entries.front().value;
+        }
+
+        bool contains(const Key& key) const
+        {
+            return std::find_if(_entries.begin(), _entries.end(), [&key](const Entry& entry) { return entry.key == key; }) != _entries.end();
+        }
+
+        /** Insert or replace the value for key as the most recently used, returns false if the value alone exceeds the memory bound */
+        bool insert(const Key& key, Value value)
+        {
+            erase(key);
+
+            const size_t numBytes = _sizeOf(value);
+            if (numBytes > _maxBytes)
+                return false;
+
+            _entries.push_front({ key, std::move(value), numBytes });
+            _numBytes += numBytes;
+            evict();
+
+            return true;
+        }
+
+        /** Change the value for key in place and estimate its memory again, returns whether it is still cached afterwards */
+        template <typename Modify>
+        bool modify(const Key& key, Modify&& modifyValue)
+        {
+            Value* value = find(key);
+            if (value == nullptr)
+                return false;
+
+            modifyValue(*value);
+
+            Entry& entry = _entries.front();
+            _numBytes -= entry.numBytes;
+            entry.numBytes = _sizeOf(entry.value);
+            _numBytes += entry.numBytes;
+
+            if (entry.numBytes > _maxBytes)
+            {
+                erase(key);
+                return false;
+            }
+
+            evict();
+            return true;
+        }
+
+        bool erase(const Key& key)
+        {
+            auto entry = findEntry(key);
+            if (entry == _entries.end())
+                return false;
+
+            _numBytes -= entry->numBytes;
+            _entries.erase(entry);
+            return true;
+        }
+
+        void clear()
+        {
+            _entries.clear();
+            _numBytes = 0;
+        }
+
+        /** Evicts the least recently used values that exceed the new bound */
+        void setMaxBytes(size_t maxBytes)
+        {
+            _maxBytes = maxBytes;
+            evict();
+        }
+
+        size_t size() const { return _entries.size(); }
+        size_t numBytes() const { return _numBytes; }
+        size_t maxBytes() const { return _maxBytes; }
+
+    private:
+        struct Entry
+        {
+            Key     key;
+            Value   value;
+            size_t  numBytes;
+        };
+
+        typename std::list<Entry>::iterator findEntry(const Key& key)
+        {
+            return std::find_if(_entries.begin(), _entries.end(), [&key](const Entry& entry) { return entry.key == key; });
+        }
+
+        void evict()
+        {
+            while (_numBytes > _maxBytes && !_entries.empty())
+            {
+                _numBytes -= _entries.back().numBytes;
+                _entries.pop_back();
+            }
+        }
+
+    private:
+        std::list<Entry>    _entries;       /** Most recently used first */
+        size_t              _numBytes;      /** Estimated memory of all values */
+        size_t              _maxBytes;      /** Memory bound */
+        SizeFunction        _sizeOf;
+    };
+
+}
@@ -11,10 +11,10 @@
 
 #include <assert.h>
 
-#include <omp.h>
-
 #include "Eigen/Dense"
 
+#include "Utils.h"     // parallel_for
+
 namespace math {
 
     /// ////////// ///
@@ -40,25 +40,17 @@ namespace math {
         const size_t num_row = data_in.size() / num_dims;
         const size_t num_col = num_dims;
 
-        // omp on visual studio can only handle signed integers
-        if (num_row > static_cast<size_t>(std::numeric_limits<int32_t>::max()))
-            std::cerr << "PCA::convertStdVectorToEigenMatrix can only handle data with up to std::numeric_limits<uint32_t>::max() points" << std::endl;
-
         // convert std vector to Eigen MatrixXf
         // each row in MatrixXf corresponds to one data point
         Eigen::MatrixXf data(num_row, num_col);     	// num_rows (data points), num_cols (attributes)
 
         // copy data from vector to matrix
-#ifndef NDEBUG
-#pragma omp parallel for
-#endif NDEBUG
         // loop over data points
-        for (int32_t point = 0; point < static_cast<int32_t>(num_row); point++)
-        {
+        utils::parallel_for(num_row, [&](const size_t point) {
             // loop over data point values
             for (size_t dim = 0; dim < num_col; dim++)
                 data(point, dim) = data_in[point * num_dims + dim];
-        }
+        });
 
         // this would be more concise but only works if data_in is not const
         // Also, I didn't test this
@@ -122,13 +114,9 @@ namespace math {
         {
             if (normFacs[col] < 0.0001f) continue;
 
-#ifndef NDEBUG
-#pragma omp parallel for
-#endif NDEBUG
-            for (int32_t row = 0; row < static_cast<int32_t>(num_row); row++)
-            {
+            utils::parallel_for(num_row, [&](const int32_t row) {
                 mat(row, col) /= normFacs[col];
-            }
+            });
         }
 
     }
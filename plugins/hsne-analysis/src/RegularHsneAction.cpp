@@ -218,7 +218,7 @@ void RegularHsneAction::refine()
     {
         utils::ScopedTimer linkedSelectionTimer("RegularHsneAction::linked selection");
 
-        LandmarkMap& landmarkMap = _hsneHierarchy.getInfluenceHierarchy().getMapTopDown()[refinedScaleLevel];
+        const LandmarkMap& landmarkMap = _hsneHierarchy.getInfluenceMapTopDown(refinedScaleLevel);
 
         mv::SelectionMap mapping;
 
@@ -227,7 +227,7 @@ void RegularHsneAction::refine()
             for (const unsigned int& scaleIndex : refinedLandmarks)
             {
                 int bottomLevelIdx = _hsneHierarchy.getScale(refinedScaleLevel)._landmark_to_original_data_idx[scaleIndex];
-                mapping.getMap()[bottomLevelIdx] = landmarkMap[scaleIndex];
+                mapping.getMap()[bottomLevelIdx] = std::vector<unsigned int>(landmarkMap[scaleIndex].begin(), landmarkMap[scaleIndex].end());
             }
         }
         else
@@ -237,7 +237,7 @@ void RegularHsneAction::refine()
             _input->getGlobalIndices(globalIndices);
             for (const unsigned int& scaleIndex : refinedLandmarks)
             {
-                std::vector<unsigned int> bottomMap = landmarkMap[scaleIndex];
+                std::vector<unsigned int> bottomMap(landmarkMap[scaleIndex].begin(), landmarkMap[scaleIndex].end());
                 // Transform bottom level indices to the global full set indices
                 for (int j = 0; j < bottomMap.size(); j++)
                 {
@@ -0,0 +1,219 @@
+#include "Scheduler.h"
+
+#include "Logger.h"
+
+#include <algorithm>    // clamp, min, max
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace utils {
+
+    static thread_local TaskPriority currentPriority = TaskPriority::Normal;
+
+    static size_t hardwareThreads() {
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    // OpenMP settings are per thread, they have to be set on each thread that starts parallel regions
+    static void limitOpenMPThreads(const size_t numThreads) {
+#ifdef _OPENMP
+        omp_set_num_threads(static_cast<int>(numThreads));
+#endif
+    }
+
+    TaskPriority getTaskPriority() {
+        return currentPriority;
+    }
+
+    /// ////////////////// ///
+    /// ScopedTaskPriority ///
+    /// ////////////////// ///
+
+    ScopedTaskPriority::ScopedTaskPriority(const TaskPriority priority) :
+        _previous(currentPriority)
+    {
+        currentPriority = priority;
+        limitOpenMPThreads(Scheduler::instance().getNumThreads());
+    }
+
+    ScopedTaskPriority::~ScopedTaskPriority()
+    {
+        currentPriority = _previous;
+    }
+
+    /// ///////// ///
+    /// Scheduler ///
+    /// ///////// ///
+
+    Scheduler& Scheduler::instance()
+    {
+        static Scheduler scheduler;
+        return scheduler;
+    }
+
+    Scheduler::Scheduler() :
+        _numThreads(0),
+        _shutdown(false)
+    {
+        for (auto& numQueued : _numQueued)
+            numQueued = 0;
+
+        setNumThreads(hardwareThreads());
+    }
+
+    Scheduler::~Scheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _shutdown = true;
+        }
+        _wakeUp.notify_all();
+
+        for (auto& worker : _workers)
+            worker.join();
+    }
+
+    void Scheduler::setNumThreads(size_t numThreads)
+    {
+        numThreads = std::clamp<size_t>(numThreads, 1, hardwareThreads());
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _numThreads = numThreads;
+
+            // workers are only ever added, surplus workers sleep
+            while (_workers.size() + 1 < numThreads)
+            {
+                const size_t workerIndex = _workers.size();
+                _workers.emplace_back(&Scheduler::workerLoop, this, workerIndex);
+            }
+        }
+        _wakeUp.notify_all();
+
+        limitOpenMPThreads(numThreads);
+
+        Log::info(fmt::format("Scheduler: using {} threads", numThreads));
+    }
+
+    void Scheduler::run(const size_t numTasks, const std::function<void(size_t)>& task)
+    {
+        if (numTasks == 0)
+            return;
+
+        const size_t numHelpers = std::min<size_t>(numTasks, _numThreads) - 1;
+
+        if (numHelpers == 0)
+        {
+            for (size_t i = 0; i < numTasks; i++)
+                task(i);
+            return;
+        }
+
+        auto job = std::make_shared<Job>(task, numTasks, getTaskPriority());
+        enqueue(job, numHelpers);
+
+        // the caller never yields, it has to wait for the job anyways
+        process(*job, false);
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job]() { return job->done == job->numTasks; });
+    }
+
+    bool Scheduler::process(Job& job, const bool yield)
+    {
+        while (true)
+        {
+            if (yield && hasQueuedAbove(job.priority))
+                return false;
+
+            const size_t i = job.next++;
+            if (i >= job.numTasks)
+                return true;
+
+            job.task(i);
+
+            if (++job.done == job.numTasks)
+            {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                job.finished.notify_all();
+            }
+        }
+    }
+
+    void Scheduler::enqueue(const JobPtr& job, const size_t numTickets)
+    {
+        const auto priority = static_cast<size_t>(job->priority);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (size_t i = 0; i < numTickets; i++)
+                _queues[priority].push_back(job);
+            _numQueued[priority] += numTickets;
+        }
+
+        for (size_t i = 0; i < numTickets; i++)
+            _wakeUp.notify_one();
+    }
+
+    bool Scheduler::hasQueuedAbove(const TaskPriority priority) const
+    {
+        for (size_t p = static_cast<size_t>(priority) + 1; p < NUM_PRIORITIES; p++)
+            if (_numQueued[p] > 0)
+                return true;
+
+        return false;
+    }
+
+    void Scheduler::workerLoop(const size_t workerIndex)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        const auto hasWork = [this, workerIndex]() {
+            if (workerIndex + 1 >= _numThreads)
+                return false;
+
+            return std::any_of(std::begin(_queues), std::end(_queues), [](const std::deque<JobPtr>& queue) { return !queue.empty(); });
+        };
+
+        while (true)
+        {
+            _wakeUp.wait(lock, [this, &hasWork]() { return _shutdown || hasWork(); });
+
+            if (_shutdown)
+                return;
+
+            // highest priority first
+            JobPtr job;
+            for (size_t p = NUM_PRIORITIES; p-- > 0;)
+            {
+                if (_queues[p].empty())
+                    continue;
+
+                job = std::move(_queues[p].front());
+                _queues[p].pop_front();
+                _numQueued[p]--;
+                break;
+            }
+
+            lock.unlock();
+
+            // nested parallel sections inherit the priority of the job
+            currentPriority = job->priority;
+            const bool finished = process(*job, true);
+            currentPriority = TaskPriority::Normal;
+
+            lock.lock();
+
+            // hand the job back, it is picked up again once no higher priority work is queued
+            if (!finished)
+            {
+                const auto priority = static_cast<size_t>(job->priority);
+                _queues[priority].push_back(std::move(job));
+                _numQueued[priority]++;
+            }
+        }
+    }
+
+}
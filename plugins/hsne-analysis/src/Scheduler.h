@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>      // size_t
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils {
+
+    /*! Priority of parallel work
+     * Workers always pick up Interactive work first, Background work only if nothing else is queued.
+     * Workers busy with lower priority work hand it back after their current task once higher priority work is queued.
+    */
+    enum class TaskPriority
+    {
+        Background = 0,     /** e.g. preparing the hierarchy scales */
+        Normal = 1,         /** default */
+        Interactive = 2,    /** e.g. scale updates the user waits for */
+    };
+
+    /*! Priority of the parallel work started from the calling thread, Normal if not set */
+    TaskPriority getTaskPriority();
+
+    /**
+     * ScopedTaskPriority
+     *
+     * Sets the priority of parallel work started from the current thread for its lifetime.
+     * Also limits OpenMP regions started from this thread (e.g. in HDILib) to the scheduler thread count,
+     * place it at the entry point of dedicated worker threads.
+     */
+    class ScopedTaskPriority
+    {
+    public:
+        ScopedTaskPriority(const TaskPriority priority);
+        ~ScopedTaskPriority();
+
+        ScopedTaskPriority(const ScopedTaskPriority&) = delete;
+        ScopedTaskPriority& operator=(const ScopedTaskPriority&) = delete;
+
+    private:
+        TaskPriority _previous;
+    };
+
+    /**
+     * Scheduler
+     *
+     * Single thread pool shared by all parallel sections of the plugin, such that
+     * concurrent work (e.g. a hierarchy build and several t-SNE runs) does not oversubscribe the cores.
+     *
+     * run() splits work into numTasks tasks. The calling thread processes tasks itself while
+     * idle workers join in, it only waits for tasks that other threads already started.
+     * Nested calls therefore never deadlock and a thread count of 1 runs everything on the caller.
+     *
+     * The thread count includes the calling thread, i.e. the pool has getNumThreads() - 1 workers.
+     */
+    class Scheduler
+    {
+    public:
+        static Scheduler& instance();
+
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        /*! Set the maximum number of threads, clamped to [1, hardware concurrency]. Also applies to OpenMP regions started from the calling thread */
+        void setNumThreads(size_t numThreads);
+        size_t getNumThreads() const { return _numThreads; }
+
+        /*! Calls task(i) for i in [0, numTasks) in parallel and returns once all calls finished
+         * Work is queued with the priority of the calling thread, see ScopedTaskPriority
+        */
+        void run(const size_t numTasks, const std::function<void(size_t)>& task);
+
+    private:
+        Scheduler();
+        ~Scheduler();
+
+        struct Job
+        {
+            Job(const std::function<void(size_t)>& task, const size_t numTasks, const TaskPriority priority) :
+                task(task), numTasks(numTasks), priority(priority), next(0), done(0) { }
+
+            const std::function<void(size_t)>&  task;       /** Only called for indices < numTasks, i.e. while the caller of run() waits */
+            const size_t                        numTasks;
+            const TaskPriority                  priority;
+            std::atomic<size_t>                 next;       /** Next task index to process */
+            std::atomic<size_t>                 done;       /** Number of finished tasks */
+            std::mutex                          mutex;
+            std::condition_variable             finished;
+        };
+
+        using JobPtr = std::shared_ptr<Job>;
+
+        /*! Process tasks of a job until it is exhausted, returns false if interrupted by higher priority work */
+        bool process(Job& job, const bool yield);
+
+        void enqueue(const JobPtr& job, const size_t numTickets);
+        bool hasQueuedAbove(const TaskPriority priority) const;
+        void workerLoop(const size_t workerIndex);
+
+    private:
+        static constexpr size_t         NUM_PRIORITIES = 3;
+
+        std::atomic<size_t>             _numThreads;                /** Maximum number of threads, including the calling thread */
+        std::vector<std::thread>        _workers;                   /** Workers with index >= _numThreads - 1 sleep */
+        std::deque<JobPtr>              _queues[NUM_PRIORITIES];    /** One entry per worker that may join a job, indexed by TaskPriority */
+        std::atomic<size_t>             _numQueued[NUM_PRIORITIES]; /** Queue sizes, readable without lock */
+        mutable std::mutex              _mutex;                     /** Guards _workers and _queues */
+        std::condition_variable         _wakeUp;
+        bool                            _shutdown;
+    };
+
+}
@@ -3,6 +3,9 @@
 #include "hdi/utils/glad/glad.h"
 #include "OffscreenBuffer.h"
 
+#include <QOpenGLContext>
+
+#include <algorithm>
 #include <vector>
 #include <assert.h>
 
@@ -29,7 +32,14 @@ TsneWorker::TsneWorker(const TsneParameters& parameters, OffscreenBuffer* buffer
     _workerID(++_workerCount),
     _analysisParentName(""),
     _offscreenBuffer(buffer),
-    _outEmbedding(_outEmd)
+    _outEmbedding(_outEmd),
+    _snapshot(nullptr),
+    _lastPublication(),
+    _gradientDescentType(parameters.getGradientDescentType()),
+    _mobility(),
+    _scheduleBegin(0),
+    _pendingUpdates(),
+    _hasPendingUpdate(false)
 {
     // Use inital embedding
     _embedding.resize(2, numPoints);
@@ -53,7 +63,14 @@ TsneWorker::TsneWorker(const TsneParameters& parameters, OffscreenBuffer* buffer
     _workerID(++_workerCount),
     _analysisParentName(""),
     _offscreenBuffer(buffer),
-    _outEmbedding(_outEmd)
+    _outEmbedding(_outEmd),
+    _snapshot(nullptr),
+    _lastPublication(),
+    _gradientDescentType(parameters.getGradientDescentType()),
+    _mobility(),
+    _scheduleBegin(0),
+    _pendingUpdates(),
+    _hasPendingUpdate(false)
 {
     if (_probabilityDistributionGiven == nullptr)
         Log::critical("TsneWorker::TsneWorker: _probabilityDistributionGiven is nullptr");
@@ -72,7 +89,14 @@ TsneWorker::TsneWorker(const TsneParameters& parameters, OffscreenBuffer* buffer
     _workerID(++_workerCount),
     _analysisParentName(""),
     _offscreenBuffer(buffer),
-    _outEmbedding(_outEmd)
+    _outEmbedding(_outEmd),
+    _snapshot(nullptr),
+    _lastPublication(),
+    _gradientDescentType(parameters.getGradientDescentType()),
+    _mobility(),
+    _scheduleBegin(0),
+    _pendingUpdates(),
+    _hasPendingUpdate(false)
 {
 }
 
@@ -127,82 +151,247 @@ void TsneWorker::computeGradientDescent(uint32_t iterations)
         return;
     }
 
-    hdi::dr::TsneParameters tsneParameters;
+    const hdi::dr::TsneParameters tsneParameters = createGradientDescentParameters();
 
-    tsneParameters._embedding_dimensionality = _parameters.getNumDimensionsOutput();
-    tsneParameters._mom_switching_iter = _parameters.getExaggerationIter();
-    tsneParameters._remove_exaggeration_iter = _parameters.getExaggerationIter();
-    tsneParameters._exponential_decay_iter = _parameters.getExponentialDecayIter();
-    tsneParameters._exaggeration_factor = (_parameters.getExaggerationFactor() != -1) ? _parameters.getExaggerationFactor() : 4 + _numPoints / 60000.0;
-    tsneParameters._presetEmbedding = _parameters.getHasPresetEmbedding();
+    Log::info(fmt::format("TsneWorker::computeGradientDescent: t-SNE settings: Exaggeration factor {0}, exaggeration iterations {1}, exponential decay iter {2}, learning rate {3}", 
+        tsneParameters._exaggeration_factor, tsneParameters._remove_exaggeration_iter, tsneParameters._exponential_decay_iter, tsneParameters._eta));
 
-    Log::info(fmt::format("TsneWorker::computeGradientDescent: t-SNE settings: Exaggeration factor {0}, exaggeration iterations {1}, exponential decay iter {2}", 
-        tsneParameters._exaggeration_factor, tsneParameters._remove_exaggeration_iter, tsneParameters._exponential_decay_iter));
+    if (_currentIteration == 0)
+        selectGradientDescentType();
 
-    // Initialize GPU gradient descent
-    {
-        Log::info("TsneWorker::computeGradientDescent: Initialize GPU gradient descent.");
-        utils::ScopedTimer gradDescentTimer("Initialize GPU gradient descent");
+    const std::string deviceName = gradientDescentTypeName(_gradientDescentType);
 
-        // Create a context local to this thread that shares with the global share context
-        if (!_offscreenBuffer->isInitialized())
-            _offscreenBuffer->initialize();
-        _offscreenBuffer->bindContext();
+    // Initialize gradient descent
+    {
+        Log::info("TsneWorker::computeGradientDescent: Initialize " + deviceName + " gradient descent.");
+        utils::ScopedTimer gradDescentTimer("Initialize " + deviceName + " gradient descent");
 
-        if (_currentIteration == 0)
+        if (!initializeGradientDescent(tsneParameters))
         {
-            if(_hasProbabilityDistribution)
-                _GPGPU_tSNE.initialize(*_probabilityDistributionGiven, &_embedding, tsneParameters);
-            else
-                _GPGPU_tSNE.initialize(_probabilityDistributionLocal, &_embedding, tsneParameters);
+            Log::error("TsneWorker::computeGradientDescent: Could not initialize gradient descent");
+            emit finished();
+            return;
         }
 
-        emit embeddingUpdate(_embedding.getContainer(), _numPoints, _parameters.getNumDimensionsOutput());
+        publishEmbedding(true);
     }
     
-    // Computing gradient descent on GPU
+    // Computing gradient descent
     {
-        Log::info("TsneWorker::computeGradientDescent: Computing gradient descent on GPU.");
-        utils::ScopedTimer gradDescentTimer("Computing gradient descent on GPU");
+        Log::info("TsneWorker::computeGradientDescent: Computing gradient descent on " + deviceName + ".");
+        utils::ScopedTimer gradDescentTimer("Computing gradient descent on " + deviceName);
 
-        const auto beginIteration   = _currentIteration;
-        const auto endIteration     = iterations;
+        const uint32_t beginIteration   = _currentIteration;
+        const uint32_t endIteration     = iterations;
+
+        // Only check for convergence once exaggeration is removed, the extends are published and all points move
+        uint32_t convergenceCheckBegin = std::max(_parameters.getExaggerationIter() + _parameters.getExponentialDecayIter(), _parameters.getPublishExtendsAtIteration());
+        if (!_mobility.empty() && _gradientDescentType != GradientDescentType::GPU)
+            convergenceCheckBegin = std::max(convergenceCheckBegin, _parameters.getAnchoredIterations());
+        convergenceCheckBegin += _scheduleBegin;
+        const uint32_t convergenceCheckInterval = _parameters.getConvergenceCheckInterval();
+        _convergenceMonitor.setTolerance(_parameters.getConvergenceTolerance());
+        _convergenceMonitor.reset();
 
         // Performs gradient descent for every iteration
         for (_currentIteration = beginIteration; _currentIteration < endIteration; ++_currentIteration)
         {
-            // Perform a GPGPU-SNE iteration
-            _GPGPU_tSNE.doAnIteration();
+            // Perform a t-SNE iteration
+            doAnIteration();
 
-            if (_currentIteration > 0 && _currentIteration % 10 == 0)
-                emit embeddingUpdate(_embedding.getContainer(), _numPoints, _parameters.getNumDimensionsOutput());
+            publishEmbedding(false);
 
-            if ((_currentIteration == _parameters.getPublishExtendsAtIteration()) && (_parameters.getPublishExtendsAtIteration() > 0))
+            if ((_currentIteration - _scheduleBegin == _parameters.getPublishExtendsAtIteration()) && (_parameters.getPublishExtendsAtIteration() > 0))
             {
                 Log::info("TsneWorker::computeGradientDescent: Set reference embedding extends at iteration " + std::to_string(_currentIteration));
                 emit publishExtends(utils::computeExtends(_embedding.getContainer()));
             }
 
-            // React to requests to stop
-            if (_shouldStop)
+            // React to requests to stop and to new points
+            if (_shouldStop || _hasPendingUpdate)
+                break;
+
+            if (_currentIteration >= convergenceCheckBegin && (_currentIteration + 1) % convergenceCheckInterval == 0 &&
+                _convergenceMonitor.check(_embedding.getContainer(), _parameters.getNumDimensionsOutput()))
+            {
+                ++_currentIteration;  // count the finished iteration, as after the last iteration
+                Log::info(fmt::format("TsneWorker::computeGradientDescent: Converged after {0} of {1} iterations, relative change {2:.2e} per {3} iterations",
+                    _currentIteration.load(), endIteration, _convergenceMonitor.getLastChange(), convergenceCheckInterval));
                 break;
+            }
         }
 
-        _offscreenBuffer->releaseContext();
+        if (_gradientDescentType == GradientDescentType::GPU)
+            _offscreenBuffer->releaseContext();
+
+        // updateComputation() continues with the new points
+        if (_hasPendingUpdate && !_shouldStop)
+            return;
 
-        emit embeddingUpdate(_embedding.getContainer(), _numPoints, _parameters.getNumDimensionsOutput());
+        publishEmbedding(true);
     }
 
     _outEmbedding->assign(_numPoints, _parameters.getNumDimensionsOutput(), _embedding.getContainer());
 
-    Log::info(fmt::format("TsneWorker::computeGradientDescent: Finished embedding of tSNE Analysis after: {} iterations", _currentIteration));
+    Log::info(fmt::format("TsneWorker::computeGradientDescent: Finished embedding of tSNE Analysis after: {} iterations", _currentIteration.load()));
     emit finished();
 }
 
+hdi::dr::TsneParameters TsneWorker::createGradientDescentParameters() const
+{
+    hdi::dr::TsneParameters tsneParameters;
+
+    tsneParameters._embedding_dimensionality = _parameters.getNumDimensionsOutput();
+    tsneParameters._mom_switching_iter = _parameters.getExaggerationIter();
+    tsneParameters._remove_exaggeration_iter = _parameters.getExaggerationIter();
+    tsneParameters._exponential_decay_iter = _parameters.getExponentialDecayIter();
+    tsneParameters._exaggeration_factor = (_parameters.getExaggerationFactor() != -1) ? _parameters.getExaggerationFactor() : 4 + _numPoints / 60000.0;
+    tsneParameters._presetEmbedding = _parameters.getHasPresetEmbedding();
+    tsneParameters._eta = _parameters.getLearningRate();
+
+    return tsneParameters;
+}
+
+void TsneWorker::publishEmbedding(const bool force)
+{
+    if (_snapshot == nullptr)
+        return;
+
+    // The UI reads the latest embedding only, more frequent copies would be overwritten before they are shown
+    const auto now = std::chrono::steady_clock::now();
+    if (!force && now - _lastPublication < PUBLISH_INTERVAL)
+        return;
+    _lastPublication = now;
+
+    // Notify only if the reader has seen the previous embedding, instead of queueing a notification per publication
+    if (_snapshot->publish(_embedding.getContainer(), _numPoints, _parameters.getNumDimensionsOutput(), _currentIteration))
+        emit embeddingPublished();
+}
+
+void TsneWorker::selectGradientDescentType()
+{
+    // Without an OpenGL context (e.g. headless machines) the GPU implementation cannot run
+    const bool hasOpenGLContext = QOpenGLContext::globalShareContext() != nullptr;
+    if (_parameters.getGradientDescentType() == GradientDescentType::GPU && !hasOpenGLContext)
+        Log::warn("TsneWorker::selectGradientDescentType: No OpenGL context available, using the CPU gradient descent");
+
+    _gradientDescentType = _parameters.selectGradientDescentType(_numPoints, hasOpenGLContext);
+
+    Log::info(fmt::format("TsneWorker::selectGradientDescentType: {0} gradient descent for {1} points", gradientDescentTypeName(_gradientDescentType), _numPoints));
+}
+
+bool TsneWorker::initializeGradientDescent(const hdi::dr::TsneParameters& tsneParameters)
+{
+    const HsneMatrix& probabilityDistribution = _hasProbabilityDistribution ? *_probabilityDistributionGiven : _probabilityDistributionLocal;
+
+    if (_gradientDescentType != GradientDescentType::GPU)
+    {
+        if (_currentIteration > 0)
+            return true;
+
+        configureCPUGradientDescent();
+        if (!_CPU_tSNE.initialize(probabilityDistribution, &_embedding, tsneParameters))
+            return false;
+
+        if (!_mobility.empty() && _parameters.getAnchoredIterations() > 0)
+            return _CPU_tSNE.setMobility(_mobility, _parameters.getAnchoredIterations());
+
+        return true;
+    }
+
+    if (!_mobility.empty() && _currentIteration == 0)
+        Log::warn("TsneWorker::initializeGradientDescent: Anchored points are only supported by the CPU gradient descent, all points move");
+
+    // Create a context local to this thread that shares with the global share context
+    if (!_offscreenBuffer->isInitialized())
+        _offscreenBuffer->initialize();
+    _offscreenBuffer->bindContext();
+
+    if (_currentIteration == 0)
+        _GPGPU_tSNE.initialize(probabilityDistribution, &_embedding, tsneParameters);
+
+    return true;
+}
+
+void TsneWorker::configureCPUGradientDescent()
+{
+    TsneGradientDescentCPU::Repulsion repulsion = TsneGradientDescentCPU::Repulsion::BarnesHut;
+    if (_gradientDescentType == GradientDescentType::CPU_FFT)
+        repulsion = TsneGradientDescentCPU::Repulsion::FFT;
+    else if (_gradientDescentType == GradientDescentType::CPU_Exact)
+        repulsion = TsneGradientDescentCPU::Repulsion::Exact;
+
+    _CPU_tSNE.setTheta(_parameters.getBarnesHutTheta());
+    _CPU_tSNE.setRepulsion(repulsion);
+}
+
+void TsneWorker::addUpdate(TsneUpdate update)
+{
+    std::lock_guard<std::mutex> lock(_pendingUpdatesMutex);
+    _pendingUpdates.push_back(std::move(update));
+    _hasPendingUpdate = true;
+}
+
+bool TsneWorker::applyPendingUpdates()
+{
+    std::deque<TsneUpdate> updates;
+    {
+        std::lock_guard<std::mutex> lock(_pendingUpdatesMutex);
+        std::swap(updates, _pendingUpdates);
+        _hasPendingUpdate = false;
+    }
+
+    if (_gradientDescentType == GradientDescentType::GPU || _currentIteration == 0)
+    {
+        Log::error("TsneWorker::applyPendingUpdates: Only an initialized CPU gradient descent can be updated");
+        return false;
+    }
+
+    utils::ScopedTimer updateTimer("Update gradient descent");
+
+    for (auto& update : updates)
+    {
+        _parameters = update.parameters;
+        _parameters.setHasPresetEmbedding(true);
+        _numPoints = static_cast<uint32_t>(update.probabilities.size());
+        _mobility = std::move(update.mobility);
+
+        // the selection depends on the number of points, but the GPU state cannot be updated
+        selectGradientDescentType();
+        if (_gradientDescentType == GradientDescentType::GPU)
+        {
+            Log::error("TsneWorker::applyPendingUpdates: The GPU gradient descent cannot be updated");
+            return false;
+        }
+
+        configureCPUGradientDescent();
+        if (!_CPU_tSNE.replacePoints(update.probabilities, update.embedding, update.previousIndices, createGradientDescentParameters()))
+            return false;
+
+        if (!_mobility.empty() && _parameters.getAnchoredIterations() > 0 && !_CPU_tSNE.setMobility(_mobility, _parameters.getAnchoredIterations()))
+            return false;
+    }
+
+    // exaggeration, extends publication and convergence checks start over for the new points
+    _scheduleBegin = _currentIteration;
+    publishEmbedding(true);
+
+    return true;
+}
+
+void TsneWorker::doAnIteration()
+{
+    if (_gradientDescentType == GradientDescentType::GPU)
+        _GPGPU_tSNE.doAnIteration();
+    else
+        _CPU_tSNE.doAnIteration();
+}
+
 void TsneWorker::compute()
 {
     Log::info(fmt::format("A-tSNE: compute worker {0} ({1})", _workerID, _analysisParentName));
     utils::ScopedTimer computeTSNETimer("Total t-SNE computation");
+    utils::ScopedTaskPriority taskPriority(utils::TaskPriority::Normal);
 
     _shouldStop = false;
 
@@ -219,6 +408,33 @@ void TsneWorker::continueComputation(uint32_t iterations)
     computeGradientDescent(iterations);
 }
 
+void TsneWorker::updateComputation()
+{
+    // a stopped computation is not updated, its thread quits
+    if (_shouldStop)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_pendingUpdatesMutex);
+            _pendingUpdates.clear();
+            _hasPendingUpdate = false;
+        }
+
+        emit updateApplied(false);
+        return;
+    }
+
+    const bool success = applyPendingUpdates();
+    emit updateApplied(success);
+
+    if (!success)
+    {
+        Log::error("TsneWorker::updateComputation: Could not update the gradient descent");
+        return;
+    }
+
+    computeGradientDescent(_currentIteration + _parameters.getNumIterations());
+}
+
 void TsneWorker::stop()
 {
     _shouldStop = true;
@@ -231,6 +447,9 @@ void TsneWorker::stop()
 TsneAnalysis::TsneAnalysis(std::string name) :
     _workerThread(),
     _tsneWorker(nullptr),
+    _stopped(false),
+    _numPendingUpdates(0),
+    _discardedUpdates(false),
     _analysisName(name),
     _offscreenBuffer(nullptr),
     _embedding()
@@ -250,7 +469,7 @@ TsneAnalysis::~TsneAnalysis()
 {
 }
 
-void TsneAnalysis::startComputation(const TsneParameters& parameters, const HsneMatrix& probDist, std::vector<float>& inital_embedding, uint32_t numPoints)
+void TsneAnalysis::startComputation(const TsneParameters& parameters, const HsneMatrix& probDist, std::vector<float>& inital_embedding, uint32_t numPoints, const std::vector<float>& mobility)
 {
     if (!_tsneWorker.isNull())
     {
@@ -259,6 +478,7 @@ void TsneAnalysis::startComputation(const TsneParameters& parameters, const Hsne
     }
 
     _tsneWorker = new TsneWorker(parameters, _offscreenBuffer, &_embedding, probDist, inital_embedding, numPoints);
+    _tsneWorker->setMobility(mobility);
     startComputation(_tsneWorker);
 }
 
@@ -296,26 +516,106 @@ void TsneAnalysis::stopComputation()
     if (_workerThread.isRunning())
         Log::info("TsneAnalysis::stopComputation: about to stop tSNE computation of worker " + std::to_string(_tsneWorker->getWorkerID()));
 
+    _stopped = true;
+
     emit stopWorker();
     _workerThread.quit();
+
+    // The stopped worker does not apply queued updates, its later embeddings still show the points before them
+    if (_numPendingUpdates > 0)
+    {
+        _numPendingUpdates = 0;
+        _discardedUpdates = true;
+        emit updateApplied(false);
+    }
+}
+
+bool TsneAnalysis::canUpdateOnline() const
+{
+    if (_tsneWorker.isNull() || _stopped || !_workerThread.isRunning())
+        return false;
+
+    // the gradient descent is initialized with the first iteration
+    return _tsneWorker->getNumIterations() > 1 && _tsneWorker->getGradientDescentType() != GradientDescentType::GPU;
+}
+
+bool TsneAnalysis::canUpdateOnline(const TsneParameters& parameters, uint32_t numPoints) const
+{
+    if (!canUpdateOnline())
+        return false;
+
+    const bool hasOpenGLContext = QOpenGLContext::globalShareContext() != nullptr;
+    return parameters.selectGradientDescentType(numPoints, hasOpenGLContext) != GradientDescentType::GPU;
+}
+
+void TsneAnalysis::updateComputation(const TsneParameters& parameters, const HsneMatrix& probDist, const std::vector<float>& embedding, const std::vector<uint32_t>& previousIndices, const std::vector<float>& mobility)
+{
+    if (!canUpdateOnline())
+    {
+        Log::error("TsneAnalysis::updateComputation: No running computation to update");
+        emit updateApplied(false);
+        return;
+    }
+
+    // the worker copies the probabilities, the caller may change them while the update is pending
+    _tsneWorker->addUpdate({ parameters, probDist, embedding, previousIndices, mobility });
+    _numPendingUpdates++;
+    emit updateWorker();
 }
 
 void TsneAnalysis::startComputation(TsneWorker* tsneWorker)
 {
     tsneWorker->setName(_analysisName);
+    tsneWorker->setSnapshot(&_snapshot);
     tsneWorker->moveToThread(&_workerThread);
+    _stopped = false;
+    _numPendingUpdates = 0;
+    _discardedUpdates = false;
 
     // To-Worker signals
     connect(this, &TsneAnalysis::startWorker, tsneWorker, &TsneWorker::compute);
     connect(this, &TsneAnalysis::continueWorker, tsneWorker, &TsneWorker::continueComputation);
+    connect(this, &TsneAnalysis::updateWorker, tsneWorker, &TsneWorker::updateComputation);
     connect(this, &TsneAnalysis::stopWorker, tsneWorker, &TsneWorker::stop, Qt::DirectConnection);
 
     // From-Worker signals
-    connect(tsneWorker, &TsneWorker::embeddingUpdate, this, &TsneAnalysis::embeddingUpdate);
+    connect(tsneWorker, &TsneWorker::embeddingPublished, this, &TsneAnalysis::readEmbeddingSnapshot);
     connect(tsneWorker, &TsneWorker::finished, this, &TsneAnalysis::finished);
     connect(tsneWorker, &TsneWorker::publishExtends, this, &TsneAnalysis::publishExtends);
+    connect(tsneWorker, &TsneWorker::updateApplied, this, [this, tsneWorker](bool success) {
+        // answers of a replaced worker, or to updates that stopComputation() already failed
+        if (tsneWorker != _tsneWorker || _numPendingUpdates == 0)
+            return;
+
+        _numPendingUpdates--;
+
+        // later updates refer to the points of the failed one
+        if (!success)
+        {
+            _numPendingUpdates = 0;
+            stopComputation();
+        }
+
+        emit updateApplied(success);
+
+        // forward the updated points, also if their first publication was already read
+        if (success)
+            readEmbeddingSnapshot();
+        });
 
     _workerThread.start();
 
     emit startWorker();
 }
+
+void TsneAnalysis::readEmbeddingSnapshot()
+{
+    if (_discardedUpdates)
+        return;
+
+    // Receivers run in this thread and copy the embedding directly from the snapshot buffer
+    const EmbeddingSnapshot::Embedding& embedding = _snapshot.acquire();
+
+    if (embedding.numPoints > 0)
+        emit embeddingUpdate(embedding.data, embedding.numPoints, embedding.numDimensions);
+}
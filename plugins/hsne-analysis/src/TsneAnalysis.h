@@ -2,6 +2,9 @@
 
 #include "TsneParameters.h"
 #include "TsneData.h"
+#include "EmbeddingSnapshot.h"
+#include "ConvergenceMonitor.h"
+#include "TsneGradientDescentCPU.h"
 #include "Utils.h"
 Q_DECLARE_METATYPE(utils::EmbeddingExtends);
 
@@ -14,6 +17,10 @@ Q_DECLARE_METATYPE(utils::EmbeddingExtends);
 #include <QThread>
 #include <QPointer>
 
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <map>
@@ -21,6 +28,16 @@ Q_DECLARE_METATYPE(utils::EmbeddingExtends);
 class OffscreenBuffer;
 class TsneAnalysis;
 
+/** New points for a running gradient descent, see TsneWorker::addUpdate */
+struct TsneUpdate
+{
+    TsneParameters          parameters;
+    HsneMatrix              probabilities;
+    std::vector<float>      embedding;
+    std::vector<uint32_t>   previousIndices;    /** see TsneGradientDescentCPU::replacePoints */
+    std::vector<float>      mobility;           /** see TsneWorker::setMobility */
+};
+
 class TsneWorker : public QObject
 {
     Q_OBJECT
@@ -36,27 +53,62 @@ public:
     void setName(const  std::string& name) { _analysisParentName = name; }
     std::string getName() const { return _analysisParentName; }
 
+    /** Intermediate embeddings are published here, embeddingPublished notifies the reader */
+    void setSnapshot(EmbeddingSnapshot* snapshot) { _snapshot = snapshot; }
+
+    /** Per point mobility during the first getAnchoredIterations() iterations, only used by the CPU gradient descent */
+    void setMobility(const std::vector<float>& mobility) { _mobility = mobility; }
+
+    /** Queue new points for the CPU gradient descent, the running computation stops and updateComputation() continues with them. Thread-safe */
+    void addUpdate(TsneUpdate update);
+
+    GradientDescentType getGradientDescentType() const { return _gradientDescentType; }
+
 public slots:
     void compute();
     void continueComputation(uint32_t iterations);
+    void updateComputation();
     void stop();
 
 signals:
-    void embeddingUpdate(const std::vector<float>& emb, const uint32_t& numPoints, const uint32_t& numDimensions);
+    void embeddingPublished();
     void finished();
     void publishExtends(utils::EmbeddingExtends extends);
+    void updateApplied(bool success);
 
 private:
     void computeSimilarities();
     void computeGradientDescent(uint32_t iterations);
+
+    /** Parameters of the gradient descent implementations */
+    hdi::dr::TsneParameters createGradientDescentParameters() const;
+
+    /** Copy the embedding into the snapshot, at most every PUBLISH_INTERVAL unless forced */
+    void publishEmbedding(const bool force);
+
+    /** Resolve automatic selection and unavailable GPU, before the first iteration */
+    void selectGradientDescentType();
+
+    /** Initialize the selected gradient descent implementation, binds the OpenGL context for the GPU */
+    bool initializeGradientDescent(const hdi::dr::TsneParameters& tsneParameters);
+
+    /** Repulsion and theta of the CPU gradient descent for the selected type */
+    void configureCPUGradientDescent();
+
+    /** Replace the points of the CPU gradient descent with the queued updates, in order */
+    bool applyPendingUpdates();
+    void doAnIteration();
     
 private:
     /** Parameters for the execution of the similarity computation and gradient descent */
     // TODO: use a single parameters instance instead of copying all the parameters
     TsneParameters _parameters;
 
-    /** Current iteration in the embedding / gradient descent process */
-    uint32_t _currentIteration;
+    /** Current iteration in the embedding / gradient descent process, read by TsneAnalysis in the UI thread */
+    std::atomic<uint32_t> _currentIteration;
+
+    /** Iteration at which the schedule of the current points began, the last applied update */
+    uint32_t _scheduleBegin;
 
     // Data variables
     uint32_t  _numPoints;
@@ -75,6 +127,15 @@ private:
     /** GPGPU t-SNE gradient descent implementation */
     hdi::dr::GradientDescentTSNETexture<HsneMatrix> _GPGPU_tSNE;
 
+    /** CPU t-SNE gradient descent implementation */
+    TsneGradientDescentCPU _CPU_tSNE;
+
+    /** Implementation used by this worker, fixed after the first iteration, read by TsneAnalysis in the UI thread */
+    std::atomic<GradientDescentType> _gradientDescentType;
+
+    /** Anchored optimization of a preset embedding, empty if all points move from the start */
+    std::vector<float> _mobility;
+
     /** Storage of current embedding */
     hdi::data::Embedding<float> _embedding;
 
@@ -84,8 +145,21 @@ private:
     /** Offscreen OpenGL buffer required to run the gradient descent */
     OffscreenBuffer* _offscreenBuffer;
 
-    // Termination flags
-    bool _shouldStop;
+    /** Intermediate embeddings for the UI */
+    EmbeddingSnapshot* _snapshot;
+    std::chrono::steady_clock::time_point _lastPublication;
+    static constexpr std::chrono::milliseconds PUBLISH_INTERVAL{ 33 };   // at most 30 updates per second
+
+    /** Stops the gradient descent early once the layout is stable */
+    ConvergenceMonitor _convergenceMonitor;
+
+    /** Updates queued by addUpdate, each refers to the points of the previous one */
+    std::deque<TsneUpdate> _pendingUpdates;
+    std::mutex _pendingUpdatesMutex;
+    std::atomic<bool> _hasPendingUpdate;
+
+    // Termination flags, set by stop() from the UI thread
+    std::atomic<bool> _shouldStop;
 
     // Debugging counter
     size_t _workerID;
@@ -102,13 +176,25 @@ public:
     TsneAnalysis(std::string name = "");
     ~TsneAnalysis() override;
 
-    void startComputation(const TsneParameters& parameters, const HsneMatrix& probDist, std::vector<float>& inital_embedding, uint32_t numPoints);
+    void startComputation(const TsneParameters& parameters, const HsneMatrix& probDist, std::vector<float>& inital_embedding, uint32_t numPoints, const std::vector<float>& mobility = {});
     void startComputation(const TsneParameters& parameters, const HsneMatrix& probDist, uint32_t numPoints);
     void startComputation(const TsneParameters& parameters, /*const*/ std::vector<float>& data, uint32_t numDimensionsData);
 
     void continueComputation(uint32_t iterations);
     void stopComputation();
 
+    /** Whether the running worker accepts new points with updateComputation(): it is not stopped and initialized its CPU gradient descent */
+    bool canUpdateOnline() const;
+
+    /** As above, and the gradient descent type selected for numPoints runs on the CPU */
+    bool canUpdateOnline(const TsneParameters& parameters, uint32_t numPoints) const;
+
+    /** Continue the running gradient descent with new points, the optimizer state of points with previousIndices is kept, see TsneGradientDescentCPU::replacePoints. Emits updateApplied */
+    void updateComputation(const TsneParameters& parameters, const HsneMatrix& probDist, const std::vector<float>& embedding, const std::vector<uint32_t>& previousIndices, const std::vector<float>& mobility = {});
+
+    /** An update was handed to the worker with updateComputation() and updateApplied was not yet emitted for it */
+    bool hasPendingUpdate() const { return _numPendingUpdates > 0; }
+
     bool canContinue() const { return (_tsneWorker == nullptr) ? false : _tsneWorker->getNumIterations() >= 1; }
     uint32_t getNumIterations() const { return _tsneWorker->getNumIterations(); }
     const TsneData& getEmbedding() const { return _embedding; }
@@ -117,23 +203,32 @@ public:
 private:
     void startComputation(TsneWorker* tsneWorker);
 
+    /** Read the latest embedding published by the worker and forward it with embeddingUpdate */
+    void readEmbeddingSnapshot();
+
 signals:
     // Local signals
     void startWorker();
     void continueWorker(uint32_t iterations);
+    void updateWorker();
     void stopWorker();
 
-    // Outgoing signals
+    // Outgoing signals, emb is only valid during the emission
     void embeddingUpdate(const std::vector<float>& emb, const uint32_t& numPoints, const uint32_t& numDimensions);
     void finished();
     void publishExtends(utils::EmbeddingExtends extends);
+    void updateApplied(bool success);           // followed by an embeddingUpdate with the new points, on failure the computation is stopped. stopComputation() fails pending updates
 
 private:
     QThread                 _workerThread;
     std::string             _analysisName;
     QPointer<TsneWorker>    _tsneWorker;
+    bool                    _stopped;                   /** stopComputation() was called after the last start */
+    uint32_t                _numPendingUpdates;         /** Updates handed to the worker that it did not answer yet */
+    bool                    _discardedUpdates;          /** stopComputation() failed pending updates, the embeddings of the worker do not contain their points */
 
     TsneData                _embedding;
+    EmbeddingSnapshot       _snapshot;                  /** Intermediate embeddings of the worker */
 
     /** Offscreen OpenGL buffer required to run the gradient descent */
     QPointer<OffscreenBuffer> _offscreenBuffer;
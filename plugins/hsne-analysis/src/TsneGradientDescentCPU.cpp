@@ -0,0 +1,578 @@
+#include "TsneGradientDescentCPU.h"
+
+#include "Utils.h"
+#include "Logger.h"
+
+#include <algorithm>    // sort, partition_point, min, max
+#include <cmath>
+#include <limits>
+#include <numeric>      // accumulate
+
+namespace {
+
+    // spread the lower 32 bits of v to the even bits of the result
+    uint64_t spreadBits(const uint32_t v)
+    {
+        uint64_t x = v;
+        x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+        x = (x | (x << 8))  & 0x00FF00FF00FF00FFULL;
+        x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+        x = (x | (x << 2))  & 0x3333333333333333ULL;
+        x = (x | (x << 1))  & 0x5555555555555555ULL;
+        return x;
+    }
+
+}
+
+TsneGradientDescentCPU::TsneGradientDescentCPU() :
+    _params(),
+    _embedding(nullptr),
+    _numPoints(0),
+    _iteration(0),
+    _theta(0.5f),
+    _repulsion(Repulsion::BarnesHut),
+    _anchoredIterations(0),
+    _frozenNormalization(0)
+{
+}
+
+bool TsneGradientDescentCPU::initialize(const HsneMatrix& probabilities, hdi::data::Embedding<float>* embedding, const hdi::dr::TsneParameters& params)
+{
+    if (params._embedding_dimensionality != 2)
+    {
+        Log::error("TsneGradientDescentCPU::initialize: only 2D embeddings are supported");
+        return false;
+    }
+
+    _params = params;
+    _embedding = embedding;
+    _numPoints = static_cast<uint32_t>(probabilities.size());
+    _iteration = 0;
+    _anchoredIterations = 0;
+
+    utils::timer([&]() {
+        computeSymmetricProbabilities(probabilities);
+        },
+        "TsneGradientDescentCPU: symmetrize probabilities");
+
+    if (!_params._presetEmbedding)
+    {
+        // small random initialization
+        _embedding->resize(2, _numPoints);
+        utils::randomEmbedding(_numPoints, 0.1f, 0.1f, utils::randomSeed(_params._seed), _embedding->getContainer());
+    }
+
+    if (_embedding->getContainer().size() != 2ull * _numPoints)
+    {
+        Log::error("TsneGradientDescentCPU::initialize: embedding size does not match the probability distribution");
+        return false;
+    }
+
+    _gains.assign(2ull * _numPoints, 1.0f);
+    _update.assign(2ull * _numPoints, 0.0f);
+    _attractiveForces.resize(2ull * _numPoints);
+    _repulsiveForces.resize(2ull * _numPoints);
+
+    return true;
+}
+
+bool TsneGradientDescentCPU::replacePoints(const HsneMatrix& probabilities, const std::vector<float>& positions, const std::vector<uint32_t>& previousIndices, const hdi::dr::TsneParameters& params)
+{
+    if (_embedding == nullptr)
+    {
+        Log::error("TsneGradientDescentCPU::replacePoints: not initialized");
+        return false;
+    }
+
+    const auto numPoints = static_cast<uint32_t>(probabilities.size());
+    if (positions.size() != 2ull * numPoints || previousIndices.size() != numPoints)
+    {
+        Log::error("TsneGradientDescentCPU::replacePoints: positions or previous indices do not match the probability distribution");
+        return false;
+    }
+
+    // carry over the optimizer state of remaining points
+    std::vector<float> gains(2ull * numPoints, 1.0f);
+    std::vector<float> update(2ull * numPoints, 0.0f);
+    size_t numRemaining = 0;
+    for (uint32_t i = 0; i < numPoints; i++)
+    {
+        const uint32_t previous = previousIndices[i];
+        if (previous == NEW_POINT || previous >= _numPoints)
+            continue;
+
+        gains[2 * i] = _gains[2 * previous];
+        gains[2 * i + 1] = _gains[2 * previous + 1];
+        update[2 * i] = _update[2 * previous];
+        update[2 * i + 1] = _update[2 * previous + 1];
+        numRemaining++;
+    }
+
+    _gains = std::move(gains);
+    _update = std::move(update);
+
+    _params = params;
+    _numPoints = numPoints;
+    _iteration = 0;
+    _anchoredIterations = 0;
+
+    // the normalization of the probabilities changes with every point, all rows are recomputed
+    utils::timer([&]() {
+        computeSymmetricProbabilities(probabilities);
+        },
+        "TsneGradientDescentCPU: symmetrize probabilities");
+
+    _embedding->resize(2, _numPoints);
+    _embedding->getContainer().assign(positions.begin(), positions.end());
+
+    _attractiveForces.resize(2ull * _numPoints);
+    _repulsiveForces.resize(2ull * _numPoints);
+
+    Log::info(fmt::format("TsneGradientDescentCPU::replacePoints: {0} of {1} points remain", numRemaining, _numPoints));
+
+    return true;
+}
+
+double TsneGradientDescentCPU::exaggerationFactor() const
+{
+    // same schedule as hdi::dr::GradientDescentTSNETexture: constant, then linear decay to 1
+    if (_iteration <= static_cast<uint32_t>(_params._remove_exaggeration_iter))
+        return _params._exaggeration_factor;
+
+    if (_iteration <= static_cast<uint32_t>(_params._remove_exaggeration_iter + _params._exponential_decay_iter))
+    {
+        const double decay = 1.0 - static_cast<double>(_iteration - _params._remove_exaggeration_iter) / _params._exponential_decay_iter;
+        return 1.0 + (_params._exaggeration_factor - 1.0) * decay;
+    }
+
+    return 1.0;
+}
+
+bool TsneGradientDescentCPU::setMobility(const std::vector<float>& mobility, const uint32_t anchoredIterations)
+{
+    if (_embedding == nullptr || mobility.size() != _numPoints)
+    {
+        Log::error("TsneGradientDescentCPU::setMobility: mobility does not match the number of points");
+        return false;
+    }
+
+    _mobility.resize(_numPoints);
+    _mobilePoints.clear();
+    std::vector<float> frozenPositions;
+
+    const std::vector<float>& positions = _embedding->getContainer();
+    for (uint32_t i = 0; i < _numPoints; i++)
+    {
+        _mobility[i] = std::clamp(mobility[i], 0.0f, 1.0f);
+
+        if (_mobility[i] > 0)
+            _mobilePoints.push_back(i);
+        else
+        {
+            frozenPositions.push_back(positions[2 * i]);
+            frozenPositions.push_back(positions[2 * i + 1]);
+        }
+    }
+
+    _anchoredIterations = _iteration + anchoredIterations;
+
+    // the repulsion among frozen points does not change during the anchored phase
+    buildTree(frozenPositions, _frozenTree);
+
+    const auto numFrozen = static_cast<uint32_t>(frozenPositions.size() / 2);
+    _normalizationTerms.resize(numFrozen);
+    utils::parallel_for(numFrozen, [&](const uint32_t k) {
+        double normalization = 0, forceX = 0, forceY = 0;
+        accumulateRepulsion(_frozenTree, _frozenTree.sortedPositions[2 * k], _frozenTree.sortedPositions[2 * k + 1], k, normalization, forceX, forceY);
+        _normalizationTerms[k] = normalization;
+        });
+    _frozenNormalization = std::accumulate(_normalizationTerms.begin(), _normalizationTerms.end(), 0.0);
+
+    Log::info(fmt::format("TsneGradientDescentCPU::setMobility: {0} of {1} points mobile during the first {2} iterations", _mobilePoints.size(), _numPoints, anchoredIterations));
+
+    return true;
+}
+
+void TsneGradientDescentCPU::doAnIteration()
+{
+    if (_embedding == nullptr || _numPoints == 0)
+        return;
+
+    double normalization = 0;
+    if (isAnchored())
+        normalization = computeRepulsiveForcesAnchored();
+    else
+    {
+        switch (_repulsion)
+        {
+        case Repulsion::FFT:
+            normalization = _repulsionFFT.computeRepulsiveForces(_embedding->getContainer(), _repulsiveForces);
+            break;
+        case Repulsion::Exact:
+            normalization = _repulsionExact.computeRepulsiveForces(_embedding->getContainer(), _repulsiveForces);
+            break;
+        default:
+            normalization = computeRepulsiveForcesBarnesHut();
+            break;
+        }
+    }
+
+    computeAttractiveForces();
+
+    updateEmbedding(exaggerationFactor(), normalization);
+
+    _iteration++;
+}
+
+void TsneGradientDescentCPU::computeSymmetricProbabilities(const HsneMatrix& probabilities)
+{
+    // each entry p_j|i is added to (i, j) and (j, i)
+    std::vector<size_t> counts(_numPoints + 1, 0);
+    for (uint32_t i = 0; i < _numPoints; i++)
+    {
+        for (Eigen::SparseVector<float>::InnerIterator it(probabilities[i].memory()); it; ++it)
+        {
+            counts[i]++;
+            counts[it.index()]++;
+        }
+    }
+
+    std::vector<size_t> offsets(_numPoints + 1, 0);
+    std::exclusive_scan(counts.begin(), counts.end(), offsets.begin(), size_t{ 0 });
+
+    std::vector<uint32_t> columns(offsets.back());
+    std::vector<float> values(offsets.back());
+    {
+        std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (uint32_t i = 0; i < _numPoints; i++)
+        {
+            for (Eigen::SparseVector<float>::InnerIterator it(probabilities[i].memory()); it; ++it)
+            {
+                const auto j = static_cast<uint32_t>(it.index());
+                columns[fill[i]] = j;
+                values[fill[i]++] = it.value();
+                columns[fill[j]] = i;
+                values[fill[j]++] = it.value();
+            }
+        }
+    }
+
+    // merge duplicate entries per row, drop the diagonal
+    std::vector<size_t> mergedCounts(_numPoints + 1, 0);
+    utils::parallel_for(_numPoints, [&](const uint32_t i) {
+        std::vector<std::pair<uint32_t, float>> row;
+        row.reserve(offsets[i + 1] - offsets[i]);
+        for (size_t e = offsets[i]; e < offsets[i + 1]; e++)
+            if (columns[e] != i)
+                row.emplace_back(columns[e], values[e]);
+
+        std::sort(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        size_t pos = offsets[i];
+        for (size_t e = 0; e < row.size(); e++)
+        {
+            if (e > 0 && row[e].first == row[e - 1].first)
+            {
+                values[pos - 1] += row[e].second;
+                continue;
+            }
+            columns[pos] = row[e].first;
+            values[pos++] = row[e].second;
+        }
+        mergedCounts[i] = pos - offsets[i];
+        });
+
+    _probOffsets.assign(_numPoints + 1, 0);
+    std::exclusive_scan(mergedCounts.begin(), mergedCounts.end(), _probOffsets.begin(), size_t{ 0 });
+
+    _probColumns.resize(_probOffsets.back());
+    _probValues.resize(_probOffsets.back());
+    utils::parallel_for(_numPoints, [&](const uint32_t i) {
+        std::copy_n(columns.begin() + offsets[i], mergedCounts[i], _probColumns.begin() + _probOffsets[i]);
+        std::copy_n(values.begin() + offsets[i], mergedCounts[i], _probValues.begin() + _probOffsets[i]);
+        });
+
+    // normalize such that all probabilities sum to 1
+    const double sum = std::accumulate(_probValues.begin(), _probValues.end(), 0.0);
+    if (sum > 0)
+    {
+        const float scale = static_cast<float>(1.0 / sum);
+        utils::parallel_for(_probValues.size(), [&](const size_t e) {
+            _probValues[e] *= scale;
+            });
+    }
+}
+
+void TsneGradientDescentCPU::buildTree(const std::vector<float>& positions, QuadTree& tree)
+{
+    const auto numPoints = static_cast<uint32_t>(positions.size() / 2);
+
+    tree.nodes.clear();
+    if (numPoints == 0)
+    {
+        tree.mortonOrder.clear();
+        tree.sortedPositions.clear();
+        return;
+    }
+
+    float minX = std::numeric_limits<float>::max(), minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest(), maxY = std::numeric_limits<float>::lowest();
+    for (uint32_t i = 0; i < numPoints; i++)
+    {
+        minX = std::min(minX, positions[2 * i]);
+        maxX = std::max(maxX, positions[2 * i]);
+        minY = std::min(minY, positions[2 * i + 1]);
+        maxY = std::max(maxY, positions[2 * i + 1]);
+    }
+
+    // square root cell, slightly enlarged such that the maximum falls into the last grid cell
+    // the lower bound keeps gridScale finite, a single or only coincident points all fall into the first grid cell
+    const float width = std::max(std::max(maxX - minX, maxY - minY) * 1.0001f, std::numeric_limits<float>::min() * static_cast<float>(1u << MAX_TREE_DEPTH));
+    const float gridScale = static_cast<float>(1u << MAX_TREE_DEPTH) / width;
+    const uint32_t maxGridCoord = (1u << MAX_TREE_DEPTH) - 1;
+
+    tree.mortonOrder.resize(numPoints);
+    utils::parallel_for(numPoints, [&](const uint32_t i) {
+        const auto gridX = std::min(maxGridCoord, static_cast<uint32_t>((positions[2 * i] - minX) * gridScale));
+        const auto gridY = std::min(maxGridCoord, static_cast<uint32_t>((positions[2 * i + 1] - minY) * gridScale));
+        tree.mortonOrder[i] = { spreadBits(gridX) | (spreadBits(gridY) << 1), i };
+        });
+
+    utils::parallel_sort(tree.mortonOrder.begin(), tree.mortonOrder.end());
+
+    tree.sortedPositions.resize(2ull * numPoints);
+    utils::parallel_for(numPoints, [&](const uint32_t k) {
+        const uint32_t i = tree.mortonOrder[k].second;
+        tree.sortedPositions[2 * k] = positions[2 * i];
+        tree.sortedPositions[2 * k + 1] = positions[2 * i + 1];
+        });
+
+    tree.nodes.push_back({ 0, 0, width, 0, numPoints, 0, 0 });
+    buildNode(tree, 0, 0, numPoints, 0);
+}
+
+void TsneGradientDescentCPU::buildNode(QuadTree& tree, const uint32_t nodeIndex, const uint32_t begin, const uint32_t end, const uint32_t depth)
+{
+    const uint32_t numNodePoints = end - begin;
+
+    if (numNodePoints <= MAX_LEAF_SIZE || depth == MAX_TREE_DEPTH)
+    {
+        double sumX = 0, sumY = 0;
+        for (uint32_t k = begin; k < end; k++)
+        {
+            sumX += tree.sortedPositions[2 * k];
+            sumY += tree.sortedPositions[2 * k + 1];
+        }
+
+        tree.nodes[nodeIndex].centerOfMassX = static_cast<float>(sumX / numNodePoints);
+        tree.nodes[nodeIndex].centerOfMassY = static_cast<float>(sumY / numNodePoints);
+        return;
+    }
+
+    // points are sorted by Morton code, the quadrants on this level are consecutive ranges
+    const uint32_t shift = 2 * (MAX_TREE_DEPTH - 1 - depth);
+    uint32_t bounds[5] = { begin, 0, 0, 0, end };
+    for (uint32_t quadrant = 1; quadrant < 4; quadrant++)
+    {
+        const auto it = std::partition_point(tree.mortonOrder.begin() + bounds[quadrant - 1], tree.mortonOrder.begin() + end, [shift, quadrant](const auto& entry) {
+            return ((entry.first >> shift) & 3u) < quadrant;
+            });
+        bounds[quadrant] = static_cast<uint32_t>(it - tree.mortonOrder.begin());
+    }
+
+    const auto firstChild = static_cast<uint32_t>(tree.nodes.size());
+    const float childWidth = tree.nodes[nodeIndex].width / 2;
+
+    uint32_t numChildren = 0;
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++)
+        if (bounds[quadrant + 1] > bounds[quadrant])
+        {
+            tree.nodes.push_back({ 0, 0, childWidth, bounds[quadrant], bounds[quadrant + 1], 0, 0 });
+            numChildren++;
+        }
+
+    tree.nodes[nodeIndex].firstChild = firstChild;
+    tree.nodes[nodeIndex].numChildren = numChildren;
+
+    // center of mass from the children
+    double sumX = 0, sumY = 0;
+    for (uint32_t child = firstChild; child < firstChild + numChildren; child++)
+    {
+        const uint32_t childBegin = tree.nodes[child].begin;
+        const uint32_t childEnd = tree.nodes[child].end;
+        buildNode(tree, child, childBegin, childEnd, depth + 1);
+
+        sumX += static_cast<double>(tree.nodes[child].centerOfMassX) * (childEnd - childBegin);
+        sumY += static_cast<double>(tree.nodes[child].centerOfMassY) * (childEnd - childBegin);
+    }
+
+    tree.nodes[nodeIndex].centerOfMassX = static_cast<float>(sumX / numNodePoints);
+    tree.nodes[nodeIndex].centerOfMassY = static_cast<float>(sumY / numNodePoints);
+}
+
+void TsneGradientDescentCPU::accumulateRepulsion(const QuadTree& tree, const float pointX, const float pointY, const uint32_t skip, double& normalization, double& forceX, double& forceY) const
+{
+    if (tree.nodes.empty())
+        return;
+
+    const float theta2 = _theta * _theta;
+
+    // depth first traversal, at most 3 siblings per level wait on the stack
+    uint32_t stack[4 * MAX_TREE_DEPTH + 4];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const QuadTreeNode& node = tree.nodes[stack[--stackSize]];
+
+        const float dx = pointX - node.centerOfMassX;
+        const float dy = pointY - node.centerOfMassY;
+        const float dist2 = dx * dx + dy * dy;
+
+        // summarize the cell, except the cells containing the point itself: with theta >= 1/sqrt(2)
+        // the criterion alone could also hold for these, which would add the point's self-interaction
+        const bool containsPoint = node.begin <= skip && skip < node.end;
+        if (!containsPoint && node.width * node.width < theta2 * dist2)
+        {
+            const float numNodePoints = static_cast<float>(node.end - node.begin);
+            const float q = 1.0f / (1.0f + dist2);
+            normalization += numNodePoints * q;
+            forceX += numNodePoints * q * q * dx;
+            forceY += numNodePoints * q * q * dy;
+            continue;
+        }
+
+        if (node.numChildren == 0)
+        {
+            for (uint32_t m = node.begin; m < node.end; m++)
+            {
+                if (m == skip)
+                    continue;
+
+                const float px = pointX - tree.sortedPositions[2 * m];
+                const float py = pointY - tree.sortedPositions[2 * m + 1];
+                const float q = 1.0f / (1.0f + px * px + py * py);
+                normalization += q;
+                forceX += q * q * px;
+                forceY += q * q * py;
+            }
+            continue;
+        }
+
+        for (uint32_t child = node.firstChild; child < node.firstChild + node.numChildren; child++)
+            stack[stackSize++] = child;
+    }
+}
+
+double TsneGradientDescentCPU::computeRepulsiveForcesBarnesHut()
+{
+    buildTree(_embedding->getContainer(), _tree);
+    _normalizationTerms.resize(_numPoints);
+
+    // iterate in Morton order: neighboring points traverse similar parts of the tree
+    utils::parallel_for(_numPoints, [&](const uint32_t k) {
+        double normalization = 0, forceX = 0, forceY = 0;
+        accumulateRepulsion(_tree, _tree.sortedPositions[2 * k], _tree.sortedPositions[2 * k + 1], k, normalization, forceX, forceY);
+
+        const uint32_t i = _tree.mortonOrder[k].second;
+        _repulsiveForces[2 * i] = static_cast<float>(forceX);
+        _repulsiveForces[2 * i + 1] = static_cast<float>(forceY);
+        _normalizationTerms[k] = normalization;
+        });
+
+    // sequential sum: same result for any number of threads
+    return std::accumulate(_normalizationTerms.begin(), _normalizationTerms.end(), 0.0);
+}
+
+double TsneGradientDescentCPU::computeRepulsiveForcesAnchored()
+{
+    const std::vector<float>& positions = _embedding->getContainer();
+    const auto numMobile = static_cast<uint32_t>(_mobilePoints.size());
+
+    _mobilePositions.resize(2ull * numMobile);
+    utils::parallel_for(numMobile, [&](const uint32_t n) {
+        _mobilePositions[2 * n] = positions[2 * _mobilePoints[n]];
+        _mobilePositions[2 * n + 1] = positions[2 * _mobilePoints[n] + 1];
+        });
+
+    buildTree(_mobilePositions, _mobileTree);
+    _normalizationTerms.resize(numMobile);
+
+    utils::parallel_for(numMobile, [&](const uint32_t k) {
+        const float pointX = _mobileTree.sortedPositions[2 * k];
+        const float pointY = _mobileTree.sortedPositions[2 * k + 1];
+
+        double normalizationMobile = 0, normalizationFrozen = 0, forceX = 0, forceY = 0;
+        accumulateRepulsion(_mobileTree, pointX, pointY, k, normalizationMobile, forceX, forceY);
+        accumulateRepulsion(_frozenTree, pointX, pointY, std::numeric_limits<uint32_t>::max(), normalizationFrozen, forceX, forceY);
+
+        const uint32_t i = _mobilePoints[_mobileTree.mortonOrder[k].second];
+        _repulsiveForces[2 * i] = static_cast<float>(forceX);
+        _repulsiveForces[2 * i + 1] = static_cast<float>(forceY);
+
+        // pairs of a mobile and a frozen point appear twice in the normalization
+        _normalizationTerms[k] = normalizationMobile + 2 * normalizationFrozen;
+        });
+
+    return _frozenNormalization + std::accumulate(_normalizationTerms.begin(), _normalizationTerms.end(), 0.0);
+}
+
+void TsneGradientDescentCPU::computeAttractiveForces()
+{
+    const std::vector<float>& positions = _embedding->getContainer();
+
+    // only the mobile points move in the anchored phase
+    const bool anchored = isAnchored();
+    const auto numUpdated = anchored ? static_cast<uint32_t>(_mobilePoints.size()) : _numPoints;
+
+    utils::parallel_for(numUpdated, [&](const uint32_t n) {
+        const uint32_t i = anchored ? _mobilePoints[n] : n;
+        const float pointX = positions[2 * i];
+        const float pointY = positions[2 * i + 1];
+
+        float forceX = 0, forceY = 0;
+        for (size_t e = _probOffsets[i]; e < _probOffsets[i + 1]; e++)
+        {
+            const uint32_t j = _probColumns[e];
+            const float dx = pointX - positions[2 * j];
+            const float dy = pointY - positions[2 * j + 1];
+            const float pq = _probValues[e] / (1.0f + dx * dx + dy * dy);
+            forceX += pq * dx;
+            forceY += pq * dy;
+        }
+
+        _attractiveForces[2 * i] = forceX;
+        _attractiveForces[2 * i + 1] = forceY;
+        });
+}
+
+void TsneGradientDescentCPU::updateEmbedding(const double exaggeration, const double normalization)
+{
+    std::vector<float>& positions = _embedding->getContainer();
+
+    const float momentum = static_cast<float>((_iteration < static_cast<uint32_t>(_params._mom_switching_iter)) ? _params._momentum : _params._final_momentum);
+    const float eta = static_cast<float>(_params._eta);
+    const float minGain = static_cast<float>(_params._minimum_gain);
+    const float exag = static_cast<float>(exaggeration);
+    const float invNormalization = (normalization > 0) ? static_cast<float>(1.0 / normalization) : 0.0f;
+
+    const bool anchored = isAnchored();
+    const size_t numUpdated = anchored ? _mobilePoints.size() : _numPoints;
+
+    utils::parallel_for(2 * numUpdated, [&](const size_t n) {
+        const size_t d = anchored ? 2ull * _mobilePoints[n / 2] + n % 2 : n;
+        const float gradient = 4.0f * (exag * _attractiveForces[d] - _repulsiveForces[d] * invNormalization);
+
+        // gains increase if the gradient changes direction w.r.t. the last update
+        float gain = ((gradient > 0) != (_update[d] > 0)) ? _gains[d] + 0.2f : _gains[d] * 0.8f;
+        gain = std::max(gain, minGain);
+        _gains[d] = gain;
+
+        _update[d] = momentum * _update[d] - eta * gain * gradient;
+        if (anchored)
+            _update[d] *= _mobility[d / 2];   // damped steps, also damps the momentum
+
+        positions[d] += _update[d];
+        });
+}
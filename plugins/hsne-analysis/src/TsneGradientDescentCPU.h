@@ -0,0 +1,163 @@
+#pragma once
+
+#include "CommonTypes.h"
+#include "TsneRepulsionExact.h"
+#include "TsneRepulsionFFT.h"
+
+#include "hdi/data/embedding.h"
+#include "hdi/dimensionality_reduction/tsne_parameters.h"
+
+#include <cstdint>
+#include <limits>
+#include <utility>      // pair
+#include <vector>
+
+/**
+ * TsneGradientDescentCPU
+ *
+ * Multithreaded t-SNE gradient descent on the CPU for 2D embeddings, needs no OpenGL context.
+ * Uses the same interface and optimization schedule (exaggeration, momentum and gains) as
+ * hdi::dr::GradientDescentTSNETexture, such that both can be used interchangeably.
+ *
+ * Repulsive forces are approximated with either
+ *  - Barnes-Hut: points are sorted along a Morton (z-order) curve and a quadtree is built over the sorted points.
+ *    Cells which appear small from a point, i.e. cell width / distance < theta, are treated as a single point at their center of mass.
+ *  - FFT: interpolation on a grid and FFT convolution, see TsneRepulsionFFT. Scales near-linearly with the number of points.
+ *  - Exact: all pairs with SIMD kernels, see TsneRepulsionExact. Fastest for small embeddings.
+ * Points can be anchored for a first phase, see setMobility: only mobile points are optimized and the repulsion of the frozen points
+ * comes from a Barnes-Hut quadtree that is built once, so these iterations scale with the number of mobile points.
+ * Forces of all points are computed in parallel, with a fixed summation order per point, so the
+ * result does not depend on the number of threads.
+ */
+class TsneGradientDescentCPU
+{
+public:
+    enum class Repulsion
+    {
+        BarnesHut,
+        FFT,
+        Exact,
+    };
+
+public:
+    TsneGradientDescentCPU();
+
+    /** Approximation of the repulsive forces. Default: Barnes-Hut */
+    void setRepulsion(const Repulsion repulsion) { _repulsion = repulsion; }
+    Repulsion getRepulsion() const { return _repulsion; }
+
+    /** Barnes-Hut accuracy, 0 computes the exact repulsive forces. Default: 0.5 */
+    void setTheta(const float theta) { _theta = theta; }
+    float getTheta() const { return _theta; }
+
+    /**
+     * Symmetrize the probabilities and initialize the embedding: random if params._presetEmbedding is false,
+     * otherwise the embedding is used as is.
+     * Returns false if the embedding is not 2D
+     */
+    bool initialize(const HsneMatrix& probabilities, hdi::data::Embedding<float>* embedding, const hdi::dr::TsneParameters& params);
+
+    /**
+     * Exchange the points of an initialized gradient descent, e.g. for the landmarks of a scale update.
+     * previousIndices[i] is the index of point i before the update, or NEW_POINT. Remaining points keep their gains
+     * and momentum, new points start like after initialize(). The embedding is set to positions and the schedule restarts with params.
+     * Returns false if the sizes do not match
+     */
+    bool replacePoints(const HsneMatrix& probabilities, const std::vector<float>& positions, const std::vector<uint32_t>& previousIndices, const hdi::dr::TsneParameters& params);
+
+    /**
+     * Anchor points during the first anchoredIterations iterations: point i moves with mobility[i] times its regular step,
+     * points with mobility 0 are frozen. Uses the Barnes-Hut approximation during this phase, regardless of setRepulsion.
+     * Call after initialize(), returns false if the mobility does not match the number of points
+     */
+    bool setMobility(const std::vector<float>& mobility, const uint32_t anchoredIterations);
+
+    void doAnIteration();
+
+    uint32_t iteration() const { return _iteration; }
+
+    /** Exaggeration of the attractive forces in the current iteration */
+    double exaggerationFactor() const;
+
+public:
+    static constexpr uint32_t NEW_POINT = std::numeric_limits<uint32_t>::max();
+
+private:
+    /** P_ij = (p_j|i + p_i|j) / sum, stored in CSR format */
+    void computeSymmetricProbabilities(const HsneMatrix& probabilities);
+
+    struct QuadTreeNode
+    {
+        float       centerOfMassX;
+        float       centerOfMassY;
+        float       width;          /** Side length of the (square) cell */
+        uint32_t    begin;          /** Range of points in Morton order */
+        uint32_t    end;
+        uint32_t    firstChild;     /** Children are stored consecutively, only non-empty children exist */
+        uint32_t    numChildren;    /** 0 for leaves */
+    };
+
+    struct QuadTree
+    {
+        std::vector<std::pair<uint64_t, uint32_t>> mortonOrder;     /** (Morton code, point index), sorted */
+        std::vector<float>                      sortedPositions;    /** Positions in Morton order */
+        std::vector<QuadTreeNode>               nodes;              /** nodes[0] is the root, empty without points */
+    };
+
+    /** Sort points along a Morton curve and build the quadtree over them */
+    static void buildTree(const std::vector<float>& positions, QuadTree& tree);
+    static void buildNode(QuadTree& tree, const uint32_t nodeIndex, const uint32_t begin, const uint32_t end, const uint32_t depth);
+
+    /** Add the Barnes-Hut approximation of the repulsion of all tree points except skip (in Morton order) on a point */
+    void accumulateRepulsion(const QuadTree& tree, const float pointX, const float pointY, const uint32_t skip, double& normalization, double& forceX, double& forceY) const;
+
+    /** Barnes-Hut approximation of the repulsive forces, returns the normalization sum_ij (1 + |y_i - y_j|^2)^-1 */
+    double computeRepulsiveForcesBarnesHut();
+
+    /** Repulsive forces on the mobile points, frozen points contribute through _frozenTree, returns the normalization of all points */
+    double computeRepulsiveForcesAnchored();
+    void computeAttractiveForces();
+
+    void updateEmbedding(const double exaggeration, const double normalization);
+
+    bool isAnchored() const { return _iteration < _anchoredIterations; }
+
+private:
+
+    static constexpr uint32_t               MAX_TREE_DEPTH = 20;    /** Morton codes use 20 bits per axis */
+    static constexpr uint32_t               MAX_LEAF_SIZE = 8;
+
+    hdi::dr::TsneParameters                 _params;
+    hdi::data::Embedding<float>*            _embedding;             /** Positions, [x0, y0, x1, y1, ...] */
+    uint32_t                                _numPoints;
+    uint32_t                                _iteration;
+    float                                   _theta;
+    Repulsion                               _repulsion;
+
+    // symmetric probabilities, CSR
+    std::vector<size_t>                     _probOffsets;
+    std::vector<uint32_t>                   _probColumns;
+    std::vector<float>                      _probValues;
+
+    // optimizer state, per coordinate
+    std::vector<float>                      _gains;
+    std::vector<float>                      _update;                /** Previous update, for momentum */
+    std::vector<float>                      _attractiveForces;
+    std::vector<float>                      _repulsiveForces;
+
+    // Barnes-Hut quadtree
+    QuadTree                                _tree;
+    std::vector<double>                     _normalizationTerms;    /** Per point contribution to the normalization, in Morton order */
+
+    // anchored phase
+    uint32_t                                _anchoredIterations;
+    std::vector<float>                      _mobility;
+    std::vector<uint32_t>                   _mobilePoints;          /** Points with mobility > 0 */
+    std::vector<float>                      _mobilePositions;
+    QuadTree                                _mobileTree;            /** Rebuilt every iteration */
+    QuadTree                                _frozenTree;            /** Built once, frozen points do not move */
+    double                                  _frozenNormalization;   /** Normalization among the frozen points */
+
+    TsneRepulsionFFT                        _repulsionFFT;
+    TsneRepulsionExact                      _repulsionExact;
+};
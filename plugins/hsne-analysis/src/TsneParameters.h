@@ -3,8 +3,32 @@
 #include "hdi/dimensionality_reduction/knn_utils.h"
 
 #include <algorithm>
+#include <cmath>
+#include <string>
 #include "Utils.h"
 
+/*! Gradient descent implementation used for the t-SNE embedding */
+enum class GradientDescentType
+{
+    GPU = 0,                /** HDILib compute shaders, requires an OpenGL context */
+    CPU_BarnesHut = 1,      /** Multithreaded Barnes-Hut, see TsneGradientDescentCPU */
+    CPU_FFT = 2,            /** Multithreaded FFT-accelerated interpolation, for large embeddings, see TsneRepulsionFFT */
+    CPU_Exact = 3,          /** Multithreaded SIMD kernel over all pairs, for small embeddings, see TsneRepulsionExact */
+    Automatic = 4,          /** Select by number of points, see TsneParameters::selectGradientDescentType */
+};
+
+inline std::string gradientDescentTypeName(const GradientDescentType type)
+{
+    switch (type)
+    {
+    case GradientDescentType::GPU:              return "GPU";
+    case GradientDescentType::CPU_BarnesHut:    return "CPU (Barnes-Hut)";
+    case GradientDescentType::CPU_FFT:          return "CPU (FFT)";
+    case GradientDescentType::CPU_Exact:        return "CPU (exact)";
+    default:                                    return "Automatic";
+    }
+}
+
 class TsneParameters
 {
 public:
@@ -22,7 +46,16 @@ public:
         _numDimensionsOutput(2),
         _exaggerationFactor(-1), // -1 means not set by user and we'll use a heuristic instead, see TsneAnalysis.cpp
         _hasPresetEmbedding(false),
-        _publishExtendsAtIteration(0)   // 0 means nothing will be published
+        _publishExtendsAtIteration(0),  // 0 means nothing will be published
+        _gradientDescentType(GradientDescentType::Automatic),
+        _barnesHutTheta(0.5f),
+        _exactGradientDescentThreshold(5000),   // calibrated with FunctionTests "[benchmark]"
+        _fftGradientDescentThreshold(25000),
+        _convergenceTolerance(0.0005f),
+        _convergenceCheckInterval(10),
+        _learningRate(200),             // HDILib default
+        _anchoredIterations(100),
+        _anchorMobility(0)
     {
 
     }
@@ -56,6 +89,15 @@ public:
     void setNumDimensionsOutput(uint32_t numDimensionsOutput) { _numDimensionsOutput = numDimensionsOutput; }
     void setHasPresetEmbedding(bool hasPresetEmbedding) { _hasPresetEmbedding = hasPresetEmbedding; }
     void setPublishExtendsAtIteration(uint32_t publishExtendsAtIteration) { _publishExtendsAtIteration = publishExtendsAtIteration; }
+    void setGradientDescentType(GradientDescentType gradientDescentType) { _gradientDescentType = gradientDescentType; }
+    void setBarnesHutTheta(float theta) { _barnesHutTheta = std::max(theta, 0.0f); }
+    void setExactGradientDescentThreshold(uint32_t numPoints) { _exactGradientDescentThreshold = numPoints; }
+    void setFFTGradientDescentThreshold(uint32_t numPoints) { _fftGradientDescentThreshold = numPoints; }
+    void setConvergenceTolerance(float tolerance) { _convergenceTolerance = std::max(tolerance, 0.0f); }
+    void setConvergenceCheckInterval(uint32_t numIterations) { _convergenceCheckInterval = std::max(numIterations, 1u); }
+    void setLearningRate(double learningRate) { _learningRate = std::max(learningRate, 0.0); }
+    void setAnchoredIterations(uint32_t numIterations) { _anchoredIterations = numIterations; }
+    void setAnchorMobility(float mobility) { _anchorMobility = std::clamp(mobility, 0.0f, 1.0f); }
 
     hdi::dr::knn_library getKnnAlgorithm() { return _knnLibrary; }
     hdi::dr::knn_distance_metric getKnnDistanceMetric() { return _knnDistanceMetric; }
@@ -71,6 +113,58 @@ public:
     uint32_t getNumDimensionsOutput() { return _numDimensionsOutput; }
     bool getHasPresetEmbedding() { return _hasPresetEmbedding; }
     uint32_t getPublishExtendsAtIteration() { return _publishExtendsAtIteration; }
+    GradientDescentType getGradientDescentType() const { return _gradientDescentType; }
+    float getBarnesHutTheta() const { return _barnesHutTheta; }
+    uint32_t getExactGradientDescentThreshold() const { return _exactGradientDescentThreshold; }
+    uint32_t getFFTGradientDescentThreshold() const { return _fftGradientDescentThreshold; }
+    float getConvergenceTolerance() const { return _convergenceTolerance; }
+    uint32_t getConvergenceCheckInterval() const { return _convergenceCheckInterval; }
+    double getLearningRate() const { return _learningRate; }
+    uint32_t getAnchoredIterations() const { return _anchoredIterations; }
+    float getAnchorMobility() const { return _anchorMobility; }
+
+    /*! Implementation used for an embedding of numPoints points
+     * Automatic uses the exact CPU kernel below the exact threshold, where the setup of the approximations dominates,
+     * otherwise the GPU if an OpenGL context is available.
+     * Without OpenGL, GPU and Automatic fall back to CPU Barnes-Hut, or CPU FFT from the FFT threshold on.
+    */
+    GradientDescentType selectGradientDescentType(uint32_t numPoints, bool hasOpenGLContext) const
+    {
+        if (_gradientDescentType == GradientDescentType::Automatic && numPoints < _exactGradientDescentThreshold)
+            return GradientDescentType::CPU_Exact;
+
+        if (_gradientDescentType != GradientDescentType::GPU && _gradientDescentType != GradientDescentType::Automatic)
+            return _gradientDescentType;
+
+        if (hasOpenGLContext)
+            return GradientDescentType::GPU;
+
+        return (numPoints < _fftGradientDescentThreshold) ? GradientDescentType::CPU_BarnesHut : GradientDescentType::CPU_FFT;
+    }
+
+    /*! Shorten the schedule for an embedding that is initialized mostly from a previous embedding
+     * The novelty of the initialization is the fraction of randomly placed points plus half the fraction of
+     * interpolated points, which start close to their neighbors. Exaggeration and its decay, and with them the
+     * momentum switch, scale with the novelty and are dropped for a novelty of zero. The number of iterations and
+     * the learning rate scale down to MIN_ITERATION_FRACTION and MIN_LEARNING_RATE_FRACTION, such that
+     * an embedding of reused points gets a short refinement while a random initialization keeps the full schedule.
+    */
+    void adaptScheduleToInitialization(const float fractionInterpolated, const float fractionRandom)
+    {
+        const double novelty = std::clamp(fractionRandom + 0.5 * fractionInterpolated, 0.0, 1.0);
+
+        _exaggerationIter = static_cast<uint32_t>(std::lround(_exaggerationIter * novelty));
+        _exponentialDecayIter = static_cast<uint32_t>(std::lround(_exponentialDecayIter * novelty));
+        if (_exaggerationIter == 0 && _exponentialDecayIter == 0)
+            _exaggerationFactor = 1;
+
+        _numIterations = std::max(static_cast<uint32_t>(std::lround(_numIterations * std::max(novelty, MIN_ITERATION_FRACTION))), 1u);
+        _learningRate *= MIN_LEARNING_RATE_FRACTION + (1.0 - MIN_LEARNING_RATE_FRACTION) * novelty;
+    }
+
+public:
+    static constexpr double MIN_ITERATION_FRACTION = 0.25;
+    static constexpr double MIN_LEARNING_RATE_FRACTION = 0.5;
 
 private:
     hdi::dr::knn_library _knnLibrary;
@@ -86,6 +180,15 @@ private:
     uint32_t _numDimensionsOutput;
     bool _hasPresetEmbedding;
     uint32_t _publishExtendsAtIteration;
+    GradientDescentType _gradientDescentType;
+    float _barnesHutTheta;          /** Accuracy of the Barnes-Hut approximation, 0 is exact */
+    uint32_t _exactGradientDescentThreshold;    /** Automatic: exact CPU kernel below this number of points */
+    uint32_t _fftGradientDescentThreshold;      /** CPU FFT instead of Barnes-Hut from this number of points on, if the GPU is not available */
+    float _convergenceTolerance;                /** Stop before the last iteration once the layout changes less than this per check, 0 disables, see ConvergenceMonitor */
+    uint32_t _convergenceCheckInterval;         /** Iterations between two convergence checks */
+    double _learningRate;
+    uint32_t _anchoredIterations;               /** Only points with a given mobility move in the first iterations, see TsneGradientDescentCPU::setMobility */
+    float _anchorMobility;                      /** Mobility of anchored points, 0 freezes them */
 
     bool _exactKnn;                 /** Compute Exact KNN instead of approximation */
 
@@ -0,0 +1,181 @@
+#include "TsneRepulsionExact.h"
+
+#include "Utils.h"
+
+#include <algorithm>    // min
+#include <numeric>      // accumulate
+
+// SIMD kernels are only available on x86-64, other platforms use the scalar kernel
+#if defined(__x86_64__) || defined(_M_X64)
+#define IHP_REPULSION_X86
+
+#include <immintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+// MSVC allows using intrinsics of any instruction set without setting /arch
+#define IHP_TARGET_AVX2
+#else
+// Compile kernels for an instruction set without setting it for the entire target
+#define IHP_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+#endif // x86-64
+
+namespace {
+
+    // Sums of (1 + d^2)^-1, (1 + d^2)^-2 dx and (1 + d^2)^-2 dy over points [0, numPoints), including the point itself
+    struct RepulsionSums
+    {
+        double normalization = 0;
+        double forceX = 0;
+        double forceY = 0;
+    };
+
+    using RepulsionKernel = RepulsionSums(*)(const float* xs, const float* ys, const size_t numPoints, const float pointX, const float pointY);
+
+    /// ////// ///
+    /// SCALAR ///
+    /// ////// ///
+    namespace scalar {
+
+        RepulsionSums repulsion(const float* xs, const float* ys, const size_t numPoints, const float pointX, const float pointY)
+        {
+            float normalization = 0, forceX = 0, forceY = 0;
+            for (size_t j = 0; j < numPoints; j++) {
+                const float dx = pointX - xs[j];
+                const float dy = pointY - ys[j];
+                const float q = 1.0f / (1.0f + dx * dx + dy * dy);
+                normalization += q;
+                forceX += q * q * dx;
+                forceY += q * q * dy;
+            }
+            return { normalization, forceX, forceY };
+        }
+
+    }
+
+#ifdef IHP_REPULSION_X86
+
+    inline float horizontalSum(const __m128 v)
+    {
+        __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 sums = _mm_add_ps(v, shuf);
+        shuf = _mm_movehl_ps(shuf, sums);
+        sums = _mm_add_ss(sums, shuf);
+        return _mm_cvtss_f32(sums);
+    }
+
+    /// ///////////// ///
+    /// SSE (128 bit) ///
+    /// ///////////// ///
+    namespace sse {
+
+        RepulsionSums repulsion(const float* xs, const float* ys, const size_t numPoints, const float pointX, const float pointY)
+        {
+            const size_t nSimd = numPoints - numPoints % 4;
+
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 px = _mm_set1_ps(pointX);
+            const __m128 py = _mm_set1_ps(pointY);
+            __m128 normalization = _mm_setzero_ps(), forceX = _mm_setzero_ps(), forceY = _mm_setzero_ps();
+            for (size_t j = 0; j < nSimd; j += 4) {
+                const __m128 dx = _mm_sub_ps(px, _mm_loadu_ps(xs + j));
+                const __m128 dy = _mm_sub_ps(py, _mm_loadu_ps(ys + j));
+                const __m128 q = _mm_div_ps(one, _mm_add_ps(one, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))));
+                const __m128 q2 = _mm_mul_ps(q, q);
+                normalization = _mm_add_ps(normalization, q);
+                forceX = _mm_add_ps(forceX, _mm_mul_ps(q2, dx));
+                forceY = _mm_add_ps(forceY, _mm_mul_ps(q2, dy));
+            }
+
+            const RepulsionSums tail = scalar::repulsion(xs + nSimd, ys + nSimd, numPoints - nSimd, pointX, pointY);
+            return { horizontalSum(normalization) + tail.normalization, horizontalSum(forceX) + tail.forceX, horizontalSum(forceY) + tail.forceY };
+        }
+
+    }
+
+    /// ////////////// ///
+    /// AVX2 (256 bit) ///
+    /// ////////////// ///
+    namespace avx2 {
+
+        IHP_TARGET_AVX2 inline float horizontalSum(const __m256 v)
+        {
+            return ::horizontalSum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+        }
+
+        IHP_TARGET_AVX2 RepulsionSums repulsion(const float* xs, const float* ys, const size_t numPoints, const float pointX, const float pointY)
+        {
+            const size_t nSimd = numPoints - numPoints % 8;
+
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 px = _mm256_set1_ps(pointX);
+            const __m256 py = _mm256_set1_ps(pointY);
+            __m256 normalization = _mm256_setzero_ps(), forceX = _mm256_setzero_ps(), forceY = _mm256_setzero_ps();
+            for (size_t j = 0; j < nSimd; j += 8) {
+                const __m256 dx = _mm256_sub_ps(px, _mm256_loadu_ps(xs + j));
+                const __m256 dy = _mm256_sub_ps(py, _mm256_loadu_ps(ys + j));
+                const __m256 q = _mm256_div_ps(one, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dx, dx, one)));
+                const __m256 q2 = _mm256_mul_ps(q, q);
+                normalization = _mm256_add_ps(normalization, q);
+                forceX = _mm256_fmadd_ps(q2, dx, forceX);
+                forceY = _mm256_fmadd_ps(q2, dy, forceY);
+            }
+
+            const RepulsionSums tail = scalar::repulsion(xs + nSimd, ys + nSimd, numPoints - nSimd, pointX, pointY);
+            return { horizontalSum(normalization) + tail.normalization, horizontalSum(forceX) + tail.forceX, horizontalSum(forceY) + tail.forceY };
+        }
+
+    }
+
+#endif // IHP_REPULSION_X86
+
+    RepulsionKernel selectKernel(const utils::SimdLevel level)
+    {
+        switch (level)
+        {
+#ifdef IHP_REPULSION_X86
+        case utils::SimdLevel::AVX512:  // wider registers do not pay off for the short per-point loops
+        case utils::SimdLevel::AVX2:    return &avx2::repulsion;
+        case utils::SimdLevel::SSE:     return &sse::repulsion;
+#endif
+        default:                        return &scalar::repulsion;
+        }
+    }
+
+}
+
+double TsneRepulsionExact::computeRepulsiveForces(const std::vector<float>& positions, std::vector<float>& forces)
+{
+    return computeRepulsiveForces(positions, forces, utils::getSimdLevel());
+}
+
+double TsneRepulsionExact::computeRepulsiveForces(const std::vector<float>& positions, std::vector<float>& forces, const utils::SimdLevel level)
+{
+    const size_t numPoints = positions.size() / 2;
+    forces.resize(2 * numPoints);
+
+    // Never use an instruction set that is not supported by the CPU
+    const RepulsionKernel kernel = selectKernel(static_cast<utils::SimdLevel>(std::min(static_cast<int>(level), static_cast<int>(utils::getSimdLevel()))));
+
+    _positionsX.resize(numPoints);
+    _positionsY.resize(numPoints);
+    for (size_t i = 0; i < numPoints; i++)
+    {
+        _positionsX[i] = positions[2 * i];
+        _positionsY[i] = positions[2 * i + 1];
+    }
+
+    _normalizationTerms.resize(numPoints);
+    utils::parallel_for(numPoints, [&](const size_t i) {
+        const RepulsionSums sums = kernel(_positionsX.data(), _positionsY.data(), numPoints, _positionsX[i], _positionsY[i]);
+
+        // the point itself adds 1 to the normalization and nothing to the forces
+        forces[2 * i] = static_cast<float>(sums.forceX);
+        forces[2 * i + 1] = static_cast<float>(sums.forceY);
+        _normalizationTerms[i] = sums.normalization - 1;
+        });
+
+    // sequential sum: same result for any number of threads
+    return std::accumulate(_normalizationTerms.begin(), _normalizationTerms.end(), 0.0);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "DistanceKernels.h"
+
+#include <vector>
+
+/**
+ * TsneRepulsionExact
+ *
+ * Exact repulsive t-SNE forces, sums over all pairs of points with SIMD kernels.
+ * Needs no setup, so for small embeddings it is faster than the Barnes-Hut and FFT approximations.
+ * Points are processed in parallel, each with a fixed summation order.
+ */
+class TsneRepulsionExact
+{
+public:
+    /**
+     * Unnormalized repulsive forces sum_j (1 + |y_i - y_j|^2)^-2 (y_i - y_j) for all points
+     * \param positions 2D positions [x0, y0, x1, y1, ...]
+     * \param forces output, same layout as positions
+     * \param level instruction set, clamped to utils::getSimdLevel()
+     * \return normalization sum_{i != j} (1 + |y_i - y_j|^2)^-1
+     */
+    double computeRepulsiveForces(const std::vector<float>& positions, std::vector<float>& forces);
+    double computeRepulsiveForces(const std::vector<float>& positions, std::vector<float>& forces, const utils::SimdLevel level);
+
+private:
+    std::vector<float>              _positionsX;                /** Positions as structure of arrays, for contiguous SIMD loads */
+    std::vector<float>              _positionsY;
+    std::vector<double>             _normalizationTerms;        /** Per point contribution to the normalization */
+};
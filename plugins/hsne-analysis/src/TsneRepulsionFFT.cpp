@@ -0,0 +1,297 @@
+#include "TsneRepulsionFFT.h"
+
+#include "Utils.h"
+
+#include <algorithm>    // min, max, fill
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <numeric>      // accumulate, exclusive_scan
+
+namespace {
+
+    constexpr size_t COLUMN_BLOCK_SIZE = 16;   // columns transformed together, for contiguous reads of the grid
+
+    // std::complex multiplication checks for inf/nan, which makes it several times slower
+    inline std::complex<double> multiply(const std::complex<double>& a, const std::complex<double>& b)
+    {
+        return { a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real() };
+    }
+
+    size_t nextPowerOfTwo(const size_t v)
+    {
+        size_t p = 1;
+        while (p < v)
+            p <<= 1;
+        return p;
+    }
+
+    // Lagrange polynomials through the nodes (k + 0.5) / n, k = 0..n-1, evaluated at t in [0, 1]
+    void lagrangeWeights(const double t, double* weights)
+    {
+        constexpr uint32_t n = TsneRepulsionFFT::INTERPOLATION_NODES;
+        for (uint32_t k = 0; k < n; k++)
+        {
+            const double nodeK = (k + 0.5) / n;
+            double w = 1;
+            for (uint32_t m = 0; m < n; m++)
+            {
+                if (m == k)
+                    continue;
+                const double nodeM = (m + 0.5) / n;
+                w *= (t - nodeM) / (nodeK - nodeM);
+            }
+            weights[k] = w;
+        }
+    }
+
+}
+
+TsneRepulsionFFT::TsneRepulsionFFT() :
+    _fftSize(0),
+    _numNodesPerDim(0)
+{
+}
+
+double TsneRepulsionFFT::computeRepulsiveForces(const std::vector<float>& positions, std::vector<float>& forces)
+{
+    constexpr uint32_t p = INTERPOLATION_NODES;
+
+    const size_t numPoints = positions.size() / 2;
+    forces.assign(2 * numPoints, 0.0f);
+
+    if (numPoints < 2)
+        return 0;
+
+    float minX = std::numeric_limits<float>::max(), minY = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest(), maxY = std::numeric_limits<float>::lowest();
+    for (size_t i = 0; i < numPoints; i++)
+    {
+        minX = std::min(minX, positions[2 * i]);
+        maxX = std::max(maxX, positions[2 * i]);
+        minY = std::min(minY, positions[2 * i + 1]);
+        maxY = std::max(maxY, positions[2 * i + 1]);
+    }
+
+    // square grid, slightly enlarged such that the maximum falls into the last box
+    const double range = std::max(std::max<double>(maxX - minX, maxY - minY) * 1.0001, 1e-6);
+
+    // use all boxes that fit into the padded power of two FFT grid
+    const auto minNumBoxes = std::max<size_t>(MIN_NUM_BOXES, static_cast<size_t>(std::ceil(range * BOXES_PER_UNIT)));
+    const size_t fftSize = std::min(nextPowerOfTwo(2 * p * minNumBoxes), MAX_FFT_SIZE);
+    const size_t numBoxes = fftSize / (2 * p);
+    const size_t numNodes = numBoxes * p;
+
+    if (fftSize != _fftSize)
+    {
+        _fftSize = fftSize;
+        _twiddles.resize(_fftSize / 2);
+        for (size_t k = 0; k < _fftSize / 2; k++)
+            _twiddles[k] = std::polar(1.0, -2.0 * std::numbers::pi * k / _fftSize);
+
+        _kernel.resize(_fftSize * _fftSize);
+        _chargesUnit.resize(_fftSize * _fftSize);
+        _chargesPosition.resize(_fftSize * _fftSize);
+    }
+    _numNodesPerDim = numNodes;
+
+    const double boxWidth = range / numBoxes;
+    const double nodeSpacing = boxWidth / p;
+
+    // positions relative to the grid center keep y_i sum_j q_ij^2 and sum_j q_ij^2 y_j small
+    const double centerX = minX + range / 2;
+    const double centerY = minY + range / 2;
+
+    // sort points by box
+    _boxOfPoint.resize(numPoints);
+    _weights.resize(numPoints * 2 * p);
+    utils::parallel_for(numPoints, [&](const size_t i) {
+        const double gridX = (positions[2 * i] - minX) / boxWidth;
+        const double gridY = (positions[2 * i + 1] - minY) / boxWidth;
+        const auto boxX = std::min(numBoxes - 1, static_cast<size_t>(gridX));
+        const auto boxY = std::min(numBoxes - 1, static_cast<size_t>(gridY));
+        _boxOfPoint[i] = static_cast<uint32_t>(boxY * numBoxes + boxX);
+
+        lagrangeWeights(gridX - boxX, &_weights[i * 2 * p]);
+        lagrangeWeights(gridY - boxY, &_weights[i * 2 * p + p]);
+        });
+
+    _boxOffsets.assign(numBoxes * numBoxes + 1, 0);
+    for (size_t i = 0; i < numPoints; i++)
+        _boxOffsets[_boxOfPoint[i]]++;
+    std::exclusive_scan(_boxOffsets.begin(), _boxOffsets.end(), _boxOffsets.begin(), uint32_t{ 0 });
+
+    _pointOrder.resize(numPoints);
+    {
+        std::vector<uint32_t> fill(_boxOffsets.begin(), _boxOffsets.end() - 1);
+        for (size_t i = 0; i < numPoints; i++)
+            _pointOrder[fill[_boxOfPoint[i]]++] = static_cast<uint32_t>(i);
+    }
+
+    // 1. spread charges 1 and y to the nodes, boxes do not share nodes
+    utils::parallel_for(_fftSize, [&](const size_t row) {
+        std::fill_n(_chargesUnit.begin() + row * _fftSize, _fftSize, Complex(0, 0));
+        std::fill_n(_chargesPosition.begin() + row * _fftSize, _fftSize, Complex(0, 0));
+        });
+
+    utils::parallel_for(numBoxes * numBoxes, [&](const size_t box) {
+        const size_t firstNodeX = (box % numBoxes) * p;
+        const size_t firstNodeY = (box / numBoxes) * p;
+
+        for (uint32_t k = _boxOffsets[box]; k < _boxOffsets[box + 1]; k++)
+        {
+            const uint32_t i = _pointOrder[k];
+            const double x = positions[2 * i] - centerX;
+            const double y = positions[2 * i + 1] - centerY;
+            const double* weights = &_weights[i * 2 * p];
+
+            for (uint32_t b = 0; b < p; b++)
+                for (uint32_t a = 0; a < p; a++)
+                {
+                    const double w = weights[a] * weights[p + b];
+                    const size_t node = (firstNodeY + b) * _fftSize + firstNodeX + a;
+                    _chargesUnit[node] += Complex(w, 0);
+                    _chargesPosition[node] += Complex(w * x, w * y);
+                }
+        }
+        });
+
+    // 2. convolve with the kernels, which are embedded circularly in the padded grid
+    const auto signedOffset = [this](const size_t index) {
+        return (index < _fftSize / 2) ? static_cast<double>(index) : static_cast<double>(index) - static_cast<double>(_fftSize);
+        };
+
+    utils::parallel_for(_fftSize, [&](const size_t row) {
+        const double dy = signedOffset(row) * nodeSpacing;
+        for (size_t col = 0; col < _fftSize; col++)
+        {
+            const double dx = signedOffset(col) * nodeSpacing;
+            const double q = 1.0 / (1.0 + dx * dx + dy * dy);
+            _kernel[row * _fftSize + col] = Complex(q * q, q);
+        }
+        });
+
+    fft2D(_kernel, _fftSize, false);
+    fft2D(_chargesUnit, numNodes, false);
+    fft2D(_chargesPosition, numNodes, false);
+
+    // both kernels are real and even, so their transforms are the real and imaginary part of the transformed _kernel.
+    // Real charges convolved with _kernel give both potentials at once, the real and imaginary part of
+    // complex charges convolved with a real kernel stay separate
+    const double scale = 1.0 / (static_cast<double>(_fftSize) * _fftSize);
+    utils::parallel_for(_fftSize, [&](const size_t row) {
+        for (size_t e = row * _fftSize; e < (row + 1) * _fftSize; e++)
+        {
+            _chargesUnit[e] = multiply(_chargesUnit[e], _kernel[e]) * scale;
+            _chargesPosition[e] *= _kernel[e].real() * scale;
+        }
+        });
+
+    fft2D(_chargesUnit, numNodes, true);
+    fft2D(_chargesPosition, numNodes, true);
+
+    // 3. interpolate the potentials back to the points
+    _normalizationTerms.resize(numPoints);
+    utils::parallel_for(numPoints, [&](const size_t i) {
+        const size_t box = _boxOfPoint[i];
+        const size_t firstNodeX = (box % numBoxes) * p;
+        const size_t firstNodeY = (box / numBoxes) * p;
+        const double* weights = &_weights[i * 2 * p];
+
+        Complex potentialUnit(0, 0), potentialPosition(0, 0);
+        for (uint32_t b = 0; b < p; b++)
+            for (uint32_t a = 0; a < p; a++)
+            {
+                const double w = weights[a] * weights[p + b];
+                const size_t node = (firstNodeY + b) * _fftSize + firstNodeX + a;
+                potentialUnit += w * _chargesUnit[node];
+                potentialPosition += w * _chargesPosition[node];
+            }
+
+        // sum_j q_ij^2 (y_i - y_j) = y_i sum_j q_ij^2 - sum_j q_ij^2 y_j, the term j = i cancels
+        const double x = positions[2 * i] - centerX;
+        const double y = positions[2 * i + 1] - centerY;
+        forces[2 * i] = static_cast<float>(x * potentialUnit.real() - potentialPosition.real());
+        forces[2 * i + 1] = static_cast<float>(y * potentialUnit.real() - potentialPosition.imag());
+
+        // sum_j q_ij, minus 1 for j = i
+        _normalizationTerms[i] = potentialUnit.imag() - 1;
+        });
+
+    // sequential sum: same result for any number of threads
+    return std::accumulate(_normalizationTerms.begin(), _normalizationTerms.end(), 0.0);
+}
+
+void TsneRepulsionFFT::fft2D(std::vector<Complex>& grid, const size_t numRows, const bool inverse)
+{
+    const auto transformRows = [&]() {
+        utils::parallel_for(numRows, [&](const size_t row) {
+            fft(&grid[row * _fftSize], inverse);
+            });
+        };
+
+    const auto transformColumns = [&]() {
+        const size_t numBlocks = (_fftSize + COLUMN_BLOCK_SIZE - 1) / COLUMN_BLOCK_SIZE;
+        utils::parallel_for(numBlocks, [&](const size_t block) {
+            const size_t firstColumn = block * COLUMN_BLOCK_SIZE;
+            const size_t numColumns = std::min(COLUMN_BLOCK_SIZE, _fftSize - firstColumn);
+
+            std::vector<Complex> columns(numColumns * _fftSize);
+            for (size_t row = 0; row < _fftSize; row++)
+                for (size_t c = 0; c < numColumns; c++)
+                    columns[c * _fftSize + row] = grid[row * _fftSize + firstColumn + c];
+
+            for (size_t c = 0; c < numColumns; c++)
+                fft(&columns[c * _fftSize], inverse);
+
+            for (size_t row = 0; row < _fftSize; row++)
+                for (size_t c = 0; c < numColumns; c++)
+                    grid[row * _fftSize + firstColumn + c] = columns[c * _fftSize + row];
+            }, 1);
+        };
+
+    // rows beyond numRows are zero on input or not needed on output
+    if (!inverse)
+    {
+        transformRows();
+        transformColumns();
+    }
+    else
+    {
+        transformColumns();
+        transformRows();
+    }
+}
+
+void TsneRepulsionFFT::fft(Complex* data, const bool inverse) const
+{
+    const size_t n = _fftSize;
+
+    // bit reversal permutation
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+
+        if (i < j)
+            std::swap(data[i], data[j]);
+    }
+
+    // butterflies, the inverse uses the conjugate twiddles
+    const double sign = inverse ? -1.0 : 1.0;
+    for (size_t length = 2; length <= n; length <<= 1)
+    {
+        const size_t half = length / 2;
+        const size_t twiddleStride = n / length;
+        for (size_t start = 0; start < n; start += length)
+            for (size_t k = 0; k < half; k++)
+            {
+                const Complex& twiddle = _twiddles[k * twiddleStride];
+                const Complex t = multiply(Complex(twiddle.real(), sign * twiddle.imag()), data[start + k + half]);
+                data[start + k + half] = data[start + k] - t;
+                data[start + k] += t;
+            }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>      // size_t
+#include <cstdint>
+#include <vector>
+
+/**
+ * TsneRepulsionFFT
+ *
+ * Repulsive t-SNE forces by polynomial interpolation on a grid and FFT convolution (FIt-SNE),
+ * Linderman et al., Efficient Algorithms for t-distributed Stochastic Neighborhood Embedding, 2019
+ *
+ * The embedding is divided into boxes with INTERPOLATION_NODES x INTERPOLATION_NODES equispaced nodes each.
+ *  1. charges of the points are spread to the nodes of their box with Lagrange polynomials
+ *  2. the node potentials are the convolution of the node charges with the kernels (1 + d^2)^-2 and (1 + d^2)^-1,
+ *     computed with a 2D FFT
+ *  3. potentials are interpolated back to the points
+ * Cost is linear in the number of points plus the grid size, which depends on the extent of the embedding only.
+ */
+class TsneRepulsionFFT
+{
+public:
+    TsneRepulsionFFT();
+
+    /**
+     * Unnormalized repulsive forces sum_j (1 + |y_i - y_j|^2)^-2 (y_i - y_j) for all points
+     * \param positions 2D positions [x0, y0, x1, y1, ...]
+     * \param forces output, same layout as positions
+     * \return normalization sum_{i != j} (1 + |y_i - y_j|^2)^-1
+     */
+    double computeRepulsiveForces(const std::vector<float>& positions, std::vector<float>& forces);
+
+    /** Number of grid nodes per dimension used in the last computation */
+    size_t getNumNodesPerDim() const { return _numNodesPerDim; }
+
+private:
+    using Complex = std::complex<double>;
+
+    /** In-place 2D FFT of a _fftSize x _fftSize grid. Only the first numRows rows may be non-zero
+     * on input (forward) or are computed on output (inverse). The inverse is not scaled */
+    void fft2D(std::vector<Complex>& grid, const size_t numRows, const bool inverse);
+
+    /** In-place radix-2 FFT of _fftSize values */
+    void fft(Complex* data, const bool inverse) const;
+
+public:
+    static constexpr uint32_t       INTERPOLATION_NODES = 3;    /** Per box and dimension */
+    static constexpr uint32_t       MIN_NUM_BOXES = 50;         /** Per dimension */
+    static constexpr double         BOXES_PER_UNIT = 1.0;       /** Boxes per unit of embedding extent */
+    static constexpr size_t         MAX_FFT_SIZE = 2048;        /** Bounds memory (three grids of MAX_FFT_SIZE^2 complex values), boxes grow wider for very large embeddings */
+
+private:
+    size_t                          _fftSize;                   /** Padded grid size per dimension, power of 2 */
+    size_t                          _numNodesPerDim;
+    std::vector<Complex>            _twiddles;                  /** exp(-2 pi i k / _fftSize) */
+
+    std::vector<uint32_t>           _boxOfPoint;
+    std::vector<uint32_t>           _pointOrder;                /** Points sorted by box */
+    std::vector<uint32_t>           _boxOffsets;                /** Range of each box in _pointOrder */
+    std::vector<double>             _weights;                   /** Interpolation weights per point, [x nodes, y nodes] */
+    std::vector<double>             _normalizationTerms;        /** Per point contribution to the normalization */
+
+    std::vector<Complex>            _kernel;                    /** Kernels (1 + d^2)^-2 (real) and (1 + d^2)^-1 (imag) on the grid, transformed */
+    std::vector<Complex>            _chargesUnit;               /** Charge 1, after convolution the potentials sum_j q_ij^2 (real) and sum_j q_ij (imag) */
+    std::vector<Complex>            _chargesPosition;           /** Charges y_x (real) and y_y (imag), after convolution sum_j q_ij^2 y_j */
+};
@@ -2,8 +2,44 @@
 
 #include "hdi/dimensionality_reduction/knn_utils.h"
 
+#include <atomic>
+#include <random>       // random_device
+
 namespace utils {
 
+    /// /////// ///
+    /// Looping ///
+    /// /////// ///
+
+#ifdef NDEBUG
+    static std::atomic<LoopPolicy> loopPolicy = LoopPolicy::Parallel;
+#else
+    static std::atomic<LoopPolicy> loopPolicy = LoopPolicy::Sequential;
+#endif
+
+    void setLoopPolicy(const LoopPolicy policy)
+    {
+        loopPolicy = policy;
+    }
+
+    LoopPolicy getLoopPolicy()
+    {
+        return loopPolicy;
+    }
+
+    /// //// ///
+    /// MATH ///
+    /// //// ///
+
+    uint64_t randomSeed(const int seed)
+    {
+        if (seed >= 0)
+            return splitmix64(static_cast<uint64_t>(seed), 0);
+
+        std::random_device rd;
+        return (static_cast<uint64_t>(rd()) << 32) | rd();
+    }
+
     /// ////////// ///
     /// EMBEDDINGS ///
     /// ////////// ///
@@ -61,6 +97,95 @@ namespace utils {
     }
 
 
+    /// ///// ///
+    /// IMAGE ///
+    /// ///// ///
+
+    void ViewportPredictor::addViewport(const ROI& roi)
+    {
+        if (_numViewports > 0 && _current.layerBottomLeft == roi.layerBottomLeft && _current.layerTopRight == roi.layerTopRight)
+            return;
+
+        _previous = _current;
+        _current = roi;
+        _numViewports = std::min(_numViewports + 1, 2u);
+    }
+
+    void ViewportPredictor::reset()
+    {
+        _previous = ROI();
+        _current = ROI();
+        _numViewports = 0;
+        _sequenceViewports.clear();
+    }
+
+    ROI ViewportPredictor::snapToImage(const ROI& roi) const
+    {
+        auto snap = [](float val, uint32_t max) -> float {
+            return static_cast<float>(std::clamp(static_cast<int64_t>(std::round(val)), int64_t{ 0 }, static_cast<int64_t>(max)));
+        };
+
+        return ROI(Vector2D(snap(roi.layerBottomLeft.x(), _imageWidth), snap(roi.layerBottomLeft.y(), _imageHeight)),
+                   Vector2D(snap(roi.layerTopRight.x(), _imageWidth), snap(roi.layerTopRight.y(), _imageHeight)));
+    }
+
+    std::vector<ROI> ViewportPredictor::predict(const uint32_t numSteps) const
+    {
+        std::vector<ROI> predictions;
+
+        auto addPrediction = [&](const ROI& roi) {
+            const ROI snapped = snapToImage(roi);
+
+            if (snapped.layerTopRight.x() <= snapped.layerBottomLeft.x() || snapped.layerTopRight.y() <= snapped.layerBottomLeft.y())
+                return;
+
+            auto sameLayerRoi = [&snapped](const ROI& other) {
+                return snapped.layerBottomLeft == other.layerBottomLeft && snapped.layerTopRight == other.layerTopRight;
+            };
+
+            if ((_numViewports > 0 && sameLayerRoi(_current)) || std::any_of(predictions.begin(), predictions.end(), sameLayerRoi))
+                return;
+
+            predictions.push_back(snapped);
+        };
+
+        if (_numViewports == 2)
+        {
+            auto center = [](const ROI& roi) -> mv::Vector2f {
+                return { (roi.layerBottomLeft.x() + roi.layerTopRight.x()) / 2.f, (roi.layerBottomLeft.y() + roi.layerTopRight.y()) / 2.f };
+            };
+
+            auto halfSize = [](const ROI& roi) -> mv::Vector2f {
+                return { (roi.layerTopRight.x() - roi.layerBottomLeft.x()) / 2.f, (roi.layerTopRight.y() - roi.layerBottomLeft.y()) / 2.f };
+            };
+
+            const mv::Vector2f previousHalfSize = halfSize(_previous);
+            mv::Vector2f currentCenter = center(_current);
+            mv::Vector2f currentHalfSize = halfSize(_current);
+
+            // Zooming around a fixed point scales the pan of each step by the zoom factor
+            const float zoomX = previousHalfSize.x > 0 ? currentHalfSize.x / previousHalfSize.x : 1.f;
+            const float zoomY = previousHalfSize.y > 0 ? currentHalfSize.y / previousHalfSize.y : 1.f;
+            mv::Vector2f pan = currentCenter - center(_previous);
+
+            for (uint32_t step = 0; step < numSteps; step++)
+            {
+                pan = { pan.x * zoomX, pan.y * zoomY };
+                currentCenter = currentCenter + pan;
+                currentHalfSize = { currentHalfSize.x * zoomX, currentHalfSize.y * zoomY };
+
+                addPrediction(ROI(Vector2D(currentCenter.x - currentHalfSize.x, currentCenter.y - currentHalfSize.y),
+                                  Vector2D(currentCenter.x + currentHalfSize.x, currentCenter.y + currentHalfSize.y)));
+            }
+        }
+
+        for (const auto& roi : _sequenceViewports)
+            addPrediction(roi);
+
+        return predictions;
+    }
+
+
     /// ////// ///
     /// TIMING ///
     /// ////// ///
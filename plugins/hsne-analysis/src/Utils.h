@@ -4,9 +4,7 @@
 #include <cmath>        // sqrt, sin, cos
 #include <numeric>      // accumulate
 #include <algorithm>    // for_each, max
-#include <execution>
 #include <vector>
-#include <random>       // random_device, mt19937, uniform_real_distribution
 #include <chrono>       // high_resolution_clock, milliseconds
 #include <string>
 #include <iostream>
@@ -15,10 +13,13 @@
 #include <type_traits>
 #include <typeinfo>
 #include <functional>
+#include <atomic>
+#include <cstdint>
 
 #include "graphics/Vector2f.h"  // mv::Vector2f
 
 #include "CommonTypes.h"
+#include "Scheduler.h"
 #include "Logger.h"
 
 namespace hdi {
@@ -37,8 +38,10 @@ namespace utils {
     // https://github.com/klmr/cpp11-range
     // https://isocpp.org/blog/2020/12/writing-a-custom-iterator-in-modern-cpp
     // cpp11-range does not define a forward_iterator but only a input_iterator
-    // and can therefor not be used with std::execution in e.g. std::for_each
+    // and can therefor not be used with STL algorithms like std::for_each
     // Other resources: https://github.com/VinGarcia/Simple-Iterator-Template
+    // pyrange models a random access iterator, since parallel STL backends only
+    // partition random access ranges well and may fall back to serial loops otherwise
 
     template <typename T>
     struct pyrange {
@@ -47,7 +50,7 @@ namespace utils {
         // see https://en.cppreference.com/w/cpp/iterator/iterator_traits
         struct pyrange_iter
         {
-            using iterator_category = std::forward_iterator_tag;    // c++17 style, c++20 would use std::forward_iterator
+            using iterator_category = std::random_access_iterator_tag;
             using difference_type = std::ptrdiff_t;
             using value_type = T;
             using pointer = value_type*;
@@ -58,12 +61,27 @@ namespace utils {
 
             reference operator*() { return _val; }
             pointer operator->() { return &_val; }
+            value_type operator[](difference_type n) const { return static_cast<value_type>(_val + n); }
 
             pyrange_iter& operator++() { _val++; return *this; }                                // prefix increment
             pyrange_iter  operator++(int) { pyrange_iter tmp = *this; ++(*this); return tmp; }  // postix increment
+            pyrange_iter& operator--() { _val--; return *this; }                                // prefix decrement
+            pyrange_iter  operator--(int) { pyrange_iter tmp = *this; --(*this); return tmp; }  // postix decrement
+
+            pyrange_iter& operator+=(difference_type n) { _val = static_cast<value_type>(_val + n); return *this; }
+            pyrange_iter& operator-=(difference_type n) { _val = static_cast<value_type>(_val - n); return *this; }
+
+            friend pyrange_iter operator+(pyrange_iter a, difference_type n) { return a += n; }
+            friend pyrange_iter operator+(difference_type n, pyrange_iter a) { return a += n; }
+            friend pyrange_iter operator-(pyrange_iter a, difference_type n) { return a -= n; }
+            friend difference_type operator-(const pyrange_iter& a, const pyrange_iter& b) { return static_cast<difference_type>(a._val) - static_cast<difference_type>(b._val); }
 
             friend bool operator== (const pyrange_iter& a, const pyrange_iter& b) { return a._val == b._val; };
             friend bool operator!= (const pyrange_iter& a, const pyrange_iter& b) { return a._val != b._val; };
+            friend bool operator<  (const pyrange_iter& a, const pyrange_iter& b) { return a._val < b._val; };
+            friend bool operator>  (const pyrange_iter& a, const pyrange_iter& b) { return a._val > b._val; };
+            friend bool operator<= (const pyrange_iter& a, const pyrange_iter& b) { return a._val <= b._val; };
+            friend bool operator>= (const pyrange_iter& a, const pyrange_iter& b) { return a._val >= b._val; };
 
         private:
             value_type _val;
@@ -84,22 +102,104 @@ namespace utils {
 
     };
 
+    /*! Policy used by parallel_for, selectable at runtime
+    *   Defaults to Parallel in release and Sequential in debug mode
+    */
+    enum class LoopPolicy
+    {
+        Sequential = 0,
+        Parallel = 1
+    };
+
+    void setLoopPolicy(const LoopPolicy policy);
+    LoopPolicy getLoopPolicy();
+
+    /*! Grain size used by parallel_for if none is given:
+    *   about 8 chunks per scheduler thread, balancing load and scheduling overhead
+    */
+    inline size_t defaultGrainSize(const size_t numIterations) {
+        const size_t numThreads = Scheduler::instance().getNumThreads();
+        return std::max<size_t>(1, numIterations / (8 * numThreads));
+    }
 
-    /*! Use parallel loops in release and sequenced loops in debug mode. 
-    *   Creates a sequence of n numbers, e.g. for  n=3 -> 0,1,2
+    /*! Parallel loop over the indices [begin, end)
+    *   The range is split into chunks of grainSize indices, chunks are processed in parallel
+    *   on the Scheduler and the indices within a chunk sequentially. Use a grainSize of 1 if each index
+    *   already stands for a large block of work, 0 selects defaultGrainSize.
+    *   func may use locks and atomics.
     *   Use as:
     *
-        auto range = utils::pyrange(n);
-        std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const auto i) {
+        utils::parallel_for(n, [&](const auto i) {
             myFunction(i);
         });
     *
     */
-#ifdef NDEBUG
-    static auto exec_policy = std::execution::par_unseq;
-#else
-    static auto exec_policy = std::execution::seq;
-#endif
+    template <typename T, typename F>
+    void parallel_for(const T begin, const T end, F&& func, size_t grainSize = 0) {
+        static_assert(std::is_integral<T>::value, "Integral type required.");
+
+        if (!(begin < end))
+            return;
+
+        const size_t numIterations = static_cast<size_t>(end - begin);
+
+        if (grainSize == 0)
+            grainSize = defaultGrainSize(numIterations);
+
+        if (getLoopPolicy() == LoopPolicy::Sequential || numIterations <= grainSize)
+        {
+            for (T i = begin; i < end; ++i)
+                func(i);
+            return;
+        }
+
+        const size_t numChunks = (numIterations + grainSize - 1) / grainSize;
+
+        Scheduler::instance().run(numChunks, [&](const size_t chunk) {
+            const T chunkBegin = static_cast<T>(begin + chunk * grainSize);
+            const T chunkEnd = static_cast<T>(begin + std::min(numIterations, (chunk + 1) * grainSize));
+            for (T i = chunkBegin; i < chunkEnd; ++i)
+                func(i);
+            });
+    }
+
+    /*! Parallel loop over the indices [0, end), see above */
+    template <typename T, typename F>
+    void parallel_for(const T end, F&& func, size_t grainSize = 0) {
+        parallel_for(T(0), end, std::forward<F>(func), grainSize);
+    }
+
+    /*! Parallel std::sort on the Scheduler
+    *   One chunk per thread is sorted in parallel, sorted chunks are then merged pairwise.
+    *   Small ranges and the Sequential policy use std::sort.
+    */
+    template <typename It, typename Compare = std::less<>>
+    void parallel_sort(It first, It last, Compare comp = {}) {
+        const size_t numElements = static_cast<size_t>(std::distance(first, last));
+        const size_t numChunks = Scheduler::instance().getNumThreads();
+
+        if (getLoopPolicy() == LoopPolicy::Sequential || numChunks == 1 || numElements < 16'384)
+        {
+            std::sort(first, last, comp);
+            return;
+        }
+
+        const size_t chunkSize = (numElements + numChunks - 1) / numChunks;
+        auto chunkBegin = [&](const size_t chunk) { return first + std::min(numElements, chunk * chunkSize); };
+
+        parallel_for(numChunks, [&](const size_t chunk) {
+            std::sort(chunkBegin(chunk), chunkBegin(chunk + 1), comp);
+            }, 1);
+
+        for (size_t width = 1; width < numChunks; width *= 2)
+        {
+            const size_t numMerges = (numChunks + 2 * width - 1) / (2 * width);
+            parallel_for(numMerges, [&](const size_t merge) {
+                const size_t chunk = merge * 2 * width;
+                std::inplace_merge(chunkBegin(chunk), chunkBegin(std::min(numChunks, chunk + width)), chunkBegin(std::min(numChunks, chunk + 2 * width)), comp);
+                }, 1);
+        }
+    }
 
     /// ///// ///
     /// ENUMS ///
@@ -142,23 +242,51 @@ namespace utils {
                  /* y = */ (vec1.y + vec2.y + vec3.y) / 3.0f };
     }
 
-    // extendX and extendY are absolute values
-    inline mv::Vector2f randomVec(const float radiusX, const float radiusY) {
-        static std::random_device rd;  // Will be used to obtain a seed for the random number engine
-        static std::mt19937 gen(rd()); // Standard mersenne_twister_engine seeded with rd()
-        static std::uniform_real_distribution<float> dis(0, 1);
+    /*! Counter-based random number generator (SplitMix64)
+     * Stateless, the result only depends on seed and counter: use e.g. the point index as counter
+     * and parallel loops need no shared generator state and are reproducible for any thread count.
+    */
+    inline uint64_t splitmix64(const uint64_t seed, const uint64_t counter) {
+        uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /*! Seed for splitmix64 from a user seed, negative seeds draw a random seed (like time based seeds in HDILib) */
+    uint64_t randomSeed(const int seed);
 
+    /*! Random point for (seed, counter), see splitmix64
+    *   radiusX and radiusY are absolute values
+    */
+    inline mv::Vector2f randomVec(const float radiusX, const float radiusY, const uint64_t seed, const uint64_t counter) {
         const float maxR = std::max(radiusX, radiusY);  // sample from a circle - usually radiusX and radiusY are similar
 
         assert(maxR >= 0);
 
-        const float r = maxR * std::sqrt(dis(gen));     // random radius: uniformly sample from [0, 1], sqrt (important!), then scale to [0, maxR]
-        const float t = 2.0f * 3.141592f * dis(gen);    // random angle: uniformly sample from [0, 1] and scale to [0, pi]
+        // two uniform samples in [0, 1) from the upper and lower 24 bits of one random number
+        const uint64_t bits = splitmix64(seed, counter);
+        const float u0 = static_cast<float>(bits >> 40) * 0x1.0p-24f;
+        const float u1 = static_cast<float>(bits & 0xFFFFFFu) * 0x1.0p-24f;
+
+        const float r = maxR * std::sqrt(u0);           // random radius: uniformly sample from [0, 1], sqrt (important!), then scale to [0, maxR]
+        const float t = 2.0f * 3.141592f * u1;          // random angle: uniformly sample from [0, 1] and scale to [0, 2 pi]
 
         return { /* x = */ r * std::cos(t), 
                  /* y = */ r * std::sin(t) };
     }
 
+    /*! Random 2D embedding [x0, y0, x1, y1, ...], point i uses counter i */
+    inline void randomEmbedding(const size_t numPoints, const float radiusX, const float radiusY, const uint64_t seed, std::vector<float>& embedding) {
+        embedding.resize(2 * numPoints);
+        parallel_for(numPoints, [&](const size_t i) {
+            const auto randomPoint = randomVec(radiusX, radiusY, seed, i);
+
+            embedding[2 * i + 0] = randomPoint.x;
+            embedding[2 * i + 1] = randomPoint.y;
+            });
+    }
+
     // Cyclic group of order "size"
     // https://godbolt.org/z/nKoc785Ga
     /* Example
@@ -253,15 +381,14 @@ namespace utils {
     std::vector<float> CalcMeanPerChannel(size_t numPoints, size_t numDims, const std::vector<T>& attribute_data) {
         std::vector<float> meanVals(numDims, 0);
 
-        auto range = utils::pyrange(numDims);
-        std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const auto dimCount) {
+        utils::parallel_for(numDims, [&](const auto dimCount) {
             float sum = 0.0f;
             for (uint32_t pointCount = 0; pointCount < numPoints; pointCount++) {
                 sum += attribute_data[pointCount * numDims + dimCount];
             }
 
             meanVals[dimCount] = sum / numPoints;
-        });
+        }, 1);
 
         return meanVals;
     }
@@ -279,12 +406,11 @@ namespace utils {
 
         std::vector<float> channelMeans = CalcMeanPerChannel(numPoints, numDims, attribute_data);
 
-        auto range = utils::pyrange(numDims);
-        std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const auto dimCount) {
+        utils::parallel_for(numDims, [&](const auto dimCount) {
             for (uint32_t pointCount = 0; pointCount < numPoints; pointCount++) {
                 normed_data[pointCount * numDims + dimCount] = attribute_data[pointCount * numDims + dimCount] - channelMeans[dimCount];
             }
-        });
+        }, 1);
     }
 
 
@@ -567,6 +693,40 @@ namespace utils {
         return false;
     }
 
+    /**
+     * Predicts the next layer ROIs from the recent viewport motion.
+     * Pan and zoom between the last two viewports are extrapolated, a zoom around the cursor shifts the center geometrically.
+     * Predictions are rounded and clamped to the image like the viewports in InteractiveHsnePlugin::updateImageViewport
+     */
+    class ViewportPredictor {
+    public:
+        ViewportPredictor() : _imageWidth(0), _imageHeight(0), _previous(), _current(), _numViewports(0), _sequenceViewports() {}
+
+        void setImageSize(uint32_t width, uint32_t height) { _imageWidth = width; _imageHeight = height; }
+
+        /** Records the viewport the user moved to, repeated viewports are ignored */
+        void addViewport(const ROI& roi);
+
+        /** Viewports that are likely next independent of the motion, e.g. the neighbouring rows of a viewport sequence */
+        void setSequenceViewports(const std::vector<ROI>& rois) { _sequenceViewports = rois; }
+
+        void reset();
+
+        /** Extrapolated viewports for numSteps steps ahead followed by the sequence viewports, without duplicates, empty viewports or the current viewport */
+        std::vector<ROI> predict(const uint32_t numSteps) const;
+
+        /** Rounds the layer ROI corners and clamps them to the image */
+        ROI snapToImage(const ROI& roi) const;
+
+    private:
+        uint32_t            _imageWidth;
+        uint32_t            _imageHeight;
+        ROI                 _previous;          /** Viewport before the current one */
+        ROI                 _current;           /** Latest viewport */
+        uint32_t            _numViewports;      /** Number of recorded viewports, at most 2 */
+        std::vector<ROI>    _sequenceViewports;
+    };
+
     /// /////////// ///
     /// INTERACTION ///
     /// /////////// ///
@@ -761,6 +921,32 @@ namespace utils {
         std::unordered_map<std::string, lockClass> _locks;
     };
 
+
+    /// //////////// ///
+    /// CANCELLATION ///
+    /// //////////// ///
+
+    /** 
+     * Cooperative cancellation of long computations, which check isCancelled() between their stages.
+     * A token remembers the generation of its source when it is created, incrementing the source cancels all earlier tokens.
+     */
+    class CancellationToken
+    {
+    public:
+        CancellationToken() : _source(nullptr), _generation(0) {};
+        CancellationToken(const std::atomic<uint64_t>& source) : _source(&source), _generation(source.load()) {};
+
+        bool isCancelled() const {
+            return _source != nullptr && _source->load() != _generation;
+        }
+
+        uint64_t generation() const { return _generation; }
+
+    private:
+        const std::atomic<uint64_t>*    _source;
+        uint64_t                        _generation;
+    };
+
 }
 
 #endif UTILS_H
\ No newline at end of file
@@ -14,20 +14,6 @@
 #include <map>
 #include <limits>
 
-namespace utils {
-    static float
-        L2Sqr(const float* pVect1, const float* pVect2, const size_t qty) {
-        float res = 0;
-        for (size_t i = 0; i < qty; i++) {
-            float t = *pVect1 - *pVect2;
-            pVect1++;
-            pVect2++;
-            res += t * t;
-        }
-        return res;
-    }
-}
-
 namespace utils {
 
     /// ////////////////// ///
@@ -73,14 +59,14 @@ namespace utils {
             return;
         }
 
-        const std::vector<std::vector<uint32_t>>& influenceMapTopDown = hsneHierarchy.getInfluenceHierarchy().getMapTopDown()[currentScale];
+        const LandmarkMap& influenceMapTopDown = hsneHierarchy.getInfluenceMapTopDown(currentScale);
 
         // get the influenced data points for all selected landmarks
         std::vector<uint32_t> imageSelectionIDs;
         for (const auto& localScaleID : localIDsOnCurrentScale)
         {
             // get the data IDs that are influenced the most by the landmark localScaleID
-            const std::vector<uint32_t>& influencedDataIds = influenceMapTopDown[localScaleID];
+            const LandmarkMap::Row influencedDataIds = influenceMapTopDown[localScaleID];
             imageSelectionIDs.insert(imageSelectionIDs.end(), influencedDataIds.begin(), influencedDataIds.end());
         }
 
@@ -110,19 +96,22 @@ namespace utils {
         Log::trace(fmt::format("computeLocalIDsOnCoarserScaleHeuristic: newScaleLevel {}", newScaleLevel));
 
         localIDsOnCoarserScale.clear();
-        const auto& influenceMapButtomUp = hsneHierarchy.getInfluenceHierarchy().getMapBottomUp()[newScaleLevel];
+        const auto& influenceMapButtomUp = hsneHierarchy.getInfluenceMapBottomUp(newScaleLevel);
+
+        localIDsOnCoarserScale.reserve(imageSelectionIDs.size());
 
         // get the influencing landmarks for all selected data points
         for (const auto& imageSelectionID : imageSelectionIDs)
         {
             // get the landmark ID on newScaleLevel that has the highest influence on the data level imageSelectionID (this might be none)
-            const std::vector<uint32_t>& influencingLandmarkIds = influenceMapButtomUp[imageSelectionID];
-            localIDsOnCoarserScale.insert(localIDsOnCoarserScale.end(), influencingLandmarkIds.begin(), influencingLandmarkIds.end());
+            const uint32_t influencingLandmarkId = influenceMapButtomUp[imageSelectionID];
+            if (influencingLandmarkId != NO_LANDMARK)
+                localIDsOnCoarserScale.push_back(influencingLandmarkId);
         }
 
         // only retain the unique IDs: sort, unique, erase, see https://en.cppreference.com/w/cpp/algorithm/unique
-        std::sort(utils::exec_policy, localIDsOnCoarserScale.begin(), localIDsOnCoarserScale.end());
-        auto last = std::unique(utils::exec_policy, localIDsOnCoarserScale.begin(), localIDsOnCoarserScale.end());
+        utils::parallel_sort(localIDsOnCoarserScale.begin(), localIDsOnCoarserScale.end());
+        auto last = std::unique(localIDsOnCoarserScale.begin(), localIDsOnCoarserScale.end());
         localIDsOnCoarserScale.erase(last, localIDsOnCoarserScale.end());
     }
 
@@ -345,7 +334,7 @@ namespace utils {
         }
 
         // _influenceMapTopDown[landmarkIDOnScale]: vector of data point IDs for which landmarkIDOnScale has the highest influence on
-        const auto& influenceMapTopDown = hsneHierarchy.getInfluenceHierarchy().getMapTopDown()[scaleLevel];
+        const auto& influenceMapTopDown = hsneHierarchy.getInfluenceMapTopDown(scaleLevel);
         //const auto& scale = hsneHierarchy.getScale(scaleLevel); // scale._landmark_to_original_data_idx[emdId]
 
         auto getPixelCoordinateFromPixelIndex = [&imgSize](const std::int32_t& pixelIndex) -> QPoint {
@@ -357,8 +346,8 @@ namespace utils {
             // TODO: use exact representation instead of Heuristic
             const uint32_t id = localIDsOnScale[i];
      
-            // vector of data point IDs for which landmarkIDOnScale has the highest influence on
-            const std::vector<uint32_t>& influencedDataPoints = influenceMapTopDown[id];
+            // data point IDs for which landmarkIDOnScale has the highest influence on
+            const LandmarkMap::Row influencedDataPoints = influenceMapTopDown[id];
 
             IdRoiRepresentation[i].second.clear();
             for (const uint32_t& influencedDataPoint : influencedDataPoints)
@@ -386,8 +375,7 @@ namespace utils {
         Log::info(fmt::format("rescaleEmbedding: Rescale factor: scaleX {0}, scaleY {1}", embScalingFactors.first, embScalingFactors.second));
 
         // rescale embedding
-        auto range = utils::pyrange(embPosRescaled.size());
-        std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const auto i) {
+        utils::parallel_for(embPosRescaled.size(), [&](const auto i) {
             embPosRescaled[i] *= scaleFact;
             });
 
@@ -400,11 +388,12 @@ namespace utils {
     }
 
     void reinitializeEmbedding(const HsneHierarchy& hsneHierarchy, const std::vector<mv::Vector2f>& embPositions, const IDMapping& idMap, const utils::EmbeddingExtends& embeddingExtends,
-        const uint32_t newScaleLevel, const std::vector<uint32_t>& localIDsOnNewScale, std::vector<float>& initEmbedding, std::vector<utils::POINTINITTYPE>& initTypes)
+        const uint32_t newScaleLevel, const std::vector<uint32_t>& localIDsOnNewScale, std::vector<float>& initEmbedding, std::vector<utils::POINTINITTYPE>& initTypes, std::vector<uint32_t>& previousIndices)
     {
         // resize embedding positions and meta into vectors
         initEmbedding.resize(localIDsOnNewScale.size() * 2);
         initTypes.resize(localIDsOnNewScale.size());
+        previousIndices.assign(localIDsOnNewScale.size(), std::numeric_limits<uint32_t>::max());
 
         // compute max radii for random init
         assert(embeddingExtends.extend_x() > 0 && embeddingExtends.extend_y() > 0);
@@ -416,6 +405,9 @@ namespace utils {
         const auto& transitionNNsOnScale = hsneHierarchy.getTransitionNNOnScale(newScaleLevel);
         const HsneMatrix& fullTransitionMatrix = newScale._transition_matrix;
 
+        // random positions are keyed by data ID, such that a landmark gets the same position independent of the ROI
+        const uint64_t seed = utils::splitmix64(utils::randomSeed(hsneHierarchy.getSeed()), newScaleLevel);
+
         // debug and logging counters
         size_t numPoints_oldPos(0), numPoints_interPos(0), numPoints_randPos(0);
         Log::info("reinitializeEmbedding:: Old embedding size of " + std::to_string(embPositions.size()) + " and new size of " + std::to_string(localIDsOnNewScale.size()));
@@ -443,6 +435,7 @@ namespace utils {
                 initEmbedding[embId_y] = previousPoint.y;
 
                 initTypes[emdId] = POINTINITTYPE::previousPos;
+                previousIndices[emdId] = idMapEntryCurrentPoint->second.posInEmbedding;
                 numPoints_oldPos++;
             }
             else
@@ -459,15 +452,13 @@ namespace utils {
                 bool interpolatePos = false;
                 uint32_t nnCount = 0;
 
-                // type of transitionNNsOnScale (for a given scale) is 
-                // std::vector<std::vector<uint32_t>>
-                //    landmarks      kNN      ID (local on scale)
-                // type of transitionNNs is
-                // std::vector<uint32_t>
+                // transitionNNsOnScale (for a given scale) is a NeighborMatrix, i.e.
+                // for each landmark the (up to k) landmarks with the highest transition values, sorted descending
+                // transitionNNs is a view into its flat storage
                 //         kNN     ID (local on scale)
 
                 // get the sorted transition values (and respective locas IDs)
-                const std::vector<uint32_t>& transitionNNs = transitionNNsOnScale[localIDsOnNewScale[emdId]];
+                const NeighborMatrix::Row transitionNNs = transitionNNsOnScale[localIDsOnNewScale[emdId]];
 
                 // check whether any of the transition landmarks have been in the previous embedding
                 for (const auto& transitID : transitionNNs)
@@ -515,7 +506,7 @@ namespace utils {
                 else
                 {
                     // Last resort: use a random position 
-                    auto randomPoint = utils::randomVec(rad_randomMax_X, rad_randomMax_Y);
+                    auto randomPoint = utils::randomVec(rad_randomMax_X, rad_randomMax_Y, seed, newScale._landmark_to_original_data_idx[localIDsOnNewScale[emdId]]);
 
                     initEmbedding[embId_x] = randomPoint.x;
                     initEmbedding[embId_y] = randomPoint.y;
@@ -532,6 +523,28 @@ namespace utils {
             ", rand pos " + std::to_string(numPoints_randPos) + " of total " + std::to_string(localIDsOnNewScale.size()) + " (" + std::to_string(numPoints_oldPos + numPoints_interPos + numPoints_randPos) + ")");
     }
 
+    InitTypeFractions computeInitTypeFractions(const std::vector<POINTINITTYPE>& initTypes)
+    {
+        InitTypeFractions fractions;
+        if (initTypes.empty())
+            return fractions;
+
+        size_t numPoints_interPos(0), numPoints_randPos(0);
+        for (const auto initType : initTypes)
+        {
+            if (initType == POINTINITTYPE::interpolPos)
+                numPoints_interPos++;
+            else if (initType == POINTINITTYPE::randomPos)
+                numPoints_randPos++;
+        }
+
+        fractions.interpolPos = static_cast<float>(numPoints_interPos) / initTypes.size();
+        fractions.randomPos = static_cast<float>(numPoints_randPos) / initTypes.size();
+        fractions.previousPos = 1.0f - fractions.interpolPos - fractions.randomPos;
+
+        return fractions;
+    }
+
     void recomputeIDMap(const Hsne::Scale& currentScale, const std::vector<uint32_t>& localIDsOnNewScale, IDMapping& idMap)
     {
         idMap.clear();
@@ -557,8 +570,7 @@ namespace utils {
 
         // same as in hdilib\hdi\dimensionality_reduction\hierarchical_sne_inl.h: initializeFirstScale()
 
-        auto range = utils::pyrange(num_dps);
-        std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const auto i) {
+        utils::parallel_for(num_dps, [&](const auto i) {
             float sum = 0;
             for (size_t n = 1; n < nn; ++n) {
                 size_t idx = i * nn + n;
@@ -572,34 +584,115 @@ namespace utils {
 
     }
 
-    void computeExactKNN(const std::vector<float>& query_data, const std::vector<float>& base_data, const size_t num_dps_query, const size_t num_dps_base, const size_t num_dims, const size_t k, std::vector<float>& knn_distances_squared, std::vector<uint32_t>& knn_indices)
+    void computeExactKNN(const std::vector<float>& query_data, const std::vector<float>& base_data, const size_t num_dps_query, const size_t num_dps_base, const size_t num_dims, const size_t k, std::vector<float>& knn_distances_squared, std::vector<uint32_t>& knn_indices, const DistanceMetric metric)
     {
-        knn_distances_squared.resize(num_dps_query * k, -1.0f);
-        knn_indices.resize(num_dps_query * k, -1);
+        using RowMatrixXf = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+        using DistIdPair  = std::pair<float, uint32_t>;
+
+        knn_distances_squared.assign(num_dps_query * k, -1.0f);
+        knn_indices.assign(num_dps_query * k, std::numeric_limits<uint32_t>::max());
 
         Log::info("computeExactKNN");
 
-        std::vector<std::pair<int, float>> indices_distances(num_dps_query);
+        if (num_dps_query == 0 || num_dps_base == 0 || k == 0)
+            return;
+
+        if (k > num_dps_base)
+            Log::warn(fmt::format("computeExactKNN: k ({0}) is larger than the number of base points ({1})", k, num_dps_base));
 
-        // For each point, calc distances to all other
-        // and take the nn smallest as kNN
-        for (int i = 0; i < static_cast<int>(num_dps_query); i++) {
-            // Calculate distance to all points  using the respective metric
-            #ifdef NDEBUG
-            #pragma omp parallel for
-            #endif
-            for (int j = 0; j < static_cast<int>(num_dps_query); j++) 
-                indices_distances[j] = std::make_pair(j, L2Sqr(query_data.data() + i * num_dims, query_data.data() + j * num_dims, num_dims));
+        // Distances are computed tile-wise from the dot products q*b^T, such that the bulk of the work is a GEMM,
+        // e.g. the squared euclidean distance is ||q||^2 + ||b||^2 - 2 q*b^T.
+        // Each worker only holds one (queryBlockSize x baseBlockSize) tile, which keeps the memory footprint bounded
+        // independent of the number of points (256 x 4096 floats = 4 MB per worker)
+        constexpr size_t queryBlockSize = 256;
+        constexpr size_t baseBlockSize  = 4096;
 
-            // sort all distances to point i
-            std::sort(indices_distances.begin(), indices_distances.end(), [](std::pair<int, float> a, std::pair<int, float> b) {return a.second < b.second; });
+        const Eigen::Map<const RowMatrixXf> queryMat(query_data.data(), num_dps_query, num_dims);
+        const Eigen::Map<const RowMatrixXf> baseMat(base_data.data(), num_dps_base, num_dims);
 
-            // Take the first nn indices 
-            std::transform(indices_distances.begin(), indices_distances.begin() + k, knn_indices.begin() + i * k, [](const std::pair<int, float>& p) { return p.first; });
+        const Eigen::VectorXf baseNorms = baseMat.rowwise().squaredNorm();
 
-            // Take the first nn distances 
-            std::transform(indices_distances.begin(), indices_distances.begin() + k, knn_distances_squared.begin() + i * k, [](const std::pair<int, float>& p) { return p.second; });
-        }
+        const size_t numQueryBlocks = (num_dps_query + queryBlockSize - 1) / queryBlockSize;
+        const size_t kHeap = std::min(k, num_dps_base);
+
+        const auto heapComp = [](const DistIdPair& a, const DistIdPair& b) { return a.first < b.first; };
+
+        const auto distFromDot = [metric](const float dot, const float queryNorm, const float baseNorm) -> float {
+            switch (metric)
+            {
+            case DistanceMetric::InnerProduct:  return 1.0f - dot;
+            case DistanceMetric::Cosine:        return (queryNorm > 0.0f && baseNorm > 0.0f) ? 1.0f - dot / std::sqrt(queryNorm * baseNorm) : 1.0f;
+            default:                            return std::max(queryNorm + baseNorm - 2.0f * dot, 0.0f);  // clamp small negative values caused by cancellation
+            }
+        };
+
+        // Exact distance kernel for the final neighbors
+        const DistanceFunction distFunc = getDistanceFunction(metric, num_dims);
+
+        utils::parallel_for(numQueryBlocks, [&](const auto queryBlock) {
+            const size_t queryStart = queryBlock * queryBlockSize;
+            const size_t queryCount = std::min(queryBlockSize, num_dps_query - queryStart);
+
+            const auto queryBlockMat = queryMat.middleRows(queryStart, queryCount);
+            const Eigen::VectorXf queryNorms = queryBlockMat.rowwise().squaredNorm();
+
+            // One bounded max-heap per query: the largest of the current k candidates is on top
+            std::vector<std::vector<DistIdPair>> heaps(queryCount);
+            for (auto& heap : heaps)
+                heap.reserve(kHeap);
+
+            RowMatrixXf tile(queryCount, std::min(baseBlockSize, num_dps_base));
+
+            for (size_t baseStart = 0; baseStart < num_dps_base; baseStart += baseBlockSize)
+            {
+                const size_t baseCount = std::min(baseBlockSize, num_dps_base - baseStart);
+
+                auto tileBlock = tile.leftCols(baseCount);
+                tileBlock.noalias() = queryBlockMat * baseMat.middleRows(baseStart, baseCount).transpose();
+
+                for (size_t q = 0; q < queryCount; q++)
+                {
+                    auto& heap = heaps[q];
+                    const float* tileRow = tile.row(q).data();
+
+                    for (size_t b = 0; b < baseCount; b++)
+                    {
+                        const float dist = distFromDot(tileRow[b], queryNorms[q], baseNorms[baseStart + b]);
+
+                        if (heap.size() < kHeap)
+                        {
+                            heap.emplace_back(dist, static_cast<uint32_t>(baseStart + b));
+                            std::push_heap(heap.begin(), heap.end(), heapComp);
+                        }
+                        else if (dist < heap.front().first)
+                        {
+                            std::pop_heap(heap.begin(), heap.end(), heapComp);
+                            heap.back() = { dist, static_cast<uint32_t>(baseStart + b) };
+                            std::push_heap(heap.begin(), heap.end(), heapComp);
+                        }
+                    }
+                }
+            }
+
+            // Recompute the distances of the selected neighbors with the exact kernel 
+            // and write the neighbors sorted by ascending distance
+            for (size_t q = 0; q < queryCount; q++)
+            {
+                auto& heap = heaps[q];
+                const float* queryPoint = query_data.data() + (queryStart + q) * num_dims;
+                for (auto& [dist, id] : heap)
+                    dist = distFunc(queryPoint, base_data.data() + static_cast<size_t>(id) * num_dims, num_dims);
+
+                std::sort(heap.begin(), heap.end(), heapComp);
+
+                const size_t offset = (queryStart + q) * k;
+                for (size_t n = 0; n < heap.size(); n++)
+                {
+                    knn_distances_squared[offset + n] = heap[n].first;
+                    knn_indices[offset + n] = heap[n].second;
+                }
+            }
+        }, 1);
 
     }
 
@@ -611,8 +704,7 @@ namespace utils {
 
         float perplexity = nn / 3.f;
 
-        auto range = utils::pyrange(num_dps);
-        std::for_each(utils::exec_policy, range.begin(), range.end(), [&](const auto d) {
+        utils::parallel_for(num_dps, [&](const auto d) {
             //It could be that the point itself is not the nearest one if two points are identical... I want the point itself to be the first one!
             if (knn_indices[d * nn] != d) {
                 size_t to_swap = d * nn;
@@ -668,8 +760,7 @@ namespace utils {
 
         // Now that I have the maps, I generate the new transition matrix
         // we can parallelize this since map_selected_idxes[selected_idxes[i]] will be a different number for each i
-        auto rangeSel = utils::pyrange(selected_idxes.size());
-        std::for_each(utils::exec_policy, rangeSel.begin(), rangeSel.end(), [&](auto i) {
+        utils::parallel_for(selected_idxes.size(), [&](auto i) {
             for (Eigen::SparseVector<float>::InnerIterator it(orig_transition_matrix[selected_idxes[i]].memory()); it; ++it) {
                 if ((map_selected_idxes[it.index()] != NOTFOUND) && (it.value() > thresh)) {
                     new_transition_matrix[map_selected_idxes[selected_idxes[i]]][map_selected_idxes[it.index()]] = it.value();
@@ -705,14 +796,12 @@ namespace utils {
                 std::vector<uint32_t> valid_set;
                 valid_set.resize(valid_vertices.size() + invalid_vertices.size(), NOTFOUND);
 
-                auto rangeVert = utils::pyrange(static_cast<uint32_t>(valid_vertices.size()));
-                std::for_each(utils::exec_policy, rangeVert.begin(), rangeVert.end(), [&](auto i) {
+                utils::parallel_for(static_cast<uint32_t>(valid_vertices.size()), [&](auto i) {
                     valid_set[valid_vertices[i]] = i;
                 });
 
                 HsneMatrix new_map(new_transition_matrix.size());
-                auto rangeTrans = utils::pyrange(valid_vertices.size());
-                std::for_each(utils::exec_policy, rangeTrans.begin(), rangeTrans.end(), [&](auto i) {
+                utils::parallel_for(valid_vertices.size(), [&](auto i) {
                     //for (auto& elem : new_transition_matrix[i]) {
                     for (Eigen::SparseVector<float>::InnerIterator it(new_transition_matrix[i].memory()); it; ++it) {
                         if (valid_set[it.index()] != NOTFOUND) {
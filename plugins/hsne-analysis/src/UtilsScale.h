@@ -2,6 +2,7 @@
 #define UTILSSCALE_H
 
 #include "CommonTypes.h"
+#include "DistanceKernels.h"
 
 #include "PointData/PointData.h"
 #include "Dataset.h"
@@ -29,6 +30,15 @@ namespace utils {
 
     constexpr float initTypeToFloat(POINTINITTYPE val) { return static_cast<float>(val); }
 
+    /** Fraction of embedding points per POINTINITTYPE, sums to one */
+    struct InitTypeFractions {
+        float previousPos = 1.0f;
+        float interpolPos = 0.0f;
+        float randomPos = 0.0f;
+    };
+
+    InitTypeFractions computeInitTypeFractions(const std::vector<POINTINITTYPE>& initTypes);
+
     /// ////////////////// ///
     /// HsneScaleFunctions ///
     /// ////////////////// ///
@@ -59,7 +69,8 @@ namespace utils {
 
     void rescaleEmbedding(const mv::Dataset<Points>& embedding, const std::pair<float, float>& embScalingFactors, const utils::EmbeddingExtends& currentEmbExtends, std::vector<mv::Vector2f>& embPosRescaled, utils::EmbeddingExtends& rescaledEmbExtends);
 
-    void reinitializeEmbedding(const HsneHierarchy& hsneHierarchy, const std::vector<mv::Vector2f>& embPositions, const IDMapping& idMap, const utils::EmbeddingExtends& embeddingExtends, const uint32_t newScaleLevel, const std::vector<uint32_t>& localIDsOnCoarserScale, std::vector<float>& initEmbedding, std::vector<utils::POINTINITTYPE>& initTypes);
+    /** previousIndices: position in the previous embedding for previousPos points, std::numeric_limits<uint32_t>::max() otherwise */
+    void reinitializeEmbedding(const HsneHierarchy& hsneHierarchy, const std::vector<mv::Vector2f>& embPositions, const IDMapping& idMap, const utils::EmbeddingExtends& embeddingExtends, const uint32_t newScaleLevel, const std::vector<uint32_t>& localIDsOnCoarserScale, std::vector<float>& initEmbedding, std::vector<utils::POINTINITTYPE>& initTypes, std::vector<uint32_t>& previousIndices);
     
     void recomputeIDMap(const Hsne::Scale& currentScale, const std::vector<uint32_t>& localIDsOnNewScale, IDMapping& idMap);
 
@@ -71,7 +82,10 @@ namespace utils {
     void computeSimilaritiesFromKNN(const std::vector<float>& distance_based_probabilities, const std::vector<uint32_t>& neighborhood_graph, const size_t num_dps, HsneMatrix& similarities);
 
     /*! Compute exact kNNs
-     * Calculate the distances between all point pairs and find closest neighbors
+     * Calculate the distances between all query and base point pairs and find closest neighbors
+     * Distances are computed block-wise as ||q||^2 + ||b||^2 - 2 q*b^T and the k closest neighbors 
+     * are kept in a bounded heap per query point. Query blocks are processed in parallel.
+     * The distances of the final neighbors are recomputed with the SIMD distance kernels.
      * \param query_data
      * \param base_data
      * \param num_dps_query
@@ -80,8 +94,9 @@ namespace utils {
      * \param k
      * \param knn_distances_squared
      * \param knn_indices
+     * \param metric distance metric, knn_distances_squared holds squared distances only for DistanceMetric::L2Sqr
     */
-    void computeExactKNN(const std::vector<float>& query_data, const std::vector<float>& base_data, const size_t num_dps_query, const size_t num_dps_base, const size_t num_dims, const size_t k, std::vector<float>& knn_distances_squared, std::vector<uint32_t>& knn_indices);
+    void computeExactKNN(const std::vector<float>& query_data, const std::vector<float>& base_data, const size_t num_dps_query, const size_t num_dps_base, const size_t num_dims, const size_t k, std::vector<float>& knn_distances_squared, std::vector<uint32_t>& knn_indices, const DistanceMetric metric = DistanceMetric::L2Sqr);
 
     void computeFMC(const size_t num_dps, const size_t nn, std::vector<float>& distance_based_probabilities, std::vector<uint32_t>& knn_indices);
 
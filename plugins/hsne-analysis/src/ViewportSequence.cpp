@@ -283,6 +283,17 @@ void ViewportSequence::setCurrentStepNum(int step)
     triggerViewportChange(_dataModel.dataRow(_currentStep));
 }
 
+std::vector<utils::ROI> ViewportSequence::getNeighbouringROIs() const
+{
+    std::vector<utils::ROI> neighbours;
+
+    for (const auto step : { _currentStep + 1, _currentStep - 1 })
+        if (step >= 0 && step < _dataModel.rowCount())
+            neighbours.push_back(_dataModel.dataRow(step));
+
+    return neighbours;
+}
+
 void ViewportSequence::appendROI(const utils::ROI& roi)
 {
     // check if the roi needs to be appended or whether we are stepping through the sequence history
@@ -151,6 +151,9 @@ public:
     /** Returns current table row number */
     int getCurrentStepNum() const { return _currentStep; };
 
+    /** Returns the rows after and before the current step, if any */
+    std::vector<utils::ROI> getNeighbouringROIs() const;
+
     void setCurrentStepNum(int step);
     
     bool getLockedAddRoi() const { return _lockAddRoi; };
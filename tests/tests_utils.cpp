@@ -1,7 +1,39 @@
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
 
 #include "Utils.h"
+#include "UtilsScale.h"
+#include "CacheFile.h"
+#include "ConvergenceMonitor.h"
+#include "DistanceKernels.h"
+#include "EmbeddingSnapshot.h"
+#include "Hashing.h"
+#include "LruCache.h"
+#include "Scheduler.h"
+#include "TsneGradientDescentCPU.h"
+#include "TsneParameters.h"
+#include "TsneRepulsionExact.h"
+#include "TsneRepulsionFFT.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <graphics/Vector2f.h>  // mv::Vector2f
@@ -11,6 +43,32 @@ static inline bool equalVectors(const mv::Vector2f& a, const mv::Vector2f& b) {
 	return (a - b).sqrMagnitude() < 0.000001f;
 }
 
+// clusters of consecutive points, each point has transitions to random points of its own cluster
+static HsneMatrix clusteredProbabilities(const uint32_t numClusters, const uint32_t clusterSize, const uint32_t numNeighbors) {
+	const uint32_t numPoints = numClusters * clusterSize;
+
+	HsneMatrix probabilities(numPoints);
+	for (uint32_t i = 0; i < numPoints; i++) {
+		probabilities[i].resize(numPoints);
+		for (uint32_t n = 0; n < numNeighbors; n++) {
+			const uint32_t j = (i / clusterSize) * clusterSize + static_cast<uint32_t>(utils::splitmix64(i, n) % clusterSize);
+			if (j != i)
+				probabilities[i][j] = 1.0f / numNeighbors;
+		}
+	}
+
+	return probabilities;
+}
+
+// sets the loop policy for the lifetime of this object, restores the previous policy also if a requirement fails
+struct ScopedLoopPolicy
+{
+	explicit ScopedLoopPolicy(const utils::LoopPolicy policy) : _previous(utils::getLoopPolicy()) { utils::setLoopPolicy(policy); }
+	~ScopedLoopPolicy() { utils::setLoopPolicy(_previous); }
+
+	const utils::LoopPolicy _previous;
+};
+
 TEST_CASE("2D vector interpolation", "[math]")
 {
 
@@ -41,4 +99,1177 @@ TEST_CASE("2D vector interpolation", "[math]")
 	for (size_t i = 0; i < expected.size(); i++) {
 		REQUIRE(equalVectors(utils::interpol2D(points[3*i], points[3 * i + 1], points[3 * i + 2]), expected[i]));
 	}
-}
\ No newline at end of file
+}
+
+TEST_CASE("Exact kNN", "[knn]")
+{
+	const size_t numQuery = 300, numBase = 5000, numDims = 7, k = 5;
+
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+	std::vector<float> query(numQuery * numDims), base(numBase * numDims);
+	std::generate(query.begin(), query.end(), [&]() { return dist(gen); });
+	std::generate(base.begin(), base.end(), [&]() { return dist(gen); });
+
+	std::vector<float> knnDists;
+	std::vector<uint32_t> knnIds;
+	utils::computeExactKNN(query, base, numQuery, numBase, numDims, k, knnDists, knnIds);
+
+	REQUIRE(knnDists.size() == numQuery * k);
+	REQUIRE(knnIds.size() == numQuery * k);
+
+	// Compare against brute force
+	for (size_t q = 0; q < numQuery; q++) {
+		std::vector<std::pair<float, uint32_t>> all(numBase);
+		for (uint32_t b = 0; b < numBase; b++) {
+			float d = 0;
+			for (size_t c = 0; c < numDims; c++) {
+				const float t = query[q * numDims + c] - base[b * numDims + c];
+				d += t * t;
+			}
+			all[b] = { d, b };
+		}
+		std::partial_sort(all.begin(), all.begin() + k, all.end());
+
+		for (size_t n = 0; n < k; n++)
+			REQUIRE(std::abs(knnDists[q * k + n] - all[n].first) < 0.0001f);
+	}
+}
+
+TEST_CASE("SIMD distance kernels", "[knn]")
+{
+	std::mt19937 gen(7);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+	// specialized and generic dimensionalities
+	for (const size_t numDims : { 3, 8, 13, 16, 32, 64, 100, 128, 224 }) {
+		std::vector<float> a(numDims), b(numDims);
+		std::generate(a.begin(), a.end(), [&]() { return dist(gen); });
+		std::generate(b.begin(), b.end(), [&]() { return dist(gen); });
+
+		for (const auto metric : { utils::DistanceMetric::L2Sqr, utils::DistanceMetric::InnerProduct, utils::DistanceMetric::Cosine }) {
+			const float reference = utils::getDistanceFunction(metric, numDims, utils::SimdLevel::SCALAR)(a.data(), b.data(), numDims);
+
+			for (const auto level : { utils::SimdLevel::SSE, utils::SimdLevel::AVX2, utils::SimdLevel::AVX512 })
+				REQUIRE(std::abs(utils::getDistanceFunction(metric, numDims, level)(a.data(), b.data(), numDims) - reference) < 0.0001f * (1.0f + std::abs(reference)));
+		}
+	}
+}
+
+TEST_CASE("LandmarkMap CSR rows", "[types]")
+{
+	const LandmarkMap map({ 0, 2, 2, 5 }, { 1, 2, 3, 4, 5 });
+
+	REQUIRE(map.size() == 3);
+	REQUIRE(map.numIDs() == 5);
+	REQUIRE(map[1].empty());
+	REQUIRE(std::vector<uint32_t>(map[2].begin(), map[2].end()) == std::vector<uint32_t>{ 3, 4, 5 });
+
+	const LandmarkMap single = LandmarkMap::fromSingleIDs({ 7, 8 });
+	REQUIRE(single.size() == 2);
+	REQUIRE(single.rowSize(0) == 1);
+	REQUIRE(single[1][0] == 8);
+}
+
+TEST_CASE("NeighborMatrix rows", "[types]")
+{
+	NeighborMatrix neighbors(2, 3);
+
+	uint32_t* row = neighbors.rowData(1);
+	row[0] = 4;
+	row[1] = 2;
+	neighbors.setRowSize(1, 2);
+
+	REQUIRE(neighbors.size() == 2);
+	REQUIRE(neighbors.k() == 3);
+	REQUIRE(neighbors[0].empty());
+	REQUIRE(std::vector<uint32_t>(neighbors[1].begin(), neighbors[1].end()) == std::vector<uint32_t>{ 4, 2 });
+	REQUIRE(neighbors.getIDs()[5] == NO_LANDMARK);
+}
+
+TEST_CASE("Content hash", "[hashing]")
+{
+	// XXH64 reference values
+	REQUIRE(utils::xxhash64("", 0) == 0xEF46DB3751D8E999ULL);
+	REQUIRE(utils::xxhash64("abc", 3) == 0x44BC2CF5AD770999ULL);
+
+	// spans several hash blocks
+	std::vector<float> data(3'000'000);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<float>(i) * 0.5f;
+
+	const uint64_t hash = utils::contentHash(data);
+	REQUIRE(utils::contentHash(data) == hash);
+
+	data.back() += 1.0f;
+	REQUIRE(utils::contentHash(data) != hash);
+
+	data.pop_back();
+	REQUIRE(utils::contentHash(data) != hash);
+
+	REQUIRE(utils::hashToString(0xEF46DB3751D8E999ULL) == "ef46db3751d8e999");
+}
+
+TEST_CASE("LRU cache", "[caching]")
+{
+	// values are charged with their number of elements
+	utils::LruCache<int, std::vector<int>> cache(10, [](const std::vector<int>& value) { return value.size(); });
+
+	SECTION("Least recently used values are evicted") {
+		REQUIRE(cache.insert(1, std::vector<int>(4, 1)));
+		REQUIRE(cache.insert(2, std::vector<int>(4, 2)));
+		REQUIRE(cache.numBytes() == 8);
+
+		// finding 1 makes 2 the least recently used
+		REQUIRE(cache.find(1) != nullptr);
+		REQUIRE(cache.insert(3, std::vector<int>(4, 3)));
+
+		REQUIRE(cache.size() == 2);
+		REQUIRE(cache.numBytes() == 8);
+		REQUIRE(cache.contains(1));
+		REQUIRE_FALSE(cache.contains(2));
+		REQUIRE(cache.find(2) == nullptr);
+		REQUIRE(cache.find(3)->front() == 3);
+	}
+
+	SECTION("Replacing and modifying values") {
+		REQUIRE(cache.insert(1, std::vector<int>(2, 1)));
+		REQUIRE(cache.insert(1, std::vector<int>(3, 4)));
+		REQUIRE(cache.size() == 1);
+		REQUIRE(cache.numBytes() == 3);
+		REQUIRE(cache.find(1)->front() == 4);
+
+		REQUIRE(cache.insert(2, std::vector<int>(3, 2)));
+		REQUIRE(cache.modify(1, [](std::vector<int>& value) { value.resize(7); }));
+		REQUIRE(cache.numBytes() == 10);
+
+		// growing the least recently used value evicts the other one
+		REQUIRE(cache.modify(2, [](std::vector<int>& value) { value.resize(4); }));
+		REQUIRE_FALSE(cache.contains(1));
+		REQUIRE(cache.numBytes() == 4);
+
+		REQUIRE_FALSE(cache.modify(1, [](std::vector<int>& value) { value.clear(); }));
+	}
+
+	SECTION("Memory bound") {
+		REQUIRE_FALSE(cache.insert(1, std::vector<int>(11, 1)));
+		REQUIRE(cache.size() == 0);
+
+		REQUIRE(cache.insert(1, std::vector<int>(6, 1)));
+		REQUIRE(cache.insert(2, std::vector<int>(3, 2)));
+		cache.setMaxBytes(5);
+		REQUIRE(cache.size() == 1);
+		REQUIRE(cache.contains(2));
+
+		cache.setMaxBytes(0);
+		REQUIRE(cache.size() == 0);
+		REQUIRE(cache.numBytes() == 0);
+		REQUIRE_FALSE(cache.insert(3, std::vector<int>(1, 3)));
+	}
+}
+
+TEST_CASE("Cache file", "[caching]")
+{
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "ihp_tests.cache";
+	constexpr uint32_t formatVersion = 3;
+
+	const std::vector<uint64_t> offsets = { 0, 2, 5 };
+	const std::vector<uint32_t> indices = { 1, 2, 3, 4, 5 };
+
+	{
+		cache::CacheWriter writer(path, formatVersion);
+		REQUIRE(writer.isOpen());
+
+		writer.beginSection(1);
+		writer.writeString("{ \"numScales\": 2 }");
+		writer.writeValue(uint64_t(7));
+		writer.writeArray(offsets);
+		writer.writeArray(indices);
+		writer.endSection();
+
+		// array with a count that exceeds the section, count * sizeof(uint32_t) wraps around to 4
+		writer.beginSection(2);
+		writer.writeValue(uint64_t(1) << 62 | 1);
+		writer.writeValue(uint32_t(0));
+
+		REQUIRE(writer.commit());
+	}
+
+	const auto fileSize = std::filesystem::file_size(path);
+
+	// overwrites the bytes at the given offset from the end of the file
+	auto patchFile = [&path](const uint64_t offsetFromEnd, const auto& value) {
+		std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(-static_cast<std::streamoff>(offsetFromEnd), std::ios::end);
+		file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	};
+
+	SECTION("Round trip") {
+		cache::CacheReader reader(path, formatVersion);
+		REQUIRE(reader.isValid());
+		REQUIRE(reader.hasSection(1));
+		REQUIRE_FALSE(reader.hasSection(3));
+
+		auto section = reader.section(1);
+		std::string string;
+		uint64_t value = 0;
+		std::vector<uint64_t> readOffsets;
+		std::span<const uint32_t> readIndices;
+		REQUIRE(section.readString(string));
+		REQUIRE(section.readValue(value));
+		REQUIRE(section.readArray(readOffsets));
+		REQUIRE(section.viewArray(readIndices));
+
+		REQUIRE(string == "{ \"numScales\": 2 }");
+		REQUIRE(value == 7);
+		REQUIRE(readOffsets == offsets);
+		REQUIRE(std::vector<uint32_t>(readIndices.begin(), readIndices.end()) == indices);
+
+		// nothing left to read
+		REQUIRE_FALSE(section.readValue(value));
+
+		REQUIRE_FALSE(cache::CacheReader(path, formatVersion + 1).isValid());
+	}
+
+	SECTION("Bad array count") {
+		cache::CacheReader reader(path, formatVersion);
+		REQUIRE(reader.isValid());
+
+		std::span<const uint32_t> view;
+		REQUIRE_FALSE(reader.section(2).viewArray(view));
+		REQUIRE(view.empty());
+	}
+
+	SECTION("Truncated file") {
+		std::filesystem::resize_file(path, fileSize - 8);
+		REQUIRE_FALSE(cache::CacheReader(path, formatVersion).isValid());
+
+		std::filesystem::resize_file(path, 4);
+		REQUIRE_FALSE(cache::CacheReader(path, formatVersion).isValid());
+	}
+
+	SECTION("Huge number of sections") {
+		// table offset that matches the huge table, such that adding up table offset and size wraps around to the file size
+		const uint32_t numSections = std::numeric_limits<uint32_t>::max();
+		const uint64_t tableOffset = fileSize - sizeof(cache::CacheFileFooter) - uint64_t(numSections) * sizeof(cache::CacheSectionEntry);
+		patchFile(sizeof(cache::CacheFileFooter), tableOffset);
+		patchFile(sizeof(cache::CacheFileFooter) - offsetof(cache::CacheFileFooter, numSections), numSections);
+		REQUIRE_FALSE(cache::CacheReader(path, formatVersion).isValid());
+	}
+
+	SECTION("Section size that wraps around") {
+		// size of the last section in the table
+		const uint64_t sizeOffset = sizeof(cache::CacheFileFooter) + sizeof(cache::CacheSectionEntry) - offsetof(cache::CacheSectionEntry, size);
+		patchFile(sizeOffset, std::numeric_limits<uint64_t>::max() - 63);
+		REQUIRE_FALSE(cache::CacheReader(path, formatVersion).isValid());
+	}
+
+	std::filesystem::remove(path);
+}
+
+TEST_CASE("Parallel for", "[looping]")
+{
+	for (const auto policy : { utils::LoopPolicy::Sequential, utils::LoopPolicy::Parallel }) {
+		ScopedLoopPolicy loopPolicy(policy);
+
+		// every index in [begin, end) is visited exactly once, independent of the grain size
+		for (const size_t grainSize : { 0, 1, 7, 5000 }) {
+			std::vector<std::atomic<int>> visits(1000);
+			utils::parallel_for(size_t(3), size_t(1000), [&](const size_t i) { visits[i]++; }, grainSize);
+
+			for (size_t i = 0; i < visits.size(); i++)
+				REQUIRE(visits[i] == (i >= 3 ? 1 : 0));
+		}
+
+		// empty range
+		utils::parallel_for(uint32_t(0), [](const uint32_t) { FAIL(); });
+	}
+
+	// chunks are processed on more than one thread
+	const size_t numThreads = utils::Scheduler::instance().getNumThreads();
+	if (numThreads > 1) {
+		ScopedLoopPolicy loopPolicy(utils::LoopPolicy::Parallel);
+
+		std::mutex mutex;
+		std::set<std::thread::id> threads;
+		const auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+		utils::parallel_for(numThreads, [&](const size_t) {
+			// each chunk waits for a second thread, such that the calling thread cannot process all chunks alone
+			while (true) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					threads.insert(std::this_thread::get_id());
+					if (threads.size() > 1)
+						return;
+				}
+
+				if (std::chrono::steady_clock::now() > timeout)
+					return;
+
+				std::this_thread::yield();
+			}
+			}, 1);
+
+		REQUIRE(threads.size() > 1);
+	}
+
+	auto range = utils::pyrange(10);
+	REQUIRE(range.end() - range.begin() == 10);
+	REQUIRE(range.begin()[4] == 4);
+}
+
+TEST_CASE("Scheduler", "[looping]")
+{
+	auto& scheduler = utils::Scheduler::instance();
+	const size_t defaultNumThreads = scheduler.getNumThreads();
+
+	for (const size_t numThreads : { size_t(1), size_t(2), defaultNumThreads }) {
+		scheduler.setNumThreads(numThreads);
+		REQUIRE(scheduler.getNumThreads() >= 1);
+
+		// nested parallel sections must not deadlock and visit every index once
+		std::vector<std::atomic<int>> visits(64 * 100);
+		utils::parallel_for(size_t(64), [&](const size_t outer) {
+			utils::ScopedTaskPriority priority(outer % 2 ? utils::TaskPriority::Interactive : utils::TaskPriority::Background);
+			utils::parallel_for(size_t(100), [&](const size_t inner) { visits[outer * 100 + inner]++; }, 7);
+			}, 1);
+
+		for (const auto& visit : visits)
+			REQUIRE(visit == 1);
+
+		// parallel sort equals std::sort
+		std::mt19937 gen(static_cast<uint32_t>(numThreads));
+		std::uniform_int_distribution<uint32_t> dist(0, 1000);
+		std::vector<uint32_t> values(100'003);
+		std::generate(values.begin(), values.end(), [&]() { return dist(gen); });
+
+		std::vector<uint32_t> expected = values;
+		std::sort(expected.begin(), expected.end());
+		utils::parallel_sort(values.begin(), values.end());
+		REQUIRE(values == expected);
+
+		utils::parallel_sort(values.begin(), values.end(), std::greater<>());
+		REQUIRE(std::is_sorted(values.begin(), values.end(), std::greater<>()));
+	}
+
+	scheduler.setNumThreads(defaultNumThreads);
+}
+
+TEST_CASE("Counter-based random numbers", "[random]")
+{
+	// stateless: same seed and counter give the same value
+	REQUIRE(utils::splitmix64(42, 7) == utils::splitmix64(42, 7));
+	REQUIRE(utils::splitmix64(42, 7) != utils::splitmix64(42, 8));
+	REQUIRE(utils::splitmix64(42, 7) != utils::splitmix64(43, 7));
+
+	// points lie in the circle and are roughly centered
+	const size_t numPoints = 100'000;
+	const float radius = 2.0f;
+	mv::Vector2f mean(0, 0);
+	for (size_t i = 0; i < numPoints; i++) {
+		const auto point = utils::randomVec(radius, radius, 1, i);
+		REQUIRE(point.x * point.x + point.y * point.y <= radius * radius * 1.0001f);
+		mean.x += point.x / numPoints;
+		mean.y += point.y / numPoints;
+	}
+	REQUIRE(std::abs(mean.x) < 0.02f);
+	REQUIRE(std::abs(mean.y) < 0.02f);
+
+	// embeddings are bitwise identical independent of the number of threads
+	std::vector<float> embeddingSequential, embeddingParallel;
+
+	{
+		ScopedLoopPolicy loopPolicy(utils::LoopPolicy::Sequential);
+		utils::randomEmbedding(numPoints, 1.0f, 1.0f, utils::randomSeed(3), embeddingSequential);
+	}
+	{
+		ScopedLoopPolicy loopPolicy(utils::LoopPolicy::Parallel);
+		utils::randomEmbedding(numPoints, 1.0f, 1.0f, utils::randomSeed(3), embeddingParallel);
+	}
+
+	REQUIRE(embeddingSequential.size() == 2 * numPoints);
+	REQUIRE(embeddingSequential == embeddingParallel);
+}
+
+TEST_CASE("CPU t-SNE gradient descent", "[tsne]")
+{
+	const uint32_t numClusters = 3, clusterSize = 200;
+	const uint32_t numPoints = numClusters * clusterSize;
+	const HsneMatrix probabilities = clusteredProbabilities(numClusters, clusterSize, 10);
+
+	auto embed = [&](const float theta) {
+		hdi::data::Embedding<float> embedding;
+		hdi::dr::TsneParameters params;
+		params._seed = 1;
+		params._exaggeration_factor = 4;
+
+		TsneGradientDescentCPU gradientDescent;
+		gradientDescent.setTheta(theta);
+		REQUIRE(gradientDescent.initialize(probabilities, &embedding, params));
+
+		for (uint32_t iteration = 0; iteration < 500; iteration++)
+			gradientDescent.doAnIteration();
+
+		return embedding.getContainer();
+	};
+
+	// clusters are separated: centroid distance exceeds the mean distance to the centroid
+	auto checkSeparation = [&](const std::vector<float>& embedding) {
+		std::vector<mv::Vector2f> centroids(numClusters, mv::Vector2f(0, 0));
+		for (uint32_t i = 0; i < numPoints; i++) {
+			centroids[i / clusterSize].x += embedding[2 * i] / clusterSize;
+			centroids[i / clusterSize].y += embedding[2 * i + 1] / clusterSize;
+		}
+
+		float spread = 0;
+		for (uint32_t i = 0; i < numPoints; i++)
+			spread += std::hypot(embedding[2 * i] - centroids[i / clusterSize].x, embedding[2 * i + 1] - centroids[i / clusterSize].y) / numPoints;
+
+		for (uint32_t a = 0; a < numClusters; a++)
+			for (uint32_t b = a + 1; b < numClusters; b++)
+				REQUIRE(std::hypot(centroids[a].x - centroids[b].x, centroids[a].y - centroids[b].y) > 4 * spread);
+	};
+
+	const auto embeddingBarnesHut = embed(0.5f);
+	const auto embeddingExact = embed(0.0f);
+
+	REQUIRE(embeddingBarnesHut.size() == 2 * numPoints);
+	checkSeparation(embeddingBarnesHut);
+	checkSeparation(embeddingExact);
+
+	// independent of the number of threads
+	const auto embedWithPolicy = [&](const utils::LoopPolicy policy) {
+		ScopedLoopPolicy loopPolicy(policy);
+		return embed(0.5f);
+	};
+	REQUIRE(embedWithPolicy(utils::LoopPolicy::Sequential) == embedWithPolicy(utils::LoopPolicy::Parallel));
+
+	// a large theta never summarizes the cell of a point with the point itself:
+	// for two points all other cells are single points, so Barnes-Hut matches the exact forces
+	{
+		auto step = [](const TsneGradientDescentCPU::Repulsion repulsion, const float theta) {
+			hdi::data::Embedding<float> embedding;
+			embedding.getContainer() = { 0.0f, 0.0f, 1.0f, 0.0f };
+
+			hdi::dr::TsneParameters params;
+			params._presetEmbedding = true;
+
+			TsneGradientDescentCPU gradientDescent;
+			gradientDescent.setRepulsion(repulsion);
+			gradientDescent.setTheta(theta);
+			REQUIRE(gradientDescent.initialize(clusteredProbabilities(1, 2, 10), &embedding, params));
+			gradientDescent.doAnIteration();
+
+			return embedding.getContainer();
+		};
+
+		const auto positionsExact = step(TsneGradientDescentCPU::Repulsion::Exact, 0.0f);
+		const auto positionsBarnesHut = step(TsneGradientDescentCPU::Repulsion::BarnesHut, 3.0f);
+		for (size_t d = 0; d < positionsExact.size(); d++)
+			REQUIRE(std::abs(positionsBarnesHut[d] - positionsExact[d]) < 1e-5f);
+	}
+
+	// trees without extent: a single point and only coincident points
+	for (const uint32_t numCoincident : { 1u, 50u }) {
+		hdi::data::Embedding<float> embedding;
+		embedding.getContainer().assign(2 * numCoincident, 1.0f);
+
+		hdi::dr::TsneParameters params;
+		params._presetEmbedding = true;
+
+		TsneGradientDescentCPU gradientDescent;
+		gradientDescent.setRepulsion(TsneGradientDescentCPU::Repulsion::BarnesHut);
+		REQUIRE(gradientDescent.initialize(clusteredProbabilities(1, numCoincident, 10), &embedding, params));
+
+		for (uint32_t iteration = 0; iteration < 10; iteration++)
+			gradientDescent.doAnIteration();
+
+		for (const float value : embedding.getContainer())
+			REQUIRE(std::isfinite(value));
+	}
+}
+
+TEST_CASE("FFT-accelerated repulsive forces", "[tsne]")
+{
+	const size_t numPoints = 1000;
+	std::vector<float> positions(2 * numPoints);
+	for (size_t i = 0; i < numPoints; i++) {
+		const auto pos = utils::randomVec(20, 20, 7, i);
+		positions[2 * i] = pos.x;
+		positions[2 * i + 1] = pos.y;
+	}
+
+	TsneRepulsionFFT repulsion;
+	std::vector<float> forces;
+	const double normalization = repulsion.computeRepulsiveForces(positions, forces);
+	REQUIRE(forces.size() == 2 * numPoints);
+
+	double normalizationExact = 0, maxError = 0, maxForce = 0;
+	for (size_t i = 0; i < numPoints; i++) {
+		double forceX = 0, forceY = 0;
+		for (size_t j = 0; j < numPoints; j++) {
+			if (j == i)
+				continue;
+			const double dx = positions[2 * i] - positions[2 * j];
+			const double dy = positions[2 * i + 1] - positions[2 * j + 1];
+			const double q = 1.0 / (1.0 + dx * dx + dy * dy);
+			normalizationExact += q;
+			forceX += q * q * dx;
+			forceY += q * q * dy;
+		}
+		maxError = std::max(maxError, std::hypot(forceX - forces[2 * i], forceY - forces[2 * i + 1]));
+		maxForce = std::max(maxForce, std::hypot(forceX, forceY));
+	}
+
+	REQUIRE(std::abs(normalization - normalizationExact) < 1e-3 * normalizationExact);
+	REQUIRE(maxError < 1e-2 * maxForce);
+
+	// independent of the number of threads
+	const auto computeWithPolicy = [&](const utils::LoopPolicy policy, std::vector<float>& policyForces) {
+		ScopedLoopPolicy loopPolicy(policy);
+		return repulsion.computeRepulsiveForces(positions, policyForces);
+	};
+	std::vector<float> forcesSequential, forcesParallel;
+	REQUIRE(computeWithPolicy(utils::LoopPolicy::Sequential, forcesSequential) == computeWithPolicy(utils::LoopPolicy::Parallel, forcesParallel));
+	REQUIRE(forcesSequential == forcesParallel);
+}
+
+TEST_CASE("Exact repulsive forces", "[tsne]")
+{
+	// odd number of points, such that all kernels have a scalar tail
+	const size_t numPoints = 1003;
+	std::vector<float> positions(2 * numPoints);
+	for (size_t i = 0; i < numPoints; i++) {
+		const auto pos = utils::randomVec(20, 20, 7, i);
+		positions[2 * i] = pos.x;
+		positions[2 * i + 1] = pos.y;
+	}
+
+	double normalizationReference = 0;
+	std::vector<double> forcesReference(2 * numPoints, 0);
+	for (size_t i = 0; i < numPoints; i++) {
+		for (size_t j = 0; j < numPoints; j++) {
+			if (j == i)
+				continue;
+			const double dx = positions[2 * i] - positions[2 * j];
+			const double dy = positions[2 * i + 1] - positions[2 * j + 1];
+			const double q = 1.0 / (1.0 + dx * dx + dy * dy);
+			normalizationReference += q;
+			forcesReference[2 * i] += q * q * dx;
+			forcesReference[2 * i + 1] += q * q * dy;
+		}
+	}
+
+	for (const auto level : { utils::SimdLevel::SCALAR, utils::SimdLevel::SSE, utils::SimdLevel::AVX2, utils::SimdLevel::AVX512 }) {
+		TsneRepulsionExact repulsion;
+		std::vector<float> forces;
+		const double normalization = repulsion.computeRepulsiveForces(positions, forces, level);
+
+		REQUIRE(forces.size() == 2 * numPoints);
+		REQUIRE(std::abs(normalization - normalizationReference) < 1e-6 * normalizationReference);
+		for (size_t d = 0; d < 2 * numPoints; d++)
+			REQUIRE(std::abs(forces[d] - forcesReference[d]) < 1e-4);
+	}
+}
+
+TEST_CASE("Gradient descent selection", "[tsne]")
+{
+	TsneParameters parameters;
+	REQUIRE(parameters.getGradientDescentType() == GradientDescentType::Automatic);
+
+	const uint32_t exactThreshold = parameters.getExactGradientDescentThreshold();
+	const uint32_t fftThreshold = parameters.getFFTGradientDescentThreshold();
+	REQUIRE(exactThreshold < fftThreshold);
+
+	// small embeddings always use the exact kernel, large ones the GPU if possible
+	REQUIRE(parameters.selectGradientDescentType(exactThreshold - 1, true) == GradientDescentType::CPU_Exact);
+	REQUIRE(parameters.selectGradientDescentType(exactThreshold, true) == GradientDescentType::GPU);
+	REQUIRE(parameters.selectGradientDescentType(exactThreshold, false) == GradientDescentType::CPU_BarnesHut);
+	REQUIRE(parameters.selectGradientDescentType(fftThreshold, false) == GradientDescentType::CPU_FFT);
+
+	// explicit choices are kept, except for the GPU without OpenGL
+	parameters.setGradientDescentType(GradientDescentType::CPU_BarnesHut);
+	REQUIRE(parameters.selectGradientDescentType(10, true) == GradientDescentType::CPU_BarnesHut);
+	parameters.setGradientDescentType(GradientDescentType::GPU);
+	REQUIRE(parameters.selectGradientDescentType(10, true) == GradientDescentType::GPU);
+	REQUIRE(parameters.selectGradientDescentType(10, false) == GradientDescentType::CPU_BarnesHut);
+}
+
+TEST_CASE("Embedding snapshot", "[threading]")
+{
+	EmbeddingSnapshot snapshot;
+	REQUIRE(snapshot.acquire().numPoints == 0);
+
+	const uint32_t numPoints = 1000;
+	std::vector<float> embedding(2 * numPoints);
+
+	SECTION("Reader gets the latest embedding, notified once") {
+		std::fill(embedding.begin(), embedding.end(), 1.0f);
+		REQUIRE(snapshot.publish(embedding, numPoints, 2, 1));
+		std::fill(embedding.begin(), embedding.end(), 2.0f);
+		REQUIRE_FALSE(snapshot.publish(embedding, numPoints, 2, 2));
+		REQUIRE(snapshot.hasNewEmbedding());
+
+		const auto& latest = snapshot.acquire();
+		REQUIRE(latest.iteration == 2);
+		REQUIRE(latest.numPoints == numPoints);
+		REQUIRE(latest.data == embedding);
+		REQUIRE_FALSE(snapshot.hasNewEmbedding());
+
+		// nothing new: same embedding again
+		REQUIRE(snapshot.acquire().iteration == 2);
+		REQUIRE(snapshot.publish(embedding, numPoints, 2, 3));
+	}
+
+	SECTION("Buffers are reused") {
+		std::set<const float*> buffers;
+		for (uint32_t iteration = 0; iteration < 20; iteration++) {
+			snapshot.publish(embedding, numPoints, 2, iteration);
+			buffers.insert(snapshot.acquire().data.data());
+		}
+		REQUIRE(buffers.size() <= 3);
+	}
+
+	SECTION("Concurrent writer and reader") {
+		const uint32_t numIterations = 2000;
+		std::thread writer([&]() {
+			std::vector<float> values(2 * numPoints);
+			for (uint32_t iteration = 1; iteration <= numIterations; iteration++) {
+				std::fill(values.begin(), values.end(), static_cast<float>(iteration));
+				snapshot.publish(values, numPoints, 2, iteration);
+			}
+			});
+
+		uint32_t lastIteration = 0;
+		while (lastIteration < numIterations) {
+			const auto& latest = snapshot.acquire();
+			if (latest.numPoints == 0)
+				continue;
+
+			// never torn and never older than the previous read
+			REQUIRE(latest.iteration >= lastIteration);
+			REQUIRE(std::all_of(latest.data.begin(), latest.data.end(), [&](const float v) { return v == static_cast<float>(latest.iteration); }));
+			lastIteration = latest.iteration;
+		}
+
+		writer.join();
+	}
+}
+
+TEST_CASE("Cancellation token", "[threading]")
+{
+	std::atomic<uint64_t> requests{ 0 };
+
+	SECTION("Newer requests cancel earlier tokens") {
+		const utils::CancellationToken none;
+		REQUIRE_FALSE(none.isCancelled());
+
+		const utils::CancellationToken first(requests);
+		REQUIRE_FALSE(first.isCancelled());
+
+		++requests;
+		const utils::CancellationToken second(requests);
+		REQUIRE(first.isCancelled());
+		REQUIRE_FALSE(second.isCancelled());
+		REQUIRE(second.generation() == first.generation() + 1);
+	}
+
+	SECTION("Latest request wins") {
+		// a computation in stages, like HsneScaleUpdateWorker::computeScaleUpdate, always continues with the latest request
+		const uint64_t numRequests = 50;
+		const uint32_t numStages = 6;
+		std::atomic<uint64_t> lastCompleted{ 0 };
+		std::atomic<uint32_t> numCompleted{ 0 };
+
+		std::thread worker([&]() {
+			while (lastCompleted < numRequests) {
+				const utils::CancellationToken cancellation(requests);
+				if (cancellation.generation() == lastCompleted) {
+					std::this_thread::yield();
+					continue;
+				}
+
+				bool cancelled = false;
+				for (uint32_t stage = 0; stage < numStages && !cancelled; stage++) {
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+					cancelled = cancellation.isCancelled();
+				}
+
+				if (!cancelled) {
+					lastCompleted = cancellation.generation();
+					++numCompleted;
+				}
+			}
+			});
+
+		for (uint64_t request = 0; request < numRequests; request++) {
+			++requests;
+			std::this_thread::sleep_for(std::chrono::microseconds(20));
+		}
+
+		worker.join();
+
+		REQUIRE(lastCompleted == numRequests);
+		REQUIRE(numCompleted <= numRequests);
+	}
+}
+
+TEST_CASE("Viewport prediction", "[interaction]")
+{
+	utils::ViewportPredictor predictor;
+	predictor.setImageSize(100, 80);
+
+	auto sameLayerRoi = [](const utils::ROI& roi, float blX, float blY, float trX, float trY) {
+		return roi.layerBottomLeft == utils::Vector2D(blX, blY) && roi.layerTopRight == utils::Vector2D(trX, trY);
+	};
+
+	SECTION("No motion, no prediction") {
+		REQUIRE(predictor.predict(2).empty());
+
+		predictor.addViewport(utils::ROI(10, 10, 30, 30));
+		predictor.addViewport(utils::ROI(10, 10, 30, 30));
+		REQUIRE(predictor.predict(2).empty());
+	}
+
+	SECTION("Continued pan") {
+		predictor.addViewport(utils::ROI(10, 10, 30, 30));
+		predictor.addViewport(utils::ROI(15, 12, 35, 32));
+
+		const auto predictions = predictor.predict(2);
+		REQUIRE(predictions.size() == 2);
+		REQUIRE(sameLayerRoi(predictions[0], 20, 14, 40, 34));
+		REQUIRE(sameLayerRoi(predictions[1], 25, 16, 45, 36));
+	}
+
+	SECTION("Zoom around a fixed point") {
+		// zoom in by factor 2 around (20, 20)
+		predictor.addViewport(utils::ROI(0, 0, 80, 80));
+		predictor.addViewport(utils::ROI(10, 10, 50, 50));
+
+		const auto predictions = predictor.predict(2);
+		REQUIRE(predictions.size() == 2);
+		REQUIRE(sameLayerRoi(predictions[0], 15, 15, 35, 35));
+		REQUIRE(sameLayerRoi(predictions[1], 18, 18, 28, 28));    // 17.5 and 27.5 are rounded
+	}
+
+	SECTION("Predictions are clamped to the image") {
+		predictor.addViewport(utils::ROI(50, 40, 80, 70));
+		predictor.addViewport(utils::ROI(70, 50, 100, 80));
+
+		// further steps are outside the image and skipped
+		const auto predictions = predictor.predict(3);
+		REQUIRE(predictions.size() == 1);
+		REQUIRE(sameLayerRoi(predictions[0], 90, 60, 100, 80));
+	}
+
+	SECTION("Sequence viewports are added without duplicates") {
+		predictor.addViewport(utils::ROI(10, 10, 30, 30));
+		predictor.addViewport(utils::ROI(15, 10, 35, 30));
+		predictor.setSequenceViewports({ utils::ROI(20, 10, 40, 30), utils::ROI(15, 10, 35, 30), utils::ROI(0, 0, 20, 20) });
+
+		const auto predictions = predictor.predict(1);
+		REQUIRE(predictions.size() == 2);
+		REQUIRE(sameLayerRoi(predictions[0], 20, 10, 40, 30));
+		REQUIRE(sameLayerRoi(predictions[1], 0, 0, 20, 20));
+	}
+}
+
+TEST_CASE("Convergence monitor", "[tsne]")
+{
+	const uint32_t numPoints = 1000;
+	std::vector<float> embedding(2 * numPoints);
+	for (uint32_t i = 0; i < numPoints; i++) {
+		const auto pos = utils::randomVec(20, 20, 5, i);
+		embedding[2 * i] = pos.x;
+		embedding[2 * i + 1] = pos.y;
+	}
+
+	ConvergenceMonitor monitor;
+
+	SECTION("Translation and scaling do not count as change") {
+		monitor.setTolerance(1e-3f);
+		REQUIRE_FALSE(monitor.check(embedding, 2));
+		REQUIRE(monitor.getLastChange() < 0);
+
+		for (uint32_t check = 1; check <= ConvergenceMonitor::CHECKS_BELOW_TOLERANCE; check++) {
+			for (auto& value : embedding)
+				value = 1.5f * value + 3.0f;
+			REQUIRE(monitor.check(embedding, 2) == (check == ConvergenceMonitor::CHECKS_BELOW_TOLERANCE));
+			REQUIRE(monitor.getLastChange() < 1e-5f);
+		}
+	}
+
+	SECTION("Moving points reset the count") {
+		monitor.setTolerance(1e-3f);
+		monitor.check(embedding, 2);
+		monitor.check(embedding, 2);
+		embedding[0] += 20.0f;
+		REQUIRE_FALSE(monitor.check(embedding, 2));
+		REQUIRE(monitor.getLastChange() > 1e-3f);
+		REQUIRE_FALSE(monitor.check(embedding, 2));
+		REQUIRE(monitor.check(embedding, 2));
+	}
+
+	SECTION("Disabled without tolerance") {
+		for (uint32_t check = 0; check < 5; check++)
+			REQUIRE_FALSE(monitor.check(embedding, 2));
+	}
+
+	SECTION("Stops a t-SNE gradient descent") {
+		const HsneMatrix probabilities = clusteredProbabilities(2, 300, 10);
+
+		hdi::data::Embedding<float> tsneEmbedding;
+		hdi::dr::TsneParameters params;
+		params._seed = 1;
+
+		TsneGradientDescentCPU gradientDescent;
+		gradientDescent.setRepulsion(TsneGradientDescentCPU::Repulsion::Exact);
+		REQUIRE(gradientDescent.initialize(probabilities, &tsneEmbedding, params));
+
+		monitor.setTolerance(1e-3f);
+		const uint32_t checkBegin = params._remove_exaggeration_iter + params._exponential_decay_iter;
+		const uint32_t maxIterations = 5000;
+
+		uint32_t iteration = 0;
+		for (; iteration < maxIterations; iteration++) {
+			gradientDescent.doAnIteration();
+			if (iteration >= checkBegin && (iteration + 1) % 10 == 0 && monitor.check(tsneEmbedding.getContainer(), 2))
+				break;
+		}
+
+		REQUIRE(iteration > checkBegin);
+		REQUIRE(iteration < maxIterations);
+		REQUIRE(monitor.getLastChange() < 1e-3f);
+	}
+}
+
+TEST_CASE("Init-aware t-SNE schedule", "[tsne]")
+{
+	using utils::POINTINITTYPE;
+
+	std::vector<POINTINITTYPE> initTypes(100, POINTINITTYPE::previousPos);
+	std::fill_n(initTypes.begin(), 10, POINTINITTYPE::interpolPos);
+	std::fill_n(initTypes.begin() + 10, 5, POINTINITTYPE::randomPos);
+
+	const auto fractions = utils::computeInitTypeFractions(initTypes);
+	REQUIRE(std::abs(fractions.previousPos - 0.85f) < 1e-6f);
+	REQUIRE(std::abs(fractions.interpolPos - 0.10f) < 1e-6f);
+	REQUIRE(std::abs(fractions.randomPos - 0.05f) < 1e-6f);
+	REQUIRE(utils::computeInitTypeFractions({}).previousPos == 1.0f);
+
+	TsneParameters defaults;
+	defaults.setNumIterations(1000);
+
+	// random initialization: full schedule
+	TsneParameters random = defaults;
+	random.adaptScheduleToInitialization(0.0f, 1.0f);
+	REQUIRE(random.getNumIterations() == defaults.getNumIterations());
+	REQUIRE(random.getExaggerationIter() == defaults.getExaggerationIter());
+	REQUIRE(random.getExponentialDecayIter() == defaults.getExponentialDecayIter());
+	REQUIRE(random.getExaggerationFactor() == defaults.getExaggerationFactor());
+	REQUIRE(random.getLearningRate() == defaults.getLearningRate());
+
+	// mostly reused points: short refinement without exaggeration
+	TsneParameters reused = defaults;
+	reused.adaptScheduleToInitialization(0.0f, 0.0f);
+	REQUIRE(reused.getNumIterations() == 250);
+	REQUIRE(reused.getExaggerationIter() == 0);
+	REQUIRE(reused.getExponentialDecayIter() == 0);
+	REQUIRE(reused.getExaggerationFactor() == 1.0);
+	REQUIRE(reused.getLearningRate() == defaults.getLearningRate() * TsneParameters::MIN_LEARNING_RATE_FRACTION);
+
+	// in between: interpolated points count half
+	TsneParameters pan = defaults;
+	pan.adaptScheduleToInitialization(fractions.interpolPos, fractions.randomPos);
+	REQUIRE(pan.getNumIterations() == 250);
+	REQUIRE(pan.getExaggerationIter() == 25);
+	REQUIRE(pan.getExaggerationIter() < defaults.getExaggerationIter());
+	REQUIRE(pan.getLearningRate() < defaults.getLearningRate());
+	REQUIRE(pan.getLearningRate() > reused.getLearningRate());
+}
+
+TEST_CASE("Anchored t-SNE gradient descent", "[tsne]")
+{
+	const uint32_t clusterSize = 300;
+	const uint32_t numPoints = 2 * clusterSize;
+	const HsneMatrix probabilities = clusteredProbabilities(2, clusterSize, 10);
+
+	hdi::dr::TsneParameters params;
+	params._seed = 1;
+
+	// converged embedding, the previous embedding of a scale update
+	hdi::data::Embedding<float> previous;
+	{
+		TsneGradientDescentCPU gradientDescent;
+		REQUIRE(gradientDescent.initialize(probabilities, &previous, params));
+		for (uint32_t iteration = 0; iteration < 500; iteration++)
+			gradientDescent.doAnIteration();
+	}
+
+	// refinement without exaggeration
+	params._presetEmbedding = true;
+	params._remove_exaggeration_iter = 0;
+	params._exponential_decay_iter = 0;
+	params._exaggeration_factor = 1;
+
+	SECTION("Full mobility matches the regular gradient descent") {
+		hdi::data::Embedding<float> regular = previous, anchored = previous;
+
+		TsneGradientDescentCPU gradientDescentRegular, gradientDescentAnchored;
+		REQUIRE(gradientDescentRegular.initialize(probabilities, &regular, params));
+		REQUIRE(gradientDescentAnchored.initialize(probabilities, &anchored, params));
+		REQUIRE(gradientDescentAnchored.setMobility(std::vector<float>(numPoints, 1.0f), 20));
+		REQUIRE_FALSE(gradientDescentAnchored.setMobility(std::vector<float>(numPoints - 1, 1.0f), 20));
+
+		for (uint32_t iteration = 0; iteration < 20; iteration++) {
+			gradientDescentRegular.doAnIteration();
+			gradientDescentAnchored.doAnIteration();
+		}
+
+		REQUIRE(anchored.getContainer() == regular.getContainer());
+	}
+
+	SECTION("Frozen points stay, new points settle") {
+		// every tenth point is placed randomly, as new landmarks of a scale update
+		hdi::data::Embedding<float> embedding = previous;
+		std::vector<float>& positions = embedding.getContainer();
+		std::vector<float> mobility(numPoints, 0.0f);
+		for (uint32_t i = 0; i < numPoints; i += 10) {
+			const auto pos = utils::randomVec(1, 1, 3, i);
+			positions[2 * i] = pos.x;
+			positions[2 * i + 1] = pos.y;
+			mobility[i] = 1.0f;
+		}
+		const std::vector<float> initial = positions;
+
+		const uint32_t anchoredIterations = 100;
+		TsneGradientDescentCPU gradientDescent;
+		REQUIRE(gradientDescent.initialize(probabilities, &embedding, params));
+		REQUIRE(gradientDescent.setMobility(mobility, anchoredIterations));
+
+		for (uint32_t iteration = 0; iteration < anchoredIterations; iteration++)
+			gradientDescent.doAnIteration();
+
+		// frozen points did not move, new points are closer to their own than to the other cluster
+		std::vector<mv::Vector2f> centroids(2, mv::Vector2f(0, 0));
+		for (uint32_t i = 0; i < numPoints; i++) {
+			if (mobility[i] > 0)
+				continue;
+			REQUIRE(positions[2 * i] == initial[2 * i]);
+			REQUIRE(positions[2 * i + 1] == initial[2 * i + 1]);
+			centroids[i / clusterSize].x += positions[2 * i];
+			centroids[i / clusterSize].y += positions[2 * i + 1];
+		}
+
+		for (uint32_t i = 0; i < numPoints; i += 10) {
+			const auto& own = centroids[i / clusterSize];
+			const auto& other = centroids[1 - i / clusterSize];
+			const float frozenPerCluster = clusterSize * 9.0f / 10.0f;
+			const float distOwn = std::hypot(positions[2 * i] - own.x / frozenPerCluster, positions[2 * i + 1] - own.y / frozenPerCluster);
+			const float distOther = std::hypot(positions[2 * i] - other.x / frozenPerCluster, positions[2 * i + 1] - other.y / frozenPerCluster);
+			REQUIRE(distOwn < distOther);
+		}
+
+		// all points move after the anchored phase
+		gradientDescent.doAnIteration();
+		REQUIRE(positions[2] != initial[2]);
+	}
+
+	SECTION("A single new point") {
+		// the mobile points form a tree of one point
+		hdi::data::Embedding<float> embedding = previous;
+		std::vector<float> mobility(numPoints, 0.0f);
+		mobility[0] = 1.0f;
+		const std::vector<float> initial = embedding.getContainer();
+
+		TsneGradientDescentCPU gradientDescent;
+		gradientDescent.setRepulsion(TsneGradientDescentCPU::Repulsion::BarnesHut);
+		REQUIRE(gradientDescent.initialize(probabilities, &embedding, params));
+		REQUIRE(gradientDescent.setMobility(mobility, 10));
+
+		for (uint32_t iteration = 0; iteration < 10; iteration++)
+			gradientDescent.doAnIteration();
+
+		const std::vector<float>& positions = embedding.getContainer();
+		REQUIRE(std::isfinite(positions[0]));
+		REQUIRE(std::isfinite(positions[1]));
+		REQUIRE(std::equal(positions.begin() + 2, positions.end(), initial.begin() + 2));
+	}
+}
+
+TEST_CASE("Replacing points of a t-SNE gradient descent", "[tsne]")
+{
+	const uint32_t clusterSize = 300;
+	const uint32_t numPoints = 2 * clusterSize;
+	const HsneMatrix probabilities = clusteredProbabilities(2, clusterSize, 10);
+
+	// constant schedule, such that restarting it does not change the iterations
+	hdi::dr::TsneParameters params;
+	params._seed = 1;
+	params._mom_switching_iter = 0;
+	params._remove_exaggeration_iter = 0;
+	params._exponential_decay_iter = 0;
+	params._exaggeration_factor = 1;
+
+	hdi::data::Embedding<float> continued, replaced;
+	TsneGradientDescentCPU gradientDescentContinued, gradientDescentReplaced;
+	REQUIRE(gradientDescentContinued.initialize(probabilities, &continued, params));
+	REQUIRE(gradientDescentReplaced.initialize(probabilities, &replaced, params));
+	for (uint32_t iteration = 0; iteration < 50; iteration++) {
+		gradientDescentContinued.doAnIteration();
+		gradientDescentReplaced.doAnIteration();
+	}
+
+	params._presetEmbedding = true;
+
+	SECTION("Remaining points keep their optimizer state") {
+		const std::vector<float> positions = replaced.getContainer();
+		std::vector<uint32_t> previousIndices(numPoints);
+		std::iota(previousIndices.begin(), previousIndices.end(), 0);
+
+		REQUIRE(gradientDescentReplaced.replacePoints(probabilities, positions, previousIndices, params));
+
+		// as new points, all gains and the momentum are reset
+		hdi::data::Embedding<float> restarted = continued;
+		TsneGradientDescentCPU gradientDescentRestarted;
+		REQUIRE(gradientDescentRestarted.initialize(probabilities, &restarted, params));
+
+		for (uint32_t iteration = 0; iteration < 50; iteration++) {
+			gradientDescentContinued.doAnIteration();
+			gradientDescentReplaced.doAnIteration();
+			gradientDescentRestarted.doAnIteration();
+		}
+
+		REQUIRE(replaced.getContainer() == continued.getContainer());
+		REQUIRE(restarted.getContainer() != continued.getContainer());
+	}
+
+	SECTION("Removed and new points") {
+		// half of each cluster remains, the other half is new and placed randomly
+		const uint32_t newClusterSize = 200, numRemainingPerCluster = 150;
+		const HsneMatrix newProbabilities = clusteredProbabilities(2, newClusterSize, 10);
+
+		std::vector<float> positions(4 * newClusterSize);
+		std::vector<uint32_t> previousIndices(2 * newClusterSize, TsneGradientDescentCPU::NEW_POINT);
+		for (uint32_t i = 0; i < 2 * newClusterSize; i++) {
+			const uint32_t indexInCluster = i % newClusterSize;
+			if (indexInCluster < numRemainingPerCluster) {
+				previousIndices[i] = (i / newClusterSize) * clusterSize + indexInCluster;
+				positions[2 * i] = replaced.getContainer()[2 * previousIndices[i]];
+				positions[2 * i + 1] = replaced.getContainer()[2 * previousIndices[i] + 1];
+			}
+			else {
+				const auto pos = utils::randomVec(1, 1, 3, i);
+				positions[2 * i] = pos.x;
+				positions[2 * i + 1] = pos.y;
+			}
+		}
+
+		REQUIRE_FALSE(gradientDescentReplaced.replacePoints(newProbabilities, positions, std::vector<uint32_t>(numPoints, 0), params));
+		REQUIRE(gradientDescentReplaced.replacePoints(newProbabilities, positions, previousIndices, params));
+		REQUIRE(replaced.getContainer() == positions);
+
+		for (uint32_t iteration = 0; iteration < 100; iteration++)
+			gradientDescentReplaced.doAnIteration();
+
+		REQUIRE(replaced.getContainer().size() == positions.size());
+		for (const float value : replaced.getContainer())
+			REQUIRE(std::isfinite(value));
+	}
+}
+
+// forward-only index iterator, for comparison with the random access utils::pyrange
+struct ForwardIndexIterator
+{
+	using iterator_category = std::forward_iterator_tag;
+	using difference_type = std::ptrdiff_t;
+	using value_type = size_t;
+	using pointer = value_type*;
+	using reference = value_type&;
+
+	reference operator*() { return _val; }
+	ForwardIndexIterator& operator++() { _val++; return *this; }
+	ForwardIndexIterator operator++(int) { ForwardIndexIterator tmp = *this; ++(*this); return tmp; }
+	friend bool operator==(const ForwardIndexIterator& a, const ForwardIndexIterator& b) { return a._val == b._val; }
+	friend bool operator!=(const ForwardIndexIterator& a, const ForwardIndexIterator& b) { return a._val != b._val; }
+
+	size_t _val;
+};
+
+// Run with: FunctionTests "[benchmark]"
+TEST_CASE("Parallel for benchmark", "[.][benchmark]")
+{
+	const size_t numPoints = 4'000'000;
+	std::vector<float> in(numPoints), out(numPoints);
+	for (size_t i = 0; i < numPoints; i++)
+		in[i] = static_cast<float>(i) * 1e-7f;
+
+	auto work = [&](const size_t i) {
+		float x = in[i];
+		for (int k = 0; k < 16; k++)
+			x = std::sin(x) + 0.5f;
+		out[i] = x;
+	};
+
+	BENCHMARK("std::for_each, forward iterator") {
+		std::for_each(std::execution::par_unseq, ForwardIndexIterator{ 0 }, ForwardIndexIterator{ numPoints }, work);
+		return out[0];
+	};
+
+	BENCHMARK("std::for_each, random access pyrange") {
+		auto range = utils::pyrange(numPoints);
+		std::for_each(std::execution::par_unseq, range.begin(), range.end(), work);
+		return out[0];
+	};
+
+	BENCHMARK("parallel_for") {
+		ScopedLoopPolicy loopPolicy(utils::LoopPolicy::Parallel);
+		utils::parallel_for(numPoints, work);
+		return out[0];
+	};
+
+	BENCHMARK("parallel_for, sequential policy") {
+		ScopedLoopPolicy loopPolicy(utils::LoopPolicy::Sequential);
+		utils::parallel_for(numPoints, work);
+		return out[0];
+	};
+}
+
+// Calibrates TsneParameters::_exactGradientDescentThreshold and _fftGradientDescentThreshold
+// Run with: FunctionTests "[benchmark]"
+TEST_CASE("t-SNE repulsion benchmark", "[.][benchmark]")
+{
+	for (const uint32_t numPoints : { 1000u, 2000u, 5000u, 10000u, 25000u, 50000u }) {
+		// four clusters, embedded for some iterations to obtain a typical layout
+		const HsneMatrix probabilities = clusteredProbabilities(4, numPoints / 4, 10);
+
+		hdi::data::Embedding<float> embedding;
+		hdi::dr::TsneParameters params;
+		params._seed = 1;
+		{
+			TsneGradientDescentCPU gradientDescent;
+			REQUIRE(gradientDescent.initialize(probabilities, &embedding, params));
+			for (uint32_t iteration = 0; iteration < 500; iteration++)
+				gradientDescent.doAnIteration();
+		}
+		params._presetEmbedding = true;
+
+		for (const auto repulsion : { TsneGradientDescentCPU::Repulsion::Exact, TsneGradientDescentCPU::Repulsion::BarnesHut, TsneGradientDescentCPU::Repulsion::FFT }) {
+			if (repulsion == TsneGradientDescentCPU::Repulsion::Exact && numPoints > 10000)
+				continue;
+
+			hdi::data::Embedding<float> benchmarkEmbedding = embedding;
+			TsneGradientDescentCPU gradientDescent;
+			gradientDescent.setRepulsion(repulsion);
+			REQUIRE(gradientDescent.initialize(probabilities, &benchmarkEmbedding, params));
+
+			const std::string name = (repulsion == TsneGradientDescentCPU::Repulsion::Exact) ? "exact" : (repulsion == TsneGradientDescentCPU::Repulsion::FFT) ? "FFT" : "Barnes-Hut";
+			BENCHMARK(name + ", " + std::to_string(numPoints) + " points") {
+				gradientDescent.doAnIteration();
+				return gradientDescent.iteration();
+			};
+		}
+	}
+}